@@ -50,11 +50,8 @@ int fitwls(regdata *dat, estimate *est, int* restrict subset,
     double* restrict sigma = &est->sigma;
 
     // STEP 0: determine the optimal size of array 'work' and return
-    if (lwork < 0) {
-        F77_CALL(dgels)("N", &n, &p, &int_1, x, &n, y, &n, work_dgels, &lwork,
-            &info_dgels);
-        return (int) work_dgels[0];
-    }
+    if (lwork < 0)
+        return fitwls_lwork(n, p);
 
     // STEP 1: compute least squares fit
     // pre-multiply the design matrix and the response vector by sqrt(w)
@@ -66,7 +63,9 @@ int fitwls(regdata *dat, estimate *est, int* restrict subset,
         wx[i] = weight_sqrt[i] * indicator * x[i];
     }
 
-    #pragma omp parallel for if(n > FITWLS_OMP_MIN_SIZE)
+    // not in parallel if BLAS runs in parallel (see wbacon_threads.c)
+    #pragma omp parallel for if(n > FITWLS_OMP_MIN_SIZE \
+        && threads_blas_active() <= 1)
     for (int j = 1; j < p; j++) {
         #pragma omp simd
         for (int i = 0; i < n; i++)
@@ -103,3 +102,18 @@ int fitwls(regdata *dat, estimate *est, int* restrict subset,
 
     return 0;
 }
+
+/******************************************************************************\
+|* optimal size of the work array of fitwls (LAPACK: dgels workspace query)   *|
+|*  n, p    dimensions                                                        *|
+|* NOTE: the query does not reference the arrays                              *|
+\******************************************************************************/
+int fitwls_lwork(int n, int p)
+{
+    const int int_1 = 1, lwork = -1;
+    int info_dgels = 1;
+    double dummy = 0.0, query = 0.0;
+    F77_CALL(dgels)("N", &n, &p, &int_1, &dummy, &n, &dummy, &n, &query,
+        &lwork, &info_dgels);
+    return (int) query;
+}
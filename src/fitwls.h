@@ -15,4 +15,5 @@
 
 // prototypes for the functions
 int fitwls(regdata*, estimate*, int* restrict, double* restrict, int);
+int fitwls_lwork(int, int);
 #endif
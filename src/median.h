@@ -1,7 +1,7 @@
 #include <R.h>
+#include "selection.h"
 
 #ifndef _MEDIAN_H
 #define _MEDIAN_H
 void median_destructive(double*, int*, double*);
-void select_k(double *array, int lo, int hi, int k);
 #endif
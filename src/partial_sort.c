@@ -19,173 +19,285 @@
    Reference:  Bentley, J.L. and D.M. McIlroy (1993). Engineering a
                Sort Function, Software - Practice and Experience 23,
                pp. 1249-1265
+               Green, O., R. McColl, and D.A. Bader (2012). GPU Merge Path:
+               A GPU Merging Algorithm, Proceedings of the 26th ACM
+               International Conference on Supercomputing, pp. 331-340
 */
 
 #include "partial_sort.h"
 
-# define _large_array 50    // pivotal element determined by ninther
-
-static inline void swap2_indx(double* restrict, int* restrict, int, int)
-    __attribute__((always_inline));
-static inline int med3(double* restrict, int, int, int)
-    __attribute__((always_inline));
-static inline int choose_pivot(double* restrict, int, int)
-    __attribute__((always_inline));
-static inline int is_equal(double, double) __attribute__((always_inline));
-static inline void partition_3way_indx(double* restrict, int* restrict, int*,
-    int*, int*, int*)
-    __attribute__((always_inline));
-void partial_sort_with_index(double* restrict, int* restrict, int*, int*, int*);
+static void psort_radix(double* restrict, int* restrict, int, int,
+    double* restrict);
+static int psort_packed(double* restrict, int* restrict, int, int,
+    double* restrict);
+static void merge_parallel(wpair* restrict, int, wpair* restrict, int,
+    wpair* restrict);
+static inline int merge_corank(wpair* restrict, int, wpair* restrict, int,
+    int) __attribute__((always_inline));
 
 /******************************************************************************\
 |* partially sorts an array with index                                        *|
 |*  x      on return: partially sorted array[n]                               *|
 |*  index  on return: array[n] that is sorted along with x                    *|
 |*  n      dimension                                                          *|
-|*  k      all elements x[0..k] are sorted into their final position; the     *|
-|*         elements (k+1)..n are not sorted                                   *|
+|*  k      all elements x[0..(k-1)] are sorted into their final position; the *|
+|*         elements k..(n-1) are not sorted                                   *|
+|*  work   work array[n]                                                      *|
+|* NOTE: the k smallest elements are selected first and then sorted           *|
+|*       (introsort); the selection is by introselect (selection.c) or, for   *|
+|*       large arrays, by radix selection (radix_select.c). For k >           *|
+|*       PSORT_OMP_MIN_SIZE, the k smallest elements are sorted in parallel   *|
+|*       as packed (value, index) pairs; see psort_packed (if its scratch     *|
+|*       cannot be allocated, see mem_scratch, we take the serial path)       *|
 \******************************************************************************/
-void psort_array(double *x, int *index, int n, int k)
+void psort_array(double *x, int *index, int n, int k, double *work)
 {
-    for (int i = 0; i < n; i++)
-        index[i] = i;
-    int zero = 0, n_minus_one = n - 1, k_minus_one = k - 1;
-    partial_sort_with_index(x, index, &zero, &n_minus_one, &k_minus_one);
+    if (k > PSORT_OMP_MIN_SIZE && psort_packed(x, index, n, k, work))
+        return;
+
+    if (k < n && n > _n_radix) {
+        psort_radix(x, index, n, k, work);
+    } else {
+        for (int i = 0; i < n; i++)
+            index[i] = i;
+
+        if (k < n)
+            select_k_indx(x, index, 0, n - 1, k - 1);
+    }
+    select_sort_indx(x, index, 0, k - 1);
 }
 
 /******************************************************************************\
-|* partially sort a double array (along with the index) up to k-th largest    *|
-|* element                                                                    *|
-|*  x       on return: array[lo..hi] is sorted for the elements x[lo..k]      *|
-|*  index   on return: array[lo..hi] is sorted along with x                   *|
-|*  lo      dimension (usually: 0)                                            *|
-|*  hi      dimension (usually: n - 1)                                        *|
-|*  k       integer in 0..(n - 1); determines the k-th largest element up to  *|
-|*          which x is to be sorted                                           *|
+|* peak scratch of psort_array (bytes)                                        *|
+|*  n          dimension                                                      *|
+|*  k          number of elements to sort                                     *|
+|*  n_threads  max. number of threads (OpenMP)                                *|
 \******************************************************************************/
-void partial_sort_with_index(double* restrict x, int* restrict index,
-    int *lo, int *hi, int *k)
+double psort_array_scratch(int n, int k, int n_threads)
 {
-    if (*hi <= *lo)     // case: n = 1
-        return;
-
-//FIXME: insertion sort for small arrays
-
-    // Bentley-McIlroy's 3-way partitioning: the positions of the sentinels 'i'
-    // and 'j' are returned
-    int i, j;
-    partition_3way_indx(x, index, lo, hi, &i, &j);
-
-    // sort all elements that are smaller than the k-th value
-    partial_sort_with_index(x, index, lo, &j, k);
-    if (*k >= i)
-        partial_sort_with_index(x, index, &i, hi, k);
+    if (k > PSORT_OMP_MIN_SIZE) {
+        // pairs, merge buffer, and chunk counts; then, radix selection
+        double bytes = 2.0 * k * sizeof(wpair) + 3.0 * n_threads * sizeof(int);
+        if (k < n)
+            bytes += select_radix_scratch(n, n_threads);
+        return bytes;
+    }
+    if (k < n && n > _n_radix)
+        return select_radix_scratch(n, n_threads);
+    return 0.0;
 }
 
 /******************************************************************************\
-|* Bentley and McIlroy's (1993) 3-way partitioning scheme with index          *|
-|*  array   array[lo..hi]                                                     *|
-|*  index   array[lo..hi]                                                     *|
-|*  lo, hi  dimensions                                                        *|
-|*  i, j    sentinels scanning up and down                                    *|
+|* top-k index extraction by radix selection (for internal use)               *|
+|*  x      on return: array[n] is permuted s.t. x[0..(k-1)] are the k         *|
+|*         smallest elements (not sorted)                                     *|
+|*  index  on return: array[n] that is permuted along with x                  *|
+|*  n      dimension                                                          *|
+|*  k      number of elements to extract                                      *|
+|*  work   work array[n]                                                      *|
 \******************************************************************************/
-static inline void partition_3way_indx(double* restrict array,
-    int* restrict index, int *lo, int *hi, int *i, int *j)
+static void psort_radix(double* restrict x, int* restrict index, int n, int k,
+    double* restrict work)
 {
-    // determine pivot and swap it into position 'lo' (i.e., position 0)
-    swap2_indx(array, index, choose_pivot(array, *lo, *hi), *lo);
-    double pivot = array[*lo];
+    // the k-th smallest element is the threshold
+    double threshold = select_radix(x, n, k - 1, work);
 
-    // Bentley-McIlroy's 3-way partitioning with sentinels i and j,
-    // respectively, scanning up and down until they cross; elements equal to
-    // the pivot are swapped to the far left and right,
-
-    int p = *lo, q = *hi + 1;
-    *i = *lo; *j = *hi + 1;             // initialize the sentinels
+    // indices of the elements smaller than the threshold go to the front;
+    // all other indices go to the back
+    int lo = 0, hi = n - 1;
+    for (int i = 0; i < n; i++) {
+        if (x[i] < threshold)
+            index[lo++] = i;
+        else
+            index[hi--] = i;
+    }
 
-    for (;;) {
-        while (array[++(*i)] < pivot)
-        if (*i == *hi)
-            break;
+    // ties with the threshold are moved to the front of the back part
+    int tmp;
+    for (int i = lo; i < n && lo < k; i++) {
+        if (x[index[i]] <= threshold) {
+            tmp = index[i]; index[i] = index[lo]; index[lo] = tmp;
+            lo++;
+        }
+    }
 
-        while (pivot < array[--(*j)])
+    // permute x along with the index
+    for (int i = 0; i < n; i++)
+        work[i] = x[index[i]];
+    Memcpy(x, work, n);
+}
 
-        if (*j == *lo)
-            break;
+/******************************************************************************\
+|* parallel partial sort of (value, index) pairs (for internal use)           *|
+|*  x      on return: partially sorted array[n]                               *|
+|*  index  on return: array[n] that is sorted along with x                    *|
+|*  n      dimension                                                          *|
+|*  k      number of elements to sort                                         *|
+|*  work   work array[n]                                                      *|
+|* NOTE: (1) the k-th smallest element (threshold) is determined by radix     *|
+|*       selection; (2) the elements smaller than, equal to, and larger than  *|
+|*       the threshold are scattered in parallel (stable; every chunk writes  *|
+|*       to its own offsets), the first k elements go to a packed array of    *|
+|*       pairs (the index is stored as double in slot 'w'; a pair of doubles  *|
+|*       is moved as one 16-byte unit, a double/int struct is not);           *|
+|*       (3) runs of _PSORT_RUN pairs are sorted in                           *|
+|*       parallel (introsort); (4) the runs are merged pairwise, every merge  *|
+|*       is split among the threads by merge path. The run size does not      *|
+|*       depend on the number of threads; hence, the result does not either   *|
+|* Return value: 1: sorted; 0: the scratch cannot be allocated (see           *|
+|*               mem_scratch), x and index are not modified                   *|
+\******************************************************************************/
+static int psort_packed(double* restrict x, int* restrict index, int n, int k,
+    double* restrict work)
+{
+    int n_chunks = 1;
+    #ifdef _OPENMP
+    n_chunks = omp_get_max_threads();
+    #endif
+    wpair* restrict a = (wpair*) mem_scratch(k, sizeof(wpair));
+    wpair* restrict buf = (wpair*) mem_scratch(k, sizeof(wpair));
+    int* restrict count = (int*) mem_scratch(3 * n_chunks, sizeof(int));
+    if (a == NULL || buf == NULL || count == NULL) {
+        mem_free(a); mem_free(buf); mem_free(count);
+        return 0;
+    }
 
-        if (*i == *j && is_equal(array[*i], pivot))
-        swap2_indx(array, index, ++p, *i);
+    if (k < n) {
+        double threshold = select_radix(x, n, k - 1, work);
+        int chunk_size = n / n_chunks + 1;
 
-        if (*i >= *j)                   // check if sentinels cross
-            break;
+        // count the elements per chunk: smaller, equal, and larger
+        #pragma omp parallel for num_threads(n_chunks) schedule(static, 1)
+        for (int c = 0; c < n_chunks; c++) {
+            int hi = (c + 1) * chunk_size < n ? (c + 1) * chunk_size : n;
+            int lt = 0, eq = 0;
+            for (int i = c * chunk_size; i < hi; i++) {
+                lt += x[i] < threshold;
+                eq += x[i] == threshold;
+            }
+            count[3 * c] = lt;
+            count[3 * c + 1] = eq;
+            count[3 * c + 2] = (hi > c * chunk_size ? hi - c * chunk_size : 0)
+                - lt - eq;
+        }
 
-        swap2_indx(array, index, *i, *j);
+        // offsets (exclusive prefix sums over the classes and the chunks)
+        int offset = 0, tmp;
+        for (int cls = 0; cls < 3; cls++) {
+            for (int c = 0; c < n_chunks; c++) {
+                tmp = count[3 * c + cls];
+                count[3 * c + cls] = offset;
+                offset += tmp;
+            }
+        }
 
-        // swap equal elements to the far left and right, respectively
-        if (is_equal(array[*i], pivot))
-            swap2_indx(array, index, ++p, *i);
+        // scatter: position < k goes to the packed array; otherwise, the
+        // element is stored in index and work
+        #pragma omp parallel for num_threads(n_chunks) schedule(static, 1)
+        for (int c = 0; c < n_chunks; c++) {
+            int hi = (c + 1) * chunk_size < n ? (c + 1) * chunk_size : n;
+            int at[3] = {count[3 * c], count[3 * c + 1], count[3 * c + 2]};
+            int pos;
+            for (int i = c * chunk_size; i < hi; i++) {
+                pos = at[(x[i] >= threshold) + (x[i] > threshold)]++;
+                if (pos < k) {
+                    a[pos].x = x[i];
+                    a[pos].w = (double)i;
+                } else {
+                    index[pos] = i;
+                    work[pos] = x[i];
+                }
+            }
+        }
 
-        if (is_equal(array[*j], pivot))
-            swap2_indx(array, index, --q, *j);
+        #pragma omp parallel for if(n - k > PSORT_OMP_MIN_SIZE)
+        for (int i = k; i < n; i++)
+            x[i] = work[i];
+    } else {
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            a[i].x = x[i];
+            a[i].w = (double)i;
+        }
     }
 
-    // swap equal elements from the borders back to the center
-    *i = *j + 1;
-    for (int k = *lo; k <= p; k++)
-        swap2_indx(array, index, k, (*j)--);
+    // sort the runs
+    int n_runs = (k + _PSORT_RUN - 1) / _PSORT_RUN;
+    #pragma omp parallel for schedule(dynamic)
+    for (int r = 0; r < n_runs; r++) {
+        int hi = (r + 1) * _PSORT_RUN < k ? (r + 1) * _PSORT_RUN : k;
+        select_sort_pair(a, r * _PSORT_RUN, hi - 1);
+    }
 
-    for (int k = *hi; k >= q; k--)
-        swap2_indx(array, index, k, (*i)++);
-}
+    // merge the runs pairwise (the result of a round goes to 'buf')
+    wpair* restrict tmp;
+    for (int width = _PSORT_RUN; width < k; width *= 2) {
+        for (int lo = 0; lo < k; lo += 2 * width) {
+            int mid = lo + width < k ? lo + width : k;
+            int hi = lo + 2 * width < k ? lo + 2 * width : k;
+            merge_parallel(a + lo, mid - lo, a + mid, hi - mid, buf + lo);
+        }
+        tmp = a; a = buf; buf = tmp;
+    }
 
-/******************************************************************************\
-|* choose pivotal element: for arrays of size < _large_array, the median of   *|
-|* three is taken as pivotal element, otherwise we take Tukey's ninther       *|
-|*  array   array[lo..hi]                                                     *|
-|*  lo, hi  dimension                                                         *|
-\******************************************************************************/
-static inline int choose_pivot(double* restrict array, int lo, int hi)
-{
-    int n = hi - lo + 1;
-    int mid = lo + n / 2;       // small array: median of three
-    if (n > _large_array) {     // large array: Tukey's ninther
-        int eps = n / 8;
-        lo = med3(array, lo, lo + eps, lo + eps + eps);
-        mid = med3(array, mid - eps, mid, mid + eps);
-        hi = med3(array, hi - eps - eps, hi - eps, hi);
+    // unpack
+    #pragma omp parallel for
+    for (int i = 0; i < k; i++) {
+        x[i] = a[i].x;
+        index[i] = (int)a[i].w;
     }
-    return med3(array, lo, mid, hi);
+    mem_free(a); mem_free(buf); mem_free(count);
+    return 1;
 }
 
 /******************************************************************************\
-|* swap the elements i and j in array and index                               *|
-|*  array  array[n]                                                           *|
-|*  index  array[n]                                                           *|
-|*  i, j   elements to be swapped                                             *|
+|* stable merge of two sorted arrays (for internal use)                       *|
+|*  a, na  sorted array[na]                                                   *|
+|*  b, nb  sorted array[nb]                                                   *|
+|*  out    on return: merged array[na + nb]                                   *|
+|* NOTE: the output is split into one segment per thread; the segment         *|
+|*       boundaries are located in 'a' and 'b' by merge_corank                *|
 \******************************************************************************/
-static inline void swap2_indx(double* restrict array, int* restrict index,
-    int i, int j)
+static void merge_parallel(wpair* restrict a, int na, wpair* restrict b,
+    int nb, wpair* restrict out)
 {
-    double tmp0 = array[i]; array[i] = array[j]; array[j] = tmp0;
-    int tmp1 = index[i]; index[i] = index[j]; index[j] = tmp1;
-}
+    int n = na + nb, n_seg = 1;
+    #ifdef _OPENMP
+    if (n > PSORT_OMP_MIN_SIZE)
+        n_seg = omp_get_max_threads();
+    #endif
 
-/******************************************************************************\
-|* is_equal: check whether two doubles are equal using Knuth's notion of      *|
-|* essential equality                                                         *|
-\******************************************************************************/
-static inline int is_equal(double a, double b)
-{
-    return fabs(a - b) <= ( (fabs(a) > fabs(b) ? fabs(b) :
-        fabs(a)) * DBL_EPSILON);
+    #pragma omp parallel for num_threads(n_seg) schedule(static, 1)
+    for (int s = 0; s < n_seg; s++) {
+        int d_lo = (int)((double)n * s / n_seg);
+        int d_hi = (int)((double)n * (s + 1) / n_seg);
+        int i = merge_corank(a, na, b, nb, d_lo);
+        int j = d_lo - i;
+        int i_hi = merge_corank(a, na, b, nb, d_hi);
+        int j_hi = d_hi - i_hi;
+        for (int d = d_lo; d < d_hi; d++) {
+            if (j >= j_hi || (i < i_hi && a[i].x <= b[j].x))
+                out[d] = a[i++];
+            else
+                out[d] = b[j++];
+        }
+    }
 }
 
 /******************************************************************************\
-|* median-of-three (without swaps)                                            *|
+|* number of elements of 'a' among the first d elements of the stable merge   *|
+|* of 'a' and 'b' (binary search on the merge path)                           *|
 \******************************************************************************/
-static inline int med3(double* restrict array, int i, int j, int k)
+static inline int merge_corank(wpair* restrict a, int na, wpair* restrict b,
+    int nb, int d)
 {
-    return array[i] < array[j] ?
-        (array[j] < array[k] ? j : array[i] < array[k] ? k : i)
-        :   (array[j] > array[k] ? j : array[i] > array[k] ? k : i);
+    int lo = d > nb ? d - nb : 0, hi = d < na ? d : na, i;
+    while (lo < hi) {
+        i = lo + (hi - lo) / 2;
+        if (a[i].x <= b[d - i - 1].x)   // a[i] precedes b[d - i - 1]
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
 }
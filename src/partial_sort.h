@@ -1,6 +1,16 @@
 #include <R.h>
+#include "selection.h"
+#include "radix_select.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 #ifndef _PARTIAL_SORT_H
 #define _PARTIAL_SORT_H
-void psort_array(double*, int*, int, int);
+
+#define PSORT_OMP_MIN_SIZE 100000   // packed parallel sort when k > this
+#define _PSORT_RUN 262144           // size of the runs that are sorted first
+void psort_array(double*, int*, int, int, double*);
+double psort_array_scratch(int, int, int);
 #endif
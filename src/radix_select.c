@@ -0,0 +1,189 @@
+/* radix selection of the k-th smallest element of a double array
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The bit pattern of an IEEE 754 double can be mapped to an
+               unsigned 64-bit integer whose order is the order of the
+               doubles (most significant digit first). The selection works
+               on the digits of this key: a histogram of the leading 16 bits
+               determines the bucket where the k-th element lies; the
+               candidates in this bucket are copied into a work array and
+               the process is repeated on the next 16 bits until only a few
+               candidates are left.
+*/
+
+#include "radix_select.h"
+
+#define _RADIX_BITS 16
+#define _RADIX_BUCKETS (1 << _RADIX_BITS)
+
+static inline uint64_t radix_key(double) __attribute__((always_inline));
+static int radix_bucket(int* restrict, int, int*);
+
+/******************************************************************************\
+|* select the k-th smallest element by MSD radix selection                    *|
+|*  x       array[n] (not modified)                                           *|
+|*  n       dimension                                                         *|
+|*  k       integer in 0:(n - 1)                                              *|
+|*  work    work array[n]                                                     *|
+|* NOTE: the first digit is histogrammed in parallel (one histogram per chunk *|
+|*       of the array); the candidates are then copied in one pass, each      *|
+|*       chunk to its own offset in 'work'. For n <= _n_radix, the function   *|
+|*       falls back to select_k on a copy of x                                *|
+\******************************************************************************/
+double select_radix(double* restrict x, int n, int k, double* restrict work)
+{
+    if (n <= _n_radix) {
+        Memcpy(work, x, n);
+        select_k(work, 0, n - 1, k);
+        return work[k];
+    }
+
+    int n_chunks = 1;
+    #ifdef _OPENMP
+    if (n > RADIX_OMP_MIN_SIZE)
+        n_chunks = omp_get_max_threads();
+    #endif
+    int chunk_size = n / n_chunks + 1;
+    int* restrict hist = (int*) mem_scratch(n_chunks * _RADIX_BUCKETS,
+        sizeof(int));
+    int* restrict count = (int*) mem_scratch(n_chunks, sizeof(int));
+
+    // no scratch (see mem_scratch): introselect on a copy of x
+    if (hist == NULL || count == NULL) {
+        mem_free(hist); mem_free(count);
+        Memcpy(work, x, n);
+        select_k(work, 0, n - 1, k);
+        return work[k];
+    }
+
+    // first digit: histogram (one per chunk)
+    int shift = 64 - _RADIX_BITS;
+    #pragma omp parallel for num_threads(n_chunks) schedule(static, 1)
+    for (int c = 0; c < n_chunks; c++) {
+        int* restrict h = hist + c * _RADIX_BUCKETS;
+        int hi = (c + 1) * chunk_size < n ? (c + 1) * chunk_size : n;
+        for (int i = c * chunk_size; i < hi; i++)
+            h[radix_key(x[i]) >> shift]++;
+    }
+
+    // reduce the histograms (into the histogram of the first chunk)
+    for (int c = 1; c < n_chunks; c++)
+        for (int b = 0; b < _RADIX_BUCKETS; b++)
+            hist[b] += hist[c * _RADIX_BUCKETS + b];
+
+    int bucket = radix_bucket(hist, _RADIX_BUCKETS, &k);
+    int n_cand = hist[bucket];
+
+    // offsets of the chunks in work (determined by the per-chunk counts of
+    // the selected bucket)
+    count[0] = n_cand;
+    for (int c = 1; c < n_chunks; c++) {
+        count[c] = hist[c * _RADIX_BUCKETS + bucket];
+        count[0] -= count[c];
+    }
+    for (int c = 1; c < n_chunks; c++)
+        count[c] += count[c - 1];
+
+    // copy the candidates (i.e. the elements in 'bucket') to work
+    uint64_t b0 = (uint64_t)bucket;
+    #pragma omp parallel for num_threads(n_chunks) schedule(static, 1)
+    for (int c = 0; c < n_chunks; c++) {
+        int at = c == 0 ? 0 : count[c - 1];
+        int hi = (c + 1) * chunk_size < n ? (c + 1) * chunk_size : n;
+        for (int i = c * chunk_size; i < hi; i++)
+            if ((radix_key(x[i]) >> shift) == b0)
+                work[at++] = x[i];
+    }
+    mem_free(count);
+
+    // next digits (serial, on the candidates)
+    const uint64_t mask = _RADIX_BUCKETS - 1;
+    while (n_cand > _n_radix_finish && shift > 0) {
+        shift -= _RADIX_BITS;
+        for (int b = 0; b < _RADIX_BUCKETS; b++)
+            hist[b] = 0;
+        for (int i = 0; i < n_cand; i++)
+            hist[(radix_key(work[i]) >> shift) & mask]++;
+
+        bucket = radix_bucket(hist, _RADIX_BUCKETS, &k);
+        if (hist[bucket] == n_cand)     // all candidates share the digit
+            continue;
+
+        b0 = (uint64_t)bucket;
+        int at = 0;
+        for (int i = 0; i < n_cand; i++) {
+            work[at] = work[i];
+            at += ((radix_key(work[i]) >> shift) & mask) == b0;
+        }
+        n_cand = at;
+    }
+    mem_free(hist);
+
+    // all digits are exhausted: the candidates are identical
+    if (n_cand > _n_radix_finish)
+        return work[0];
+
+    select_k(work, 0, n_cand - 1, k);
+    return work[k];
+}
+
+/******************************************************************************\
+|* peak scratch of select_radix (bytes)                                       *|
+|*  n          dimension                                                      *|
+|*  n_threads  max. number of threads (OpenMP)                                *|
+\******************************************************************************/
+double select_radix_scratch(int n, int n_threads)
+{
+    if (n <= _n_radix)
+        return 0.0;
+    double n_chunks = n > RADIX_OMP_MIN_SIZE ? (double)n_threads : 1.0;
+    return n_chunks * (_RADIX_BUCKETS + 1) * sizeof(int);
+}
+
+/******************************************************************************\
+|* bucket that contains the k-th smallest element                             *|
+|*  hist    histogram, array[n_buckets]                                       *|
+|*  n_buckets dimension                                                       *|
+|*  k       on entry: rank (0-based); on return: rank within the bucket       *|
+\******************************************************************************/
+static int radix_bucket(int* restrict hist, int n_buckets, int *k)
+{
+    int b, cumsum = 0;
+    for (b = 0; b < n_buckets; b++) {
+        if (cumsum + hist[b] > *k)
+            break;
+        cumsum += hist[b];
+    }
+    *k -= cumsum;
+    return b;
+}
+
+/******************************************************************************\
+|* order-preserving map of a double to an unsigned 64-bit integer: the sign   *|
+|* bit of positive numbers is flipped; all bits of negative numbers are       *|
+|* flipped                                                                    *|
+\******************************************************************************/
+static inline uint64_t radix_key(double x)
+{
+    uint64_t u;
+    memcpy(&u, &x, sizeof(double));
+    return u ^ ((uint64_t)((int64_t)u >> 63) | 0x8000000000000000ULL);
+}
+
+#undef _RADIX_BITS
+#undef _RADIX_BUCKETS
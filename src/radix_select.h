@@ -0,0 +1,19 @@
+#include <R.h>
+#include <stdint.h>
+#include "selection.h"
+#include "wbacon_memory.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+#define RADIX_OMP_MIN_SIZE 1000000  // parallel histograms when n > this
+
+#ifndef _RADIX_SELECT_H
+#define _RADIX_SELECT_H
+
+#define _n_radix 100000             // radix selection when n > _n_radix
+#define _n_radix_finish 4096        // candidates are finished by select_k
+
+double select_radix(double* restrict, int, int, double* restrict);
+double select_radix_scratch(int, int);
+#endif
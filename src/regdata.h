@@ -1,3 +1,8 @@
+#include "wbacon_trace.h"
+#include "wbacon_threads.h"
+#include "wbacon_deadline.h"
+#include "wbacon_checkpoint.h"
+
 #ifndef _REGDATA_H
 #define _REGDATA_H
 
@@ -11,6 +16,13 @@ typedef struct regdata_struct {
     double *wx;
     double *y;          // response vector (raw and weighted)
     double *wy;
+    wbacon_trace *trace;    // per-phase timing
+    wbacon_threads *blas;   // threads of BLAS
+    int blas_threads;       // threads of BLAS in fitwls and hat_matrix
+    wbacon_deadline *deadline;  // time budget and cancellation
+    wbacon_checkpoint *checkpoint;  // checkpoints of the state
+    const double *t_quantile;   // cutoffs of Algorithm 5 by the size of the
+                                // subset, array[n + 1] (NULL: by qt)
 } regdata;
 
 // structure of estimates
@@ -0,0 +1,157 @@
+/* selection and (partial) sorting engine: plain array, array with weights,
+   array with index, and array of (value, weight) pairs
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Reference:  Bentley, J.L. and D.M. McIlroy (1993). Engineering a
+               Sort Function, Software - Practice and Experience 23,
+               pp. 1249-1265
+               Blum, M., R.W. Floyd, V. Pratt, R.L. Rivest, and R.E. Tarjan
+               (1973). Time Bounds for Selection, Journal of Computer and
+               System Sciences 7, pp. 448-461
+               Musser, D.R. (1997). Introspective Sorting and Selection
+               Algorithms, Software - Practice and Experience 27,
+               pp. 983-993
+   Note:       The four variants (plain, weighted, indexed, and pairs) are
+               generated from the same source, 'selection_template.h'; they
+               differ only in the type of the elements and in the auxiliary
+               array that is swapped along with the data array.
+*/
+
+#include "selection.h"
+
+#define _STACK_SIZE 64      // max. depth of the explicit stack in select_sort
+
+#ifdef SELECT_STATS
+select_stats_type select_stats;
+
+/******************************************************************************\
+|* nesting depth of a partitioning step (instrumentation, see selection.h)    *|
+|*  lo, hi  range of the partitioning step                                    *|
+|* NOTE: the ranges of the partitioning steps are nested (a step works on a   *|
+|*       part of the range of its parent); the enclosing ranges are kept on a *|
+|*       stack, and the ranges that do not contain [lo, hi] are popped        *|
+\******************************************************************************/
+void select_stats_depth(int lo, int hi)
+{
+    select_stats_type *s = &select_stats;
+    while (s->n_open > 0 && (lo < s->open_lo[s->n_open - 1]
+            || hi > s->open_hi[s->n_open - 1]))
+        s->n_open--;
+    if (s->n_open == SELECT_STATS_MAX_OPEN)    // the depth saturates
+        s->n_open--;
+    s->open_lo[s->n_open] = lo;
+    s->open_hi[s->n_open] = hi;
+    s->n_open++;
+    s->max_depth = s->n_open > s->max_depth ? s->n_open : s->max_depth;
+}
+#endif
+
+/******************************************************************************\
+|* depth limit of the introspective algorithms: 2 * floor(log2(n)); when the  *|
+|* limit is reached, the pivot is determined by the median of medians, which  *|
+|* guarantees n log n time for sorting (for selection, see select_progress)   *|
+|*  n   dimension                                                             *|
+\******************************************************************************/
+int select_depth_limit(int n)
+{
+    int depth = 0;
+    while (n > 1) {
+        n >>= 1;
+        depth++;
+    }
+    return 2 * depth;
+}
+
+/******************************************************************************\
+|* progress of a selection (introselect; Musser, 1997): if the range has not  *|
+|* been halved within _n_shrink partitioning steps, the depth budget is       *|
+|* exhausted; hence, the remaining pivots are medians of medians              *|
+|*  n       size of the range after the partitioning step                     *|
+|*  size    size of the range at the last check (initialized with the size of *|
+|*          the array)                                                        *|
+|*  steps   number of steps since the last check (initialized with 0)         *|
+|*  depth   remaining depth budget (see select_partition)                     *|
+|* NOTE: a step with the median of medians shrinks the range by a constant    *|
+|*       fraction (at most 7/10 of the elements remain); hence, the sizes of  *|
+|*       the ranges decrease geometrically, and selection runs in linear time *|
+|*       even on adversarial inputs (the depth limit alone admits up to       *|
+|*       2 log2(n) steps over nearly the whole range, i.e., n log n time)     *|
+\******************************************************************************/
+void select_progress(int n, int *size, int *steps, int *depth)
+{
+    if (++(*steps) < _n_shrink)
+        return;
+    if (2 * n > *size)
+        *depth = 0;
+    *size = n;
+    *steps = 0;
+}
+
+// variant 1: plain array
+#define SEL_TYPE double
+#define SEL_KEY(_v) (_v)
+#define SEL_FN(_name) _name
+#define SEL_PARAM
+#define SEL_ARG
+#define SEL_AUX_SWAP(_i, _j)
+#define SEL_AUX_SAVE(_i)
+#define SEL_AUX_MOVE(_to, _from)
+#define SEL_AUX_RESTORE(_to)
+#include "selection_template.h"
+
+// variant 2: array with weights
+#define SEL_TYPE double
+#define SEL_KEY(_v) (_v)
+#define SEL_FN(_name) _name ## _w
+#define SEL_PARAM , double* restrict aux
+#define SEL_ARG , aux
+#define SEL_AUX_SWAP(_i, _j) do {                                           \
+    double _aux_tmp = aux[_i]; aux[_i] = aux[_j]; aux[_j] = _aux_tmp;       \
+} while (0)
+#define SEL_AUX_SAVE(_i) double _aux_pivot = aux[_i]
+#define SEL_AUX_MOVE(_to, _from) aux[_to] = aux[_from]
+#define SEL_AUX_RESTORE(_to) aux[_to] = _aux_pivot
+#include "selection_template.h"
+
+// variant 3: array with index
+#define SEL_TYPE double
+#define SEL_KEY(_v) (_v)
+#define SEL_FN(_name) _name ## _indx
+#define SEL_PARAM , int* restrict aux
+#define SEL_ARG , aux
+#define SEL_AUX_SWAP(_i, _j) do {                                           \
+    int _aux_tmp = aux[_i]; aux[_i] = aux[_j]; aux[_j] = _aux_tmp;          \
+} while (0)
+#define SEL_AUX_SAVE(_i) int _aux_pivot = aux[_i]
+#define SEL_AUX_MOVE(_to, _from) aux[_to] = aux[_from]
+#define SEL_AUX_RESTORE(_to) aux[_to] = _aux_pivot
+#include "selection_template.h"
+
+// variant 4: array of (value, weight) pairs
+#define SEL_TYPE wpair
+#define SEL_KEY(_v) ((_v).x)
+#define SEL_FN(_name) _name ## _pair
+#define SEL_PARAM
+#define SEL_ARG
+#define SEL_AUX_SWAP(_i, _j)
+#define SEL_AUX_SAVE(_i)
+#define SEL_AUX_MOVE(_to, _from)
+#define SEL_AUX_RESTORE(_to)
+#include "selection_template.h"
+
+#undef _STACK_SIZE
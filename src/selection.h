@@ -0,0 +1,71 @@
+#include <R.h>
+#include "wbacon_simd.h"
+
+#ifndef _SELECTION_H
+#define _SELECTION_H
+
+#define _n_quickselect 40   // switch from insertion sort to quickselect
+#define _n_nither 50        // pivotal element determined by ninther
+#define _n_shrink 3         // steps in which the range of a selection must
+                            // halve (otherwise: median of medians)
+
+// instrumentation for the benchmark and stress suite (tests/benchmark): if
+// the engine is compiled with -DSELECT_STATS, the partitioning steps are
+// counted in the global 'select_stats' (not thread-safe)
+#ifdef SELECT_STATS
+#define SELECT_STATS_MAX_OPEN 256
+typedef struct select_stats_struct {
+    double n_scanned;   // number of elements scanned by the partitioning
+    int n_partition;    // number of partitioning steps
+    int n_fallback;     // number of median-of-medians pivots (depth limit)
+    int max_depth;      // max. nesting depth of the partitioning steps
+    int n_open;         // [internal] number of enclosing ranges
+    int open_lo[SELECT_STATS_MAX_OPEN];  // [internal] enclosing ranges
+    int open_hi[SELECT_STATS_MAX_OPEN];
+} select_stats_type;
+extern select_stats_type select_stats;
+void select_stats_depth(int, int);
+#define SEL_STATS(_stmt) do { _stmt; } while (0)
+#else
+#define SEL_STATS(_stmt)
+#endif
+
+// (value, weight) pair: interleaved layout for weighted selection
+typedef struct wpair_struct {
+    double x;
+    double w;
+} wpair;
+
+// plain array
+void select_k(double* restrict, int, int, int);
+void select_sort(double* restrict, int, int);
+void select_insertion(double* restrict, int, int);
+void select_partition(double* restrict, int, int, int*, int*, int*);
+int select_pivot(double* restrict, int, int);
+
+// array with weights (weights are swapped along with the array)
+void select_k_w(double* restrict, double* restrict, int, int, int);
+void select_sort_w(double* restrict, double* restrict, int, int);
+void select_insertion_w(double* restrict, double* restrict, int, int);
+void select_partition_w(double* restrict, double* restrict, int, int, int*,
+    int*, int*);
+int select_pivot_w(double* restrict, int, int);
+
+// array with index (index is swapped along with the array)
+void select_k_indx(double* restrict, int* restrict, int, int, int);
+void select_sort_indx(double* restrict, int* restrict, int, int);
+void select_insertion_indx(double* restrict, int* restrict, int, int);
+void select_partition_indx(double* restrict, int* restrict, int, int, int*,
+    int*, int*);
+int select_pivot_indx(double* restrict, int, int);
+
+// array of (value, weight) pairs
+void select_k_pair(wpair* restrict, int, int, int);
+void select_sort_pair(wpair* restrict, int, int);
+void select_insertion_pair(wpair* restrict, int, int);
+void select_partition_pair(wpair* restrict, int, int, int*, int*, int*);
+int select_pivot_pair(wpair* restrict, int, int);
+
+int select_depth_limit(int);
+void select_progress(int, int*, int*, int*);
+#endif
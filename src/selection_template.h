@@ -0,0 +1,259 @@
+/* selection and (partial) sorting engine: source template
+
+   This file is not a stand-alone header; it is included by 'selection.c'
+   once for every variant of the engine. The includer defines the macros
+
+   SEL_TYPE                 type of the elements of the array
+   SEL_KEY(_v)              sort key of the element _v (a double)
+   SEL_FN(_name)            name of the function of the variant
+   SEL_PARAM, SEL_ARG       declaration and forwarding of the auxiliary array
+   SEL_AUX_SWAP(_i, _j)     swap elements _i and _j in the auxiliary array
+   SEL_AUX_SAVE(_i)         save element _i (insertion sort)
+   SEL_AUX_MOVE(_to, _from) move element _from to position _to
+   SEL_AUX_RESTORE(_to)     restore the saved element at position _to
+
+   All macros are undefined at the end of this file.
+*/
+
+#define SEL_SWAP(_i, _j) do {                                               \
+    SEL_TYPE _tmp = array[_i]; array[_i] = array[_j]; array[_j] = _tmp;     \
+    SEL_AUX_SWAP(_i, _j);                                                   \
+} while (0)
+
+static int SEL_FN(median_of_medians)(SEL_TYPE* restrict SEL_PARAM, int, int);
+static inline int SEL_FN(med3)(SEL_TYPE* restrict, int, int, int)
+    __attribute__((always_inline));
+
+/******************************************************************************\
+|* insertion sort (with sentinel and half-exchanges)                          *|
+|*  array   array[lo..hi]                                                     *|
+|*  aux     array[lo..hi] that is sorted along with 'array' (if any)          *|
+|*  lo, hi  dimension                                                         *|
+\******************************************************************************/
+void SEL_FN(select_insertion)(SEL_TYPE* restrict array SEL_PARAM, int lo,
+    int hi)
+{
+    int exch = 0;
+    for (int i = hi; i > lo; i--) {     // smallest element as sentinel
+        if (SEL_KEY(array[i]) < SEL_KEY(array[i - 1])) {
+            SEL_SWAP(i, i - 1);
+            exch++;
+        }
+    }
+    if (exch == 0)                      // array is already sorted
+        return;
+
+    int j;
+    SEL_TYPE pivot;
+    for (int i = lo + 2; i <= hi; i++) {// insertion sort with half-exchanges
+        pivot = array[i];
+        SEL_AUX_SAVE(i);
+        j = i;
+        while (SEL_KEY(pivot) < SEL_KEY(array[j - 1])) {
+            array[j] = array[j - 1];
+            SEL_AUX_MOVE(j, j - 1);
+            j--;
+        }
+        array[j] = pivot;
+        SEL_AUX_RESTORE(j);
+    }
+}
+
+/******************************************************************************\
+|* 3-way partitioning (branchless)                                            *|
+|*  array   array[lo..hi]                                                     *|
+|*  aux     array[lo..hi] that is partitioned along with 'array' (if any)     *|
+|*  lo, hi  dimensions                                                        *|
+|*  depth   on entry: remaining depth budget; on return: decremented budget   *|
+|*  i, j    on return: array[lo..j] < pivot, array[(j+1)..(i-1)] = pivot,     *|
+|*          and array[i..hi] > pivot                                          *|
+|* NOTE: the 3-way partition is obtained by two branchless Lomuto passes: the *|
+|*       first pass separates the elements smaller than the pivot; the second *|
+|*       pass (only on the right part) separates the ties from the elements   *|
+|*       larger than the pivot. The swaps are unconditional, hence the loops  *|
+|*       are free of data-dependent branches. The function is multiversioned  *|
+|*       (see wbacon_simd.h)                                                  *|
+\******************************************************************************/
+WBACON_TARGET_CLONES
+void SEL_FN(select_partition)(SEL_TYPE* restrict array SEL_PARAM, int lo,
+    int hi, int *depth, int *i, int *j)
+{
+    SEL_STATS(select_stats.n_partition++;
+        select_stats.n_scanned += hi - lo + 1;
+        select_stats_depth(lo, hi));
+
+    // determine pivot and swap it into position 'lo'
+    int at;
+    if (*depth > 0) {
+        (*depth)--;
+        at = SEL_FN(select_pivot)(array, lo, hi);
+    } else {
+        SEL_STATS(select_stats.n_fallback++);
+        at = SEL_FN(median_of_medians)(array SEL_ARG, lo, hi);
+    }
+    SEL_SWAP(at, lo);
+    double pivot = SEL_KEY(array[lo]);
+    SEL_TYPE tmp;
+
+    // first pass: array[(lo+1)..(first-1)] < pivot <= array[first..k]
+    int first = lo + 1;
+    for (int k = lo + 1; k <= hi; k++) {
+        tmp = array[k];
+        array[k] = array[first];
+        array[first] = tmp;
+        SEL_AUX_SWAP(k, first);
+        first += SEL_KEY(tmp) < pivot;
+    }
+
+    // move the pivot to the boundary between the two parts
+    SEL_SWAP(lo, first - 1);
+    *j = first - 2;
+
+    // second pass: array[first..hi] >= pivot is split into ties and larger
+    // elements
+    for (int k = first; k <= hi; k++) {
+        tmp = array[k];
+        array[k] = array[first];
+        array[first] = tmp;
+        SEL_AUX_SWAP(k, first);
+        first += SEL_KEY(tmp) <= pivot;
+    }
+    *i = first;
+}
+
+/******************************************************************************\
+|* select the k-th smallest element (introselect, iterative)                  *|
+|*  array   array[lo..hi]                                                     *|
+|*  aux     array[lo..hi] that is partitioned along with 'array' (if any)     *|
+|*  lo      dimension (usually: 0)                                            *|
+|*  hi      dimension (usually: n - 1)                                        *|
+|*  k       integer in lo:hi                                                  *|
+|*                                                                            *|
+|* NOTE     select_k sorts 'array' partially, such that element 'k' is in its *|
+|*          final (sorted) position => array[k] is the k-th smallest element *|
+|*          (linear time in the worst case; see select_progress)              *|
+\******************************************************************************/
+void SEL_FN(select_k)(SEL_TYPE* restrict array SEL_PARAM, int lo, int hi,
+    int k)
+{
+    if (k < lo || k > hi)
+        return;
+
+    int i, j, depth = select_depth_limit(hi - lo + 1);
+    int size = hi - lo + 1, steps = 0;
+    while (hi - lo + 1 > _n_quickselect) {
+        SEL_FN(select_partition)(array SEL_ARG, lo, hi, &depth, &i, &j);
+
+        // iterate only on the partition where element 'k' lies
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else                            // array[k] is equal to the pivot
+            return;
+        select_progress(hi - lo + 1, &size, &steps, &depth);
+    }
+    SEL_FN(select_insertion)(array SEL_ARG, lo, hi);
+}
+
+/******************************************************************************\
+|* sort an array in ascending order (introsort, iterative)                    *|
+|*  array   array[lo..hi]                                                     *|
+|*  aux     array[lo..hi] that is sorted along with 'array' (if any)          *|
+|*  lo, hi  dimension                                                         *|
+|* NOTE: the larger partition is pushed onto an explicit stack and the loop   *|
+|*       continues on the smaller one; hence, the stack never holds more than *|
+|*       log2(n) ranges                                                       *|
+\******************************************************************************/
+void SEL_FN(select_sort)(SEL_TYPE* restrict array SEL_PARAM, int lo, int hi)
+{
+    int stack[3 * _STACK_SIZE];
+    int top = 0, i, j, depth = select_depth_limit(hi - lo + 1);
+
+    for (;;) {
+        if (hi - lo + 1 > _n_quickselect) {
+            SEL_FN(select_partition)(array SEL_ARG, lo, hi, &depth, &i, &j);
+            if (j - lo > hi - i) {
+                stack[top++] = lo; stack[top++] = j; stack[top++] = depth;
+                lo = i;
+            } else {
+                stack[top++] = i; stack[top++] = hi; stack[top++] = depth;
+                hi = j;
+            }
+            continue;
+        }
+
+        SEL_FN(select_insertion)(array SEL_ARG, lo, hi);
+        if (top == 0)
+            break;
+
+        depth = stack[--top]; hi = stack[--top]; lo = stack[--top];
+    }
+}
+
+/******************************************************************************\
+|* pivotal element by the median of medians of groups of 5 elements (the      *|
+|* group medians are swapped to the front of the array)                       *|
+|*  array   array[lo..hi]                                                     *|
+|*  aux     array[lo..hi] that is permuted along with 'array' (if any)        *|
+|*  lo, hi  dimension                                                         *|
+|* NOTE: this is the only place where the engine recurses (through select_k   *|
+|*       on the group medians); the depth of the recursion is log5(n)         *|
+\******************************************************************************/
+static int SEL_FN(median_of_medians)(SEL_TYPE* restrict array SEL_PARAM,
+    int lo, int hi)
+{
+    int n = hi - lo + 1;
+    if (n < 10)
+        return SEL_FN(select_pivot)(array, lo, hi);
+
+    int at, n_groups = n / 5;
+    for (int g = 0; g < n_groups; g++) {
+        at = lo + 5 * g;
+        SEL_FN(select_insertion)(array SEL_ARG, at, at + 4);
+        SEL_SWAP(lo + g, at + 2);
+    }
+
+    int mid = lo + n_groups / 2;
+    SEL_FN(select_k)(array SEL_ARG, lo, lo + n_groups - 1, mid);
+    return mid;
+}
+
+/******************************************************************************\
+|* choose pivotal element: for arrays of size < _n_nither, the median of      *|
+|* three is taken as pivotal element, otherwise we take Tukey's ninther       *|
+|*  array   array[lo..hi]                                                     *|
+|*  lo, hi  dimension                                                         *|
+\******************************************************************************/
+int SEL_FN(select_pivot)(SEL_TYPE* restrict array, int lo, int hi)
+{
+    int n = hi - lo + 1;
+    int mid = lo + n / 2;       // small array: median of three
+    if (n > _n_nither) {        // large array: Tukey's ninther
+        int eps = n / 8;
+        lo = SEL_FN(med3)(array, lo, lo + eps, lo + eps + eps);
+        mid = SEL_FN(med3)(array, mid - eps, mid, mid + eps);
+        hi = SEL_FN(med3)(array, hi - eps - eps, hi - eps, hi);
+    }
+    return SEL_FN(med3)(array, lo, mid, hi);
+}
+
+/******************************************************************************\
+|* median-of-three (but without swaps)                                        *|
+\******************************************************************************/
+static inline int SEL_FN(med3)(SEL_TYPE* restrict array, int i, int j, int k)
+{
+    double a = SEL_KEY(array[i]), b = SEL_KEY(array[j]), c = SEL_KEY(array[k]);
+    return a < b ? (b < c ? j : a < c ? k : i) : (b > c ? j : a > c ? k : i);
+}
+
+#undef SEL_SWAP
+#undef SEL_TYPE
+#undef SEL_KEY
+#undef SEL_FN
+#undef SEL_PARAM
+#undef SEL_ARG
+#undef SEL_AUX_SWAP
+#undef SEL_AUX_SAVE
+#undef SEL_AUX_MOVE
+#undef SEL_AUX_RESTORE
@@ -37,15 +37,38 @@ typedef struct wbdata_struct {
     double *w;
     double *w_sqrt;
     double *dist;
+    double *sorted;     // sorted-order cache (or NULL); see wquantile_sort
+    int *perm;
+    wbacon_trace *trace;    // per-phase timing
+    wbacon_plan *plan;      // execution plan
+    wbacon_threads *blas;   // threads of BLAS
+    wbacon_deadline *deadline;  // time budget and cancellation (or NULL)
 } wbdata;
 
 // structure of working arrays
 typedef struct workarray_struct {
     int *iarray;
+    int *subset0;           // previous subset
+    double *select_weight;  // 1.0 if obs. in subset, otherwise 0.0
+    double *w_sqrt;
     double *work_n;
     double *work_np;
     double *work_pp;
     double *work_2n;
+    double *last;           // distances, center, and scatter of the last
+                            // iteration (only with a time budget; otherwise
+                            // NULL), array[n + p + p * p]
+    // moments of the subset about 'ref' (incremental update of the scatter)
+    double *ref;            // reference point, array[p]
+    double *sum_wx;         // sum of w[i] * (x[i] - ref), array[p]
+    double *sum_wxx;        // lower triangle of the sum of w[i] * (x[i] - ref)
+                            // * (x[i] - ref)^T, array[p, p]
+    double sum_w;
+    int valid;              // 1: the moments match the last subset
+    int stale;              // 1: the distances do not match the center and
+                            // scatter (resumed from a checkpoint)
+    int n_added;            // rows that entered the subset: iarray[0, n_added)
+    int n_removed;          // rows that left: iarray[n - n_removed, n)
 } workarray;
 
 // declarations of local function
@@ -55,15 +78,37 @@ static wbacon_error_type initial_subset(wbdata*, workarray*, double* restrict,
 static wbacon_error_type initial_location(wbdata*, workarray*,
     double* restrict, double* restrict, double* restrict, int*);
 static inline wbacon_error_type mahalanobis(wbdata*, workarray*,
-    double* restrict, double* restrict, double* restrict);
+    double* restrict, double* restrict, double* restrict, wbacon_kernel_type);
 static wbacon_error_type check_matrix_fullrank(double* restrict, int);
-static inline void mean_scatter_w(wbdata*, double* restrict, double* restrict,
-    double* restrict, double* restrict, double* restrict);
+static inline double mean_scatter_w(wbdata*, double* restrict,
+    double* restrict, double* restrict, double* restrict, double* restrict);
+static inline double mean_scatter_compact(wbdata*, double* restrict,
+    int* restrict, double* restrict, double* restrict, double* restrict);
+static void moments_reset(workarray*, double* restrict, double* restrict, int,
+    double);
+static void moments_update(wbdata*, workarray*, double* restrict,
+    double* restrict);
+static int distance_fused(wbdata*, double* restrict, double* restrict,
+    double* restrict);
+static void scatter_syrk(wbdata*, int, double, double* restrict,
+    double* restrict);
 static inline void scatter_w(wbdata*, double* restrict, double* restrict,
     double* restrict, double* restrict);
 static inline void euclidean_norm2(wbdata*, double* restrict, double* restrict);
 static void verbose_message(int, int, int, double);
 static inline double cutoffval(int, int, int) __attribute__((always_inline));
+static wbacon_error_type workarray_alloc(wbacon_memory*, workarray*, int, int,
+    wbacon_plan*, int);
+static void workarray_free(workarray*);
+static void kernel_scratch(wbacon_memory*, int, int, int, int, int, int,
+    int);
+static void dryrun(int, int, int, int, int, int, int, double*);
+static int max_threads(int);
+static void checkpoint_items(wbacon_checkpoint*, workarray*, wbacon_plan*,
+    int* restrict, double* restrict, double* restrict, int*, double*, int);
+static void resume_subset(workarray*, int* restrict, int);
+static int replicate_iterate(wbdata*, workarray*, int* restrict,
+    double* restrict, double* restrict, double, int*);
 
 /******************************************************************************\
 |* Quantile of chi-square distr. (approximation of Severo and Zelen, 1960)    *|
@@ -108,23 +153,82 @@ static inline double qchisq2(double p, double df)
 |*  collect  on entry: parameter to specify the size of the intial subset     *|
 |*  success  on return: 1: successful; 0: failure                             *|
 |*  threads  set the max number of threads for OpenMP                         *|
+|*  sorted   sorted columns of x, array[n, p] (see wquantile_sort)            *|
+|*  perm     permutation of the sorted columns, array[n, p]                   *|
+|*  cached   1: 'sorted' and 'perm' are used by the V2 initialization;        *|
+|*           0: not used                                                      *|
+|*  trace    on return: per-phase timing, array[trace_len]; see wbacon_trace.h*|
+|*  trace_len dimension; 0: no timing                                         *|
+|*  memory   on return: peak working set, array[WBACON_MEMORY_LEN]; see       *|
+|*           wbacon_memory.h                                                  *|
+|*  mode     execution plan: WBACON_PLAN_AUTO (cost model),                   *|
+|*           WBACON_PLAN_FIXED, or WBACON_PLAN_DETERMINISTIC (the result does *|
+|*           not depend on the number of threads); see wbacon_plan.h          *|
+|*  cost     coefficients of the cost model, array[WBACON_COST_LEN]; NaN: the *|
+|*           defaults (see plan_wbacon)                                       *|
+|*  budget   time budget of the call (seconds); <= 0: no budget               *|
+|*  stop     on return: typedef enum wbacon_stop_type; if the call stopped    *|
+|*           before convergence, the estimates of the last complete iteration *|
+|*           are returned (success = 0)                                       *|
+|*  checkpoint file of the checkpoints (see wbacon_checkpoint.c); "": none    *|
+|*  resume   on entry: 1: the call resumes from the checkpoint (if the file   *|
+|*           exists); 0: from scratch; on return: typedef enum                *|
+|*           wbacon_checkpoint_status                                         *|
 \******************************************************************************/
 void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
     int *n, int *p, double *alpha, int *subset, double *cutoff, int *maxiter,
-    int *verbose, int *version2, int *collect, int *success, int *threads)
+    int *verbose, int *version2, int *collect, int *success, int *threads,
+    double *sorted, int *perm, int *cached, double *trace, int *trace_len,
+    double *memory, int *mode, double *cost, double *budget, int *stop,
+    char **checkpoint, int *resume)
+{
+    double chi2 = qchisq(*alpha / (double)*n , (double)(*p), 0, 0);
+    wbacon_fit(x, w, center, scatter, dist, n, p, alpha, subset, cutoff,
+        maxiter, verbose, version2, collect, success, threads, sorted, perm,
+        cached, trace, trace_len, memory, mode, cost, budget, stop,
+        checkpoint, resume, chi2);
+}
+
+/******************************************************************************\
+|* weighted BACON with a given chi-square quantile (for internal use)         *|
+|*  x ... resume  see wbacon                                                  *|
+|*  chi2     quantile qchisq(alpha / n, p) (R is not called by the threads of *|
+|*           a parallel region; see wbacon_simulate)                          *|
+|* Return value: WBACON_ERROR_MEMORY if the work arrays cannot be allocated   *|
+|*               (in a parallel region; see mem_alloc); WBACON_ERROR_OK       *|
+|*               otherwise (see 'success')                                    *|
+\******************************************************************************/
+wbacon_error_type wbacon_fit(double *x, double *w, double *center,
+    double *scatter, double *dist, int *n, int *p, double *alpha, int *subset,
+    double *cutoff, int *maxiter, int *verbose, int *version2, int *collect,
+    int *success, int *threads, double *sorted, int *perm, int *cached,
+    double *trace, int *trace_len, double *memory, int *mode, double *cost,
+    double *budget, int *stop, char **checkpoint, int *resume, double chi2)
 {
-    int subsetsize, default_no_threads;
     wbacon_error_type err;
-    int* restrict subset0 = (int*) Calloc(*n, int);
-    double* select_weight = (double*) Calloc(*n, double);
+    wbacon_trace timing;
+    trace_init(&timing, trace, *trace_len);
+    trace_begin(&timing, WBACON_PHASE_TOTAL);
+
+    // execution plan
+    wbacon_plan plan;
+    plan_wbacon(&plan, *n, *p, *collect, *version2, *cached,
+        max_threads(*threads), *mode, cost);
+
+    // initialize and populate the struct 'workarray' (the large arrays are
+    // placed by the threads of the plan)
+    wbacon_memory mem;
+    mem_begin(&mem, 0);
+    workarray warray;
+    workarray *work = &warray;
+    wbacon_error_type status = workarray_alloc(&mem, work, *n, *p, &plan,
+        *budget > 0.0);
+    int* restrict subset0 = work->subset0;
+    double* select_weight = work->select_weight;
+    double* w_sqrt = work->w_sqrt;
 
     *success = 1;
 
-    // square root of the weights
-    double* w_sqrt = (double*) Calloc(*n, double);
-    for (int i = 0; i < *n; i++)
-        w_sqrt[i] = sqrt(w[i]);
-
     // initialize and populate the struct 'wbdata'
     wbdata data;
     wbdata *dat = &data;
@@ -135,21 +239,33 @@ void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
     dat->w = w;
     dat->w_sqrt = w_sqrt;
     dat->dist = dist;
-
-    // initialize and populate the struct 'workarray'
-    workarray warray;
-    workarray *work = &warray;
-
-    int *iarray = (int*) Calloc(*n, int);
-    double *work_n = (double*) Calloc(*n, double);
-    double *work_np = (double*) Calloc(*n * *p, double);
-    double *work_pp = (double*) Calloc(*p * *p, double);
-    double *work_2n = (double*) Calloc(2 * *n, double);
-    work->iarray = iarray;
-    work->work_n = work_n;
-    work->work_np = work_np;
-    work->work_pp = work_pp;
-    work->work_2n = work_2n;
+    dat->sorted = *cached ? sorted : NULL;
+    dat->perm = *cached ? perm : NULL;
+    dat->trace = &timing;
+    dat->deadline = NULL;               // not checked in the initialization
+    wbacon_deadline deadline;
+    deadline_begin(&deadline, *budget);
+
+    dat->plan = &plan;
+    wbacon_threads blas;
+    dat->blas = &blas;
+
+    // checkpoints: the fingerprint covers the data and the arguments of the
+    // initialization (and the mode of the plan: the deterministic plan sums
+    // up in another order)
+    wbacon_checkpoint ckpt;
+    uint64_t fingerprint = 0;
+    if (checkpoint[0][0] != '\0') {
+        fingerprint = checkpoint_hash(0, x, (size_t)*n * *p * sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, w, *n * sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, alpha, sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, collect, sizeof(int));
+        fingerprint = checkpoint_hash(fingerprint, version2, sizeof(int));
+        fingerprint = checkpoint_hash(fingerprint, mode, sizeof(int));
+    }
+    checkpoint_begin(&ckpt, &mem, checkpoint[0], WBACON_CHECKPOINT_WBACON, *n,
+        *p, fingerprint);
+    int subsetsize, default_no_threads;
 
     #ifdef _OPENMP
     // store current definition of max number of threads
@@ -162,10 +278,46 @@ void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
         PRINT_OUT("Thus, the default is kept at %d\n", default_no_threads);
     }
     #endif
+    threads_begin(&blas);
+    trace_open_counters(&timing);
+
+    int iter = 1, is_different, resumed, honour;
+    int* restrict iarray = work->iarray;
+    wbacon_kernel_type kernel;
+    if (status != WBACON_ERROR_OK) {
+        *success = 0;
+        PRINT_OUT("Error: %s\n", wbacon_error(status));
+        goto clean_up;
+    }
+
+    // square root of the weights
+    for (int i = 0; i < *n; i++)
+        w_sqrt[i] = sqrt(w[i]);
+
+    // resume from the checkpoint (the initialization is skipped)
+    checkpoint_items(&ckpt, work, &plan, subset, center, scatter, &subsetsize,
+        cutoff, *p);
+    *resume = *resume ? (int)checkpoint_load(&ckpt) : 0;
+    if (*resume == WBACON_CHECKPOINT_INVALID) {
+        *success = 0;
+        PRINT_OUT("Error: checkpoint '%s' does not match the data or is "
+            "corrupt\n", checkpoint[0]);
+        goto clean_up;
+    }
+    if (ckpt.resumed) {
+        if (*verbose)
+            PRINT_OUT("Resumed from checkpoint (iteration %d)\n", ckpt.iter);
+        goto iterate;
+    }
 
     // STEP 0
     // initial location
+    trace_begin(&timing, WBACON_PHASE_INIT_LOCATION);
+    threads_blas(&blas, plan.blas[WBACON_STEP_LOCATION]);
+    WBACON_PROBE(initial_location__begin, *n, *p, -1, 0);
     err = initial_location(dat, work, select_weight, center, scatter, version2);
+    WBACON_PROBE(initial_location__end, *n, *p, -1, 0);
+    trace_end(&timing, WBACON_PHASE_INIT_LOCATION);
     if (err != WBACON_ERROR_OK) {
         *success = 0;
         PRINT_OUT("Error: covariance %s\n", wbacon_error(err));
@@ -173,23 +325,70 @@ void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
     }
 
     // initial subset
+    trace_begin(&timing, WBACON_PHASE_INIT_SUBSET);
+    threads_blas(&blas, plan.blas[WBACON_STEP_SUBSET]);
+    WBACON_PROBE(initial_subset__begin, *n, *p, -1, 0);
     err = initial_subset(dat, work, select_weight, center, scatter, subset,
         &subsetsize, verbose, collect);
+    WBACON_PROBE(initial_subset__end, *n, *p, subsetsize, 0);
+    trace_end(&timing, WBACON_PHASE_INIT_SUBSET);
     if (err != WBACON_ERROR_OK) {
         *success = 0;
         PRINT_OUT("Error: %s (initial subset)\n", wbacon_error(err));
         goto clean_up;
     }
 
+    work->valid = 0;
+
     // STEP 1: update iteratively
-    double chi2 = qchisq(*alpha / (double)*n , (double)(*p), 0, 0);
-    int iter = 1, is_different;
+iterate:
+    if (ckpt.resumed) {
+        iter = ckpt.iter;
+        resume_subset(work, subset, *n);
+    }
     for (;;) {
+        // checkpoint of the state at the beginning of the iteration; the
+        // iteration that continues a checkpoint is run in full
+        resumed = checkpoint_resumed(&ckpt, 3, iter);
+        if (!resumed && checkpoint_save(&ckpt, 3, iter))
+            PRINT_OUT("Warning: checkpoint '%s' cannot be written\n",
+                checkpoint[0]);
+
+        // time budget, cancellation, and user interrupt (checked between the
+        // iterations; the estimates of the last iteration are kept). The
+        // first iteration is run in full: before it, scatter holds the
+        // Cholesky factor of the initialization and dist is not computed
+        honour = !resumed && iter > 1;
+        if (honour && deadline_check(&deadline) != WBACON_STOP_NONE)
+            break;
+        dat->deadline = honour ? &deadline : NULL;
+        if (work->last != NULL) {
+            Memcpy(work->last, dist, *n);
+            Memcpy(work->last + *n, center, *p);
+            Memcpy(work->last + *n + *p, scatter, *p * *p);
+        }
+
         if (*verbose)
             verbose_message(subsetsize, *n, iter, *cutoff);
 
         // location, scatter and the Mahalanobis distances
-        err = mahalanobis(dat, work, select_weight, center, scatter);
+        trace_begin(&timing, WBACON_PHASE_ITERATION);
+        WBACON_PROBE(iteration__begin, *n, *p, subsetsize, iter);
+        kernel = plan_scatter(&plan, subsetsize, work->n_added
+            + work->n_removed, work->valid);
+        err = mahalanobis(dat, work, select_weight, center, scatter, kernel);
+        work->stale = 0;
+        if (err == WBACON_ERROR_STOPPED) {
+            // the budget ran out in the tile loop: the distances of this
+            // iteration are incomplete; the last iteration is restored
+            Memcpy(dist, work->last, *n);
+            Memcpy(center, work->last + *n, *p);
+            Memcpy(scatter, work->last + *n + *p, *p * *p);
+            deadline_check(&deadline);
+            WBACON_PROBE(iteration__end, *n, *p, subsetsize, iter);
+            trace_end(&timing, WBACON_PHASE_ITERATION);
+            break;
+        }
         if (err != WBACON_ERROR_OK) {
             *success = 0;
             PRINT_OUT("Error: covariance %s (iterative updating)\n",
@@ -207,26 +406,41 @@ void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
         }
         if (is_different == 0) {
             *maxiter = iter;
+            WBACON_PROBE(iteration__end, *n, *p, subsetsize, iter);
+            trace_end(&timing, WBACON_PHASE_ITERATION);
+            trace_iteration(&timing, WBACON_PHASE_ITERATION, iter, subset0,
+                subset, *n);
             break;
         }
 
         // chi-square cutoff value (quantile)
         *cutoff = chi2 * cutoffval(*n, subsetsize, *p);
 
-        // generate new subset (based on updated Mahalanobis dist.)
+        // generate new subset (based on updated Mahalanobis dist.); the rows
+        // that changed membership are recorded in iarray
         Memcpy(subset0, subset, *n);
 
         subsetsize = 0;
+        work->n_added = 0;
+        work->n_removed = 0;
         for (int i = 0; i < *n; i++) {
             if (dist[i] < *cutoff) {        // obs. is in subset
                 subset[i] = 1;
                 select_weight[i] = 1.0;
                 subsetsize += 1;
-        } else {                            // obs. is not in subset
+                if (!subset0[i])
+                    iarray[work->n_added++] = i;
+            } else {                        // obs. is not in subset
                 subset[i] = 0;
                 select_weight[i] = 0.0;
+                if (subset0[i])
+                    iarray[*n - ++work->n_removed] = i;
             }
         }
+        WBACON_PROBE(iteration__end, *n, *p, subsetsize, iter);
+        trace_end(&timing, WBACON_PHASE_ITERATION);
+        trace_iteration(&timing, WBACON_PHASE_ITERATION, iter, subset0, subset,
+            *n);
 
         iter++;
         if (iter > *maxiter) {
@@ -235,19 +449,459 @@ void wbacon(double *x, double *w, double *center, double *scatter, double *dist,
         }
     }
 
+    if (deadline.stop != WBACON_STOP_NONE) {
+        *success = 0;
+        *maxiter = iter - 1;                // complete iterations
+        if (*verbose)
+            PRINT_OUT("Stopped (%s) after %d iterations\n",
+                deadline_reason(deadline.stop), iter - 1);
+    }
+
     for (int i = 0; i < *n; i++)            // Mahalanobis distances
         dist[i] = sqrt(dist[i]);
 
 clean_up:
-    Free(subset0); Free(work_np); Free(work_pp);
-    Free(work_2n); Free(work_n); Free(iarray); Free(w_sqrt);
-    Free(select_weight);
+    *stop = (int)deadline.stop;
+    checkpoint_end(&ckpt);
+    workarray_free(work);
+    mem_end(&mem, memory);
+    trace_end(&timing, WBACON_PHASE_TOTAL);
+    trace_close(&timing);
+    threads_end(&blas);
 
     #ifdef _OPENMP
     // set the number of threads to the default value
     if (*threads != default_no_threads)
         omp_set_num_threads(default_no_threads);
     #endif
+    return status;
+}
+
+/******************************************************************************\
+|* peak working set of wbacon without running it (dry run)                    *|
+|*  n, p     dimensions                                                       *|
+|*  collect  parameter to specify the size of the intial subset               *|
+|*  version2 1: 'Version 2' init. of Billor et al. (2000); 0: 'Version 1'     *|
+|*  cached   1: the sorted-order cache is used; 0: not used                   *|
+|*  threads  max number of threads for OpenMP                                 *|
+|*  memory   on return: array[WBACON_MEMORY_LEN]; see wbacon_memory.h         *|
+|* NOTE: the work arrays are charged as allocated by wbacon; the scratch of   *|
+|*       the kernels is charged in the order of the calls. The trace (incl.   *|
+|*       the hardware counters) is not included                               *|
+\******************************************************************************/
+void wbacon_dryrun(int *n, int *p, int *collect, int *version2, int *cached,
+    int *threads, double *memory)
+{
+    dryrun(*n, *p, *collect, *version2, *cached, max_threads(*threads),
+        WBACON_PLAN_AUTO, memory);
+}
+
+// dry run of a plan (the deterministic plan needs the scratch of
+// scatter_syrk)
+static void dryrun(int n, int p, int collect, int version2, int cached,
+    int n_threads, int mode, double *memory)
+{
+    wbacon_memory mem;
+    mem_begin(&mem, 1);
+    workarray warray;
+    workarray_alloc(&mem, &warray, n, p, NULL, 0);
+    kernel_scratch(&mem, n, p, collect, version2, cached, n_threads, mode);
+    mem_end(&mem, memory);
+}
+
+/******************************************************************************\
+|* execution plan of wbacon without running it (explain)                      *|
+|*  n, p, collect, version2, cached, threads   see wbacon_dryrun              *|
+|*  mode      WBACON_PLAN_AUTO, WBACON_PLAN_FIXED, or                         *|
+|*            WBACON_PLAN_DETERMINISTIC                                       *|
+|*  cost      coefficients of the cost model (see wbacon)                     *|
+|*  kernel    on return: kernel per step, array[WBACON_STEP_COUNT]            *|
+|*  step_threads on return: threads per step, array[WBACON_STEP_COUNT]        *|
+|*  blas      on return: threads of BLAS per step, array[WBACON_STEP_COUNT]   *|
+|*  time      on return: estimated time per call of a step (seconds),         *|
+|*            array[WBACON_STEP_COUNT]                                        *|
+|*  threshold on return: compact_max and delta_max, array[2]                  *|
+|*  memory    on return: array[WBACON_MEMORY_LEN]; see wbacon_dryrun         *|
+\******************************************************************************/
+void wbacon_explain(int *n, int *p, int *collect, int *version2, int *cached,
+    int *threads, int *mode, double *cost, int *kernel, int *step_threads,
+    int *blas, double *time, int *threshold, double *memory)
+{
+    wbacon_plan plan;
+    plan_wbacon(&plan, *n, *p, *collect, *version2, *cached,
+        max_threads(*threads), *mode, cost);
+    plan_explain(&plan, kernel, step_threads, blas, time, threshold);
+    dryrun(*n, *p, *collect, *version2, *cached, max_threads(*threads), *mode,
+        memory);
+}
+
+/******************************************************************************\
+|* wbacon for replicate weights: every column of a matrix of weights (e.g.,   *|
+|* bootstrap, jackknife, or BRR replicates) is warm-started from the subset   *|
+|* of the full sample                                                         *|
+|*  x        data, array[n, p]                                                *|
+|*  w        replicate weights, array[n, n_rep]                               *|
+|*  subset   final subset of the full sample (see wbacon), array[n]           *|
+|*  n, p     dimensions                                                       *|
+|*  n_rep    number of replicates                                             *|
+|*  alpha    prob.                                                            *|
+|*  maxiter  maximal no. of iterations of a replicate                         *|
+|*  threads  set the max number of threads for OpenMP                         *|
+|*  cost     coefficients of the cost model (see wbacon)                      *|
+|*  center   on return: centers, array[p, n_rep]                              *|
+|*  scatter  on return: lower triangles of the scatter matrices (packed by    *|
+|*           columns), array[p * (p + 1) / 2, n_rep]                          *|
+|*  iter     on return: no. of iterations, array[n_rep]                       *|
+|*  size     on return: size of the final subset, array[n_rep]                *|
+|*  success  on return: 1: successful; 0: failure (the scatter matrix is rank *|
+|*           deficient or no convergence), array[n_rep]                       *|
+|*  memory   on return: peak working set, array[WBACON_MEMORY_LEN]; see       *|
+|*           wbacon_memory.h                                                  *|
+|* NOTE: the replicates run in parallel, one replicate per thread; the        *|
+|*       kernels of a replicate run on one thread (hence, the results do not  *|
+|*       depend on the number of threads) and so does BLAS. Every thread owns *|
+|*       a set of work arrays, which is reused by its replicates; the data    *|
+|*       are shared. The initialization is skipped: the iterations start from *|
+|*       the subset of the full sample (warm start)                           *|
+\******************************************************************************/
+void wbacon_replicate(double *x, double *w, int *subset, int *n, int *p,
+    int *n_rep, double *alpha, int *maxiter, int *threads, double *cost,
+    double *center, double *scatter, int *iter, int *size, int *success,
+    double *memory)
+{
+    int n_teams = max_threads(*threads);
+    n_teams = n_teams < *n_rep ? n_teams : *n_rep;
+    n_teams = n_teams > 0 ? n_teams : 1;
+    int pp = *p * *p, packed = *p * (*p + 1) / 2;
+
+    // plan of a replicate: one thread
+    wbacon_plan plan;
+    plan_wbacon(&plan, *n, *p, 1, 0, 0, 1, WBACON_PLAN_AUTO, cost);
+
+    // work arrays per thread (allocated outside of the parallel region)
+    wbacon_memory mem;
+    mem_begin(&mem, 0);
+    workarray *work = (workarray*) Calloc(n_teams, workarray);
+    for (int t = 0; t < n_teams; t++)
+        workarray_alloc(&mem, work + t, *n, *p, &plan, 0);
+    int *team_subset = (int*) mem_alloc(&mem, (size_t)n_teams * *n,
+        sizeof(int), WBACON_MEM_SUBSET);
+    double *team_dist = (double*) mem_alloc(&mem, (size_t)n_teams * *n,
+        sizeof(double), WBACON_MEM_WORK_N);
+    double *team_scatter = (double*) mem_alloc(&mem, (size_t)n_teams * pp,
+        sizeof(double), WBACON_MEM_WORK_PP);
+
+    wbacon_threads blas;
+    threads_begin(&blas);
+    threads_blas(&blas, 1);
+    double chi2 = qchisq(*alpha / (double)*n , (double)(*p), 0, 0);
+
+    #pragma omp parallel for num_threads(n_teams) schedule(dynamic)
+    for (int r = 0; r < *n_rep; r++) {
+        int t = 0;
+        #ifdef _OPENMP
+        t = omp_get_thread_num();
+        #endif
+        wbdata data;
+        data.n = *n;
+        data.p = *p;
+        data.x = x;
+        data.w = w + (size_t)*n * r;
+        data.w_sqrt = work[t].w_sqrt;
+        data.dist = team_dist + (size_t)*n * t;
+        data.sorted = NULL;
+        data.perm = NULL;
+        data.trace = NULL;
+        data.plan = &plan;
+        data.blas = NULL;               // BLAS runs on one thread (see above)
+        data.deadline = NULL;
+
+        int* restrict subset_r = team_subset + (size_t)*n * t;
+        double* restrict center_r = center + (size_t)*p * r;
+        double* restrict scatter_r = team_scatter + (size_t)pp * t;
+        Memcpy(subset_r, subset, *n);
+        iter[r] = *maxiter;
+        success[r] = replicate_iterate(&data, work + t, subset_r, center_r,
+            scatter_r, chi2, iter + r);
+
+        size[r] = 0;
+        for (int i = 0; i < *n; i++)
+            size[r] += subset_r[i];
+        double* restrict packed_r = scatter + (size_t)packed * r;
+        for (int j = 0, k = 0; j < *p; j++)
+            for (int i = j; i < *p; i++)
+                packed_r[k++] = scatter_r[i + *p * j];
+    }
+
+    threads_end(&blas);
+    mem_free(team_subset);
+    mem_free(team_dist);
+    mem_free(team_scatter);
+    for (int t = 0; t < n_teams; t++)
+        workarray_free(work + t);
+    Free(work);
+    mem_end(&mem, memory);
+}
+
+/******************************************************************************\
+|* iterations of a replicate (see wbacon; warm start)                         *|
+|*  dat     data, typedef struct wbdata                                       *|
+|*  work    work arrays, typedef struct workarray                             *|
+|*  subset  on entry: subset of the full sample; on return: final subset,     *|
+|*          array[n]                                                          *|
+|*  center  on return: array[p]                                               *|
+|*  scatter on return: array[p, p] (lower triangle)                           *|
+|*  chi2    chi-square quantile (see wbacon)                                  *|
+|*  maxiter on entry: maximal no. of iterations, on return: effective no.     *|
+|* Return value: 1: successful; 0: failure                                    *|
+|* NOTE: the previous subset is empty on entry; hence, the first iteration    *|
+|*       computes the subset of the replicate from the distances of the      *|
+|*       warm start                                                           *|
+\******************************************************************************/
+static int replicate_iterate(wbdata *dat, workarray *work,
+    int* restrict subset, double* restrict center, double* restrict scatter,
+    double chi2, int *maxiter)
+{
+    int n = dat->n, p = dat->p, subsetsize = 0, is_different;
+    int* restrict subset0 = work->subset0;
+    int* restrict iarray = work->iarray;
+    double* restrict select_weight = work->select_weight;
+    double* restrict dist = dat->dist;
+    double cutoff;
+    wbacon_kernel_type kernel;
+
+    for (int i = 0; i < n; i++) {
+        dat->w_sqrt[i] = sqrt(dat->w[i]);
+        subset0[i] = 0;
+        select_weight[i] = subset[i] ? 1.0 : 0.0;
+        subsetsize += subset[i];
+    }
+    work->valid = 0;
+    work->stale = 0;
+    work->n_added = 0;
+    work->n_removed = 0;
+
+    for (int iter = 1; iter <= *maxiter; iter++) {
+        // location, scatter and the Mahalanobis distances
+        kernel = plan_scatter(dat->plan, subsetsize, work->n_added
+            + work->n_removed, work->valid);
+        if (mahalanobis(dat, work, select_weight, center, scatter, kernel)
+                != WBACON_ERROR_OK)
+            return 0;
+
+        // check whether the subsets differ
+        is_different = 0;
+        for (int i = 0; i < n; i++) {
+            if (subset0[i] ^ subset[i]) {
+                is_different = 1;
+                break;
+            }
+        }
+        if (is_different == 0) {
+            *maxiter = iter;
+            return 1;
+        }
+
+        // new subset; the rows that changed membership are recorded in iarray
+        cutoff = chi2 * cutoffval(n, subsetsize, p);
+        Memcpy(subset0, subset, n);
+        subsetsize = 0;
+        work->n_added = 0;
+        work->n_removed = 0;
+        for (int i = 0; i < n; i++) {
+            if (dist[i] < cutoff) {
+                subset[i] = 1;
+                select_weight[i] = 1.0;
+                subsetsize += 1;
+                if (!subset0[i])
+                    iarray[work->n_added++] = i;
+            } else {
+                subset[i] = 0;
+                select_weight[i] = 0.0;
+                if (subset0[i])
+                    iarray[n - ++work->n_removed] = i;
+            }
+        }
+    }
+    return 0;
+}
+
+// number of threads of wbacon: the default of OpenMP is kept if the request
+// is larger (see wbacon)
+static int max_threads(int threads)
+{
+    int n_threads = 1;
+    #ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+    if (threads <= n_threads)
+        n_threads = threads;
+    #endif
+    return n_threads;
+}
+
+/******************************************************************************\
+|* allocate the work arrays (in a dry run, the pointers are NULL)             *|
+|*  mem     typedef struct wbacon_memory                                      *|
+|*  work    typedef struct workarray                                          *|
+|*  n, p    dimensions                                                        *|
+|*  plan    typedef struct wbacon_plan (NULL in a dry run)                    *|
+|*  last    1: the estimates of the last iteration are kept (time budget)     *|
+|* Return value: WBACON_ERROR_MEMORY if an array cannot be allocated (in a    *|
+|*               parallel region; see mem_alloc); WBACON_ERROR_OK otherwise   *|
+|* NOTE: work_np and work_2n are first-touched by the threads of the loops    *|
+|*       that use them (see mem_alloc_placed): work_np by tiles of rows       *|
+|*       (distance_fused), work_2n by chunks of the parallel partitioning of  *|
+|*       wquantile_noalloc                                                    *|
+\******************************************************************************/
+static wbacon_error_type workarray_alloc(wbacon_memory *mem, workarray *work,
+    int n, int p, wbacon_plan *plan, int last)
+{
+    int threads_np = plan != NULL ? plan->threads[WBACON_STEP_DISTANCE] : 1;
+    int threads_2n = plan != NULL ? plan->n_threads : 1;
+    work->subset0 = (int*) mem_alloc(mem, n, sizeof(int), WBACON_MEM_SUBSET);
+    work->select_weight = (double*) mem_alloc(mem, n, sizeof(double),
+        WBACON_MEM_SUBSET);
+    work->w_sqrt = (double*) mem_alloc(mem, n, sizeof(double),
+        WBACON_MEM_DATA);
+    work->iarray = (int*) mem_alloc(mem, n, sizeof(int), WBACON_MEM_SUBSET);
+    work->work_n = (double*) mem_alloc(mem, n, sizeof(double),
+        WBACON_MEM_WORK_N);
+    work->work_np = (double*) mem_alloc_placed(mem, (size_t)n * p,
+        sizeof(double), WBACON_MEM_WORK_NP, (size_t)WBACON_TILE * p,
+        threads_np);
+    work->work_pp = (double*) mem_alloc(mem, p * p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    work->work_2n = (double*) mem_alloc_placed(mem, 2 * (size_t)n,
+        sizeof(double), WBACON_MEM_WORK_N, 2 * ((size_t)n / threads_2n + 1),
+        threads_2n);
+    work->ref = (double*) mem_alloc(mem, p, sizeof(double), WBACON_MEM_WORK_PP);
+    work->sum_wx = (double*) mem_alloc(mem, p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    work->sum_wxx = (double*) mem_alloc(mem, p * p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    work->last = last ? (double*) mem_alloc(mem, n + p + p * p, sizeof(double),
+        WBACON_MEM_WORK_N) : NULL;
+    work->valid = 0;
+    work->stale = 0;
+    work->n_added = 0;
+    work->n_removed = 0;
+
+    if (mem->dry)
+        return WBACON_ERROR_OK;
+    if (work->subset0 == NULL || work->select_weight == NULL
+            || work->w_sqrt == NULL || work->iarray == NULL
+            || work->work_n == NULL || work->work_np == NULL
+            || work->work_pp == NULL || work->work_2n == NULL
+            || work->ref == NULL || work->sum_wx == NULL
+            || work->sum_wxx == NULL || (last && work->last == NULL))
+        return WBACON_ERROR_MEMORY;
+    return WBACON_ERROR_OK;
+}
+
+static void workarray_free(workarray *work)
+{
+    mem_free(work->subset0); mem_free(work->work_np); mem_free(work->work_pp);
+    mem_free(work->work_2n); mem_free(work->work_n); mem_free(work->iarray);
+    mem_free(work->w_sqrt); mem_free(work->select_weight);
+    mem_free(work->ref); mem_free(work->sum_wx); mem_free(work->sum_wxx);
+    mem_free(work->last);
+}
+
+/******************************************************************************\
+|* register the state of wbacon at the beginning of an iteration (see         *|
+|* wbacon_checkpoint.c)                                                       *|
+|*  ck      typedef struct wbacon_checkpoint                                  *|
+|*  work    typedef struct workarray                                          *|
+|*  plan    typedef struct wbacon_plan                                        *|
+|*  subset  array[n]                                                          *|
+|*  center  array[p]                                                          *|
+|*  scatter array[p, p]                                                       *|
+|*  subsetsize, cutoff  size of the subset and chi-square cutoff threshold    *|
+|*  p       dimension                                                         *|
+|* NOTE: the kernels and threads of the plan are part of the state; hence,    *|
+|*       the iterations after a resume use the same kernels. The distances    *|
+|*       are not stored; they are recomputed in the first iteration           *|
+\******************************************************************************/
+static void checkpoint_items(wbacon_checkpoint *ck, workarray *work,
+    wbacon_plan *plan, int* restrict subset, double* restrict center,
+    double* restrict scatter, int *subsetsize, double *cutoff, int p)
+{
+    int n = ck->n;
+    checkpoint_add(ck, WBACON_ITEM_BITMAP, subset, n);
+    checkpoint_add(ck, WBACON_ITEM_BITMAP, work->subset0, n);
+    checkpoint_add(ck, WBACON_ITEM_INT, subsetsize, 1);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, cutoff, 1);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, center, p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, scatter, p * p);
+    // moments of the subset (incremental update)
+    checkpoint_add(ck, WBACON_ITEM_INT, &work->valid, 1);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, work->ref, p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, work->sum_wx, p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, work->sum_wxx, p * p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, &work->sum_w, 1);
+    // plan
+    checkpoint_add(ck, WBACON_ITEM_INT, plan->kernel, WBACON_STEP_COUNT);
+    checkpoint_add(ck, WBACON_ITEM_INT, plan->threads, WBACON_STEP_COUNT);
+    checkpoint_add(ck, WBACON_ITEM_INT, plan->blas, WBACON_STEP_COUNT);
+    checkpoint_add(ck, WBACON_ITEM_INT, &plan->compact_max, 1);
+    checkpoint_add(ck, WBACON_ITEM_INT, &plan->delta_max, 1);
+}
+
+/******************************************************************************\
+|* selection weights and the rows that changed membership (restored state)    *|
+|* as in the iterations of wbacon                                             *|
+|*  work    typedef struct workarray: on entry, subset0; on return,           *|
+|*          select_weight, iarray, n_added, and n_removed                     *|
+|*  subset  array[n]                                                          *|
+|*  n       dimension                                                         *|
+\******************************************************************************/
+static void resume_subset(workarray *work, int* restrict subset, int n)
+{
+    int* restrict subset0 = work->subset0;
+    work->n_added = 0;
+    work->n_removed = 0;
+    for (int i = 0; i < n; i++) {
+        work->select_weight[i] = subset[i] ? 1.0 : 0.0;
+        if (subset[i] && !subset0[i])
+            work->iarray[work->n_added++] = i;
+        else if (!subset[i] && subset0[i])
+            work->iarray[n - ++work->n_removed] = i;
+    }
+    work->stale = 1;
+}
+
+/******************************************************************************\
+|* charge the scratch of the kernels called by wbacon (dry run)               *|
+|*  mem      typedef struct wbacon_memory                                     *|
+|*  n, p     dimensions                                                       *|
+|*  collect, version2, cached   see wbacon_dryrun                             *|
+|*  n_threads number of threads                                               *|
+|*  mode     execution plan; see wbacon_plan.h                                *|
+\******************************************************************************/
+static void kernel_scratch(wbacon_memory *mem, int n, int p, int collect,
+    int version2, int cached, int n_threads, int mode)
+{
+    double bytes;
+    // initial_location: coordinate-wise weighted median
+    if (version2 && !cached) {
+        bytes = wquant_pair_scratch(n);
+        mem_reserve(mem, bytes, WBACON_MEM_KERNEL);
+        mem_release(mem, bytes, WBACON_MEM_KERNEL);
+    }
+
+    // initial_subset: partial sort of the distances
+    int m = (int)fmin((double)collect * (double)p, (double)n * 0.5);
+    bytes = psort_array_scratch(n, m, n_threads);
+    mem_reserve(mem, bytes, WBACON_MEM_KERNEL);
+    mem_release(mem, bytes, WBACON_MEM_KERNEL);
+
+    // scatter_syrk: scatter matrices of the blocks of rows
+    int n_blocks = (n + WBACON_ROW_BLOCK - 1) / WBACON_ROW_BLOCK;
+    if (mode == WBACON_PLAN_DETERMINISTIC && n_blocks > 1) {
+        bytes = (double)n_blocks * p * p * sizeof(double);
+        mem_reserve(mem, bytes, WBACON_MEM_KERNEL);
+        mem_release(mem, bytes, WBACON_MEM_KERNEL);
+    }
 }
 
 /******************************************************************************\
@@ -268,11 +922,21 @@ static wbacon_error_type initial_location(wbdata *dat, workarray *work,
     wbacon_error_type err = WBACON_ERROR_OK;
 
     if (*version2) {
-        // center: coordinate-wise weighted median
+        // center: coordinate-wise weighted median (from the sorted-order
+        // cache, if available)
         double d_half = 0.5;
-        for (int j = 0; j < p; j++)
-            wquantile_noalloc(x + n * j, dat->w, work->work_2n, &n,
-                &d_half, &center[j]);
+        if (dat->sorted != NULL) {
+            double sum_w = 0.0;
+            for (int i = 0; i < n; i++)
+                sum_w += dat->w[i];
+            for (int j = 0; j < p; j++)
+                wquant_sorted(dat->sorted + n * j, dat->perm + n * j, dat->w,
+                    sum_w, n, &d_half, 1, &center[j]);
+        } else {
+            for (int j = 0; j < p; j++)
+                wquantile_noalloc(x + n * j, dat->w, work->work_2n, &n,
+                    &d_half, &center[j]);
+        }
 
         // distance: Euclidean norm
         euclidean_norm2(dat, work->work_np, center);
@@ -281,7 +945,8 @@ static wbacon_error_type initial_location(wbdata *dat, workarray *work,
         for (int i = 0; i < n; i++)
             select_weight[i] = 1.0;
 
-        err = mahalanobis(dat, work, select_weight, center, scatter);
+        err = mahalanobis(dat, work, select_weight, center, scatter,
+            dat->plan->kernel[WBACON_STEP_SCATTER]);
     }
     return err;
 }
@@ -326,7 +991,7 @@ static wbacon_error_type initial_subset(wbdata *dat, workarray *work,
     int m = (int)fmin((double)(*collect) * (double)p, (double)n * 0.5);
 
     // (partially) sort the Mahalanobis distances
-    psort_array(dat->dist, iarray, n, m);
+    psort_array(dat->dist, iarray, n, m, work->work_n);
 
     // set weights of observations (m+1):n to zero
     for (int i = 0; i < n; i++)
@@ -410,6 +1075,71 @@ static void verbose_message(int subsetsize, int n, int iter, double cutoff)
         PRINT_OUT("Subset %d: m = %d (%.1f%%)\n", iter, subsetsize, percentage);
 }
 
+/******************************************************************************\
+|* lower triangle of the scatter matrix, scatter = alpha * t(a) %*% a         *|
+|*  dat     data, typedef struct wbdata                                       *|
+|*  k       number of rows of a                                               *|
+|*  alpha   scalar                                                            *|
+|*  a       array[k, p]                                                       *|
+|*  scatter on return: array[p, p] (lower triangle)                           *|
+|* NOTE: in the deterministic plan, the rows are split into blocks of         *|
+|*       WBACON_ROW_BLOCK rows; the scatter matrices of the blocks are        *|
+|*       computed in parallel (dsyrk on one thread) and summed up by a        *|
+|*       pairwise tree in a fixed order; hence, the result does not depend    *|
+|*       on the number of threads                                             *|
+\******************************************************************************/
+static void scatter_syrk(wbdata *dat, int k, double alpha, double* restrict a,
+    double* restrict scatter)
+{
+    int p = dat->p, pp = p * p;
+    int n_blocks = (k + WBACON_ROW_BLOCK - 1) / WBACON_ROW_BLOCK;
+    const double d_zero = 0.0, d_one = 1.0;
+
+    if (dat->plan->mode != WBACON_PLAN_DETERMINISTIC || n_blocks < 2) {
+        F77_CALL(dsyrk)("L", "T", &p, &k, &alpha, a, &k, &d_zero, scatter,
+            &p);
+        return;
+    }
+
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_SCATTER];
+    #endif
+    double* restrict part = (double*) mem_scratch((size_t)n_blocks * pp,
+        sizeof(double));
+    if (part == NULL) {                 // no scratch (see mem_scratch)
+        F77_CALL(dsyrk)("L", "T", &p, &k, &alpha, a, &k, &d_zero, scatter,
+            &p);
+        return;
+    }
+
+    #pragma omp parallel for if(threads > 1) num_threads(threads) \
+        schedule(static)
+    for (int b = 0; b < n_blocks; b++) {
+        int i0 = b * WBACON_ROW_BLOCK;
+        int rows = k - i0 < WBACON_ROW_BLOCK ? k - i0 : WBACON_ROW_BLOCK;
+        F77_CALL(dsyrk)("L", "T", &p, &rows, &d_one, a + i0, &k, &d_zero,
+            part + (size_t)b * pp, &p);
+    }
+
+    // pairwise tree: block b += block b + step (lower triangle)
+    for (int step = 1; step < n_blocks; step *= 2) {
+        #pragma omp parallel for if(threads > 1) num_threads(threads) \
+            schedule(static)
+        for (int b = 0; b < n_blocks - step; b += 2 * step) {
+            double* restrict dst = part + (size_t)b * pp;
+            double* restrict src = part + (size_t)(b + step) * pp;
+            for (int j = 0; j < p; j++)
+                for (int i = j; i < p; i++)
+                    dst[i + p * j] += src[i + p * j];
+        }
+    }
+
+    for (int j = 0; j < p; j++)
+        for (int i = j; i < p; i++)
+            scatter[i + p * j] = alpha * part[i + p * j];
+    mem_free(part);
+}
+
 /******************************************************************************\
 |* weighted covariance/ scatter matrix                                        *|
 |*  dat           data, typedef struct wbdata                                 *|
@@ -427,12 +1157,16 @@ static inline void scatter_w(wbdata *dat, double* restrict work_np,
     double* restrict w = dat->w;
     double* restrict w_sqrt = dat->w_sqrt;
 
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_SCATTER];
+    #endif
+
     double sum_w = 0.0;
     for (int i = 0; i < n; i++)
         sum_w += w[i] * select_weight[i];
 
     // centered data
-    #pragma omp parallel for if(n > OMP_MIN_SIZE)
+    #pragma omp parallel for if(threads > 1) num_threads(threads)
     for (int j = 0; j < p; j++) {
         #pragma omp simd
         for (int i = 0; i < n; i++) {
@@ -442,10 +1176,7 @@ static inline void scatter_w(wbdata *dat, double* restrict work_np,
     }
 
     // lower triangle of the scatter matrix
-    const double d_zero = 0.0;
-    double denom = 1.0 / (sum_w - 1.0);
-    F77_CALL(dsyrk)("L", "T", &p, &n, &denom, work_np, &n, &d_zero, scatter,
-        &p);
+    scatter_syrk(dat, n, 1.0 / (sum_w - 1.0), work_np, scatter);
 }
 
 /******************************************************************************\
@@ -456,12 +1187,16 @@ static inline void scatter_w(wbdata *dat, double* restrict work_np,
 |*  work_np       array[n, p]                                                 *|
 |*  center        on return: array[p]                                         *|
 |*  scatter       on return: array[p, p]                                      *|
+|* Return value: sum of the weights of the subset                             *|
 \******************************************************************************/
-static inline void mean_scatter_w(wbdata *dat, double* restrict select_weight,
+static inline double mean_scatter_w(wbdata *dat, double* restrict select_weight,
     double* restrict work_n, double* restrict work_np, double* restrict center,
     double* restrict scatter)
 {
     int n = dat->n, p = dat->p;
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_SCATTER];
+    #endif
     double denom;
     double* restrict x = dat->x;
     double* restrict w = dat->w;
@@ -478,27 +1213,148 @@ static inline void mean_scatter_w(wbdata *dat, double* restrict select_weight,
     // coordinate-wise mean and centered data
     denom = 1.0 / sum_w;
 
-    #pragma omp parallel for if(n > OMP_MIN_SIZE)
+    #pragma omp parallel for if(threads > 1) num_threads(threads)
+    for (int j = 0; j < p; j++)
+        kernel_moments(x + (size_t)n * j, work_n, w_sqrt, select_weight, n,
+            denom, &center[j], work_np + (size_t)n * j);
+
+    // lower triangle of the scatter matrix
+    scatter_syrk(dat, n, 1.0 / (sum_w - 1.0), work_np, scatter);
+    return sum_w;
+}
+
+/******************************************************************************\
+|* weighted mean and scatter matrix of the compacted subset (the m rows of    *|
+|* the subset are gathered; otherwise, the same as mean_scatter_w)            *|
+|*  dat           data, typedef struct wbdata                                 *|
+|*  select_weight weight = 1.0 if obs. in subset, otherwise 0.0, array[n]     *|
+|*  index         on return: rows of the subset, array[n]                     *|
+|*  work_np       on return: centered and weighted subset, array[m, p]        *|
+|*  center        on return: array[p]                                         *|
+|*  scatter       on return: array[p, p]                                      *|
+|* Return value: sum of the weights of the subset                             *|
+\******************************************************************************/
+static inline double mean_scatter_compact(wbdata *dat,
+    double* restrict select_weight, int* restrict index,
+    double* restrict work_np, double* restrict center,
+    double* restrict scatter)
+{
+    int n = dat->n, p = dat->p, m = 0;
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_SCATTER];
+    #endif
+    double* restrict x = dat->x;
+    double* restrict w = dat->w;
+    double* restrict w_sqrt = dat->w_sqrt;
+
+    for (int i = 0; i < n; i++)
+        if (select_weight[i] > 0.0)
+            index[m++] = i;
+    if (m == 0)                         // empty subset (see mahalanobis)
+        return 0.0;
+
+    double sum_w = 0.0;
+    for (int k = 0; k < m; k++)
+        sum_w += w[index[k]];
+
+    // coordinate-wise mean and centered data (in the order of mean_scatter_w)
+    double denom = 1.0 / sum_w;
+
+    #pragma omp parallel for if(threads > 1) num_threads(threads)
     for (int j = 0; j < p; j++) {
+        double* restrict x_j = x + (size_t)n * j;
+        double* restrict work_j = work_np + (size_t)m * j;
         center[j] = 0.0;
-        for (int i = 0; i < n; i++)
-            center[j] += x[n * j + i] * work_n[i];
+        for (int k = 0; k < m; k++)
+            center[j] += x_j[index[k]] * w[index[k]];
 
         center[j] *= denom;
 
-        // center the data and pre-multiply by sqrt(w[i])
-        #pragma omp simd
-        for (int i = 0; i < n; i++) {
-            work_np[n * j + i] = x[n * j + i] - center[j];
-            work_np[n * j + i] *= w_sqrt[i] * select_weight[i];
-        }
+        for (int k = 0; k < m; k++)
+            work_j[k] = (x_j[index[k]] - center[j]) * w_sqrt[index[k]];
     }
 
     // lower triangle of the scatter matrix
-    const double d_zero = 0.0;
-    denom = 1.0 / (sum_w - 1.0);
-    F77_CALL(dsyrk)("L", "T", &p, &n, &denom, work_np, &n, &d_zero, scatter,
-        &p);
+    scatter_syrk(dat, m, 1.0 / (sum_w - 1.0), work_np, scatter);
+    return sum_w;
+}
+
+/******************************************************************************\
+|* moments of the subset about the center (after a full computation)          *|
+|*  work    work arrays, typedef struct workarray                             *|
+|*  center  array[p]                                                          *|
+|*  scatter array[p, p]                                                       *|
+|*  p       dimension                                                         *|
+|*  sum_w   sum of the weights of the subset                                  *|
+\******************************************************************************/
+static void moments_reset(workarray *work, double* restrict center,
+    double* restrict scatter, int p, double sum_w)
+{
+    for (int j = 0; j < p; j++) {
+        work->ref[j] = center[j];
+        work->sum_wx[j] = 0.0;
+    }
+    for (int j = 0; j < p * p; j++)
+        work->sum_wxx[j] = scatter[j] * (sum_w - 1.0);
+    work->sum_w = sum_w;
+    work->valid = 1;
+}
+
+/******************************************************************************\
+|* incremental update of the moments by the rows that changed membership     *|
+|*  dat     data, typedef struct wbdata                                       *|
+|*  work    work arrays, typedef struct workarray                             *|
+|*  center  on return: array[p]                                               *|
+|*  scatter on return: array[p, p] (lower triangle)                           *|
+|* NOTE: the moments are about the center of the last full computation (ref); *|
+|*       the rows are listed in work->iarray (see wbacon)                     *|
+\******************************************************************************/
+static void moments_update(wbdata *dat, workarray *work,
+    double* restrict center, double* restrict scatter)
+{
+    int n = dat->n, p = dat->p;
+    double* restrict x = dat->x;
+    double* restrict w = dat->w;
+    double* restrict w_sqrt = dat->w_sqrt;
+    double* restrict ref = work->ref;
+    double* restrict sum_wx = work->sum_wx;
+    double* restrict buf = work->work_np;
+    const double d_one = 1.0;
+
+    // added rows (sign = 1), removed rows (sign = -1)
+    for (int pass = 0; pass < 2; pass++) {
+        int rows = pass ? work->n_removed : work->n_added;
+        int* restrict index = pass ? work->iarray + n - rows : work->iarray;
+        double sign = pass ? -1.0 : 1.0;
+        if (rows == 0)
+            continue;
+
+        for (int k = 0; k < rows; k++)
+            work->sum_w += sign * w[index[k]];
+
+        for (int j = 0; j < p; j++) {
+            double* restrict x_j = x + (size_t)n * j;
+            double* restrict buf_j = buf + (size_t)rows * j;
+            double tmp, sum = 0.0;
+            for (int k = 0; k < rows; k++) {
+                tmp = x_j[index[k]] - ref[j];
+                sum += w[index[k]] * tmp;
+                buf_j[k] = w_sqrt[index[k]] * tmp;
+            }
+            sum_wx[j] += sign * sum;
+        }
+        F77_CALL(dsyrk)("L", "T", &p, &rows, &sign, buf, &rows, &d_one,
+            work->sum_wxx, &p);
+    }
+
+    // center and scatter (lower triangle)
+    double sum_w = work->sum_w;
+    for (int j = 0; j < p; j++) {
+        center[j] = ref[j] + sum_wx[j] / sum_w;
+        for (int i = j; i < p; i++)
+            scatter[i + p * j] = (work->sum_wxx[i + p * j]
+                - sum_wx[i] * sum_wx[j] / sum_w) / (sum_w - 1.0);
+    }
 }
 
 /******************************************************************************\
@@ -542,29 +1398,75 @@ static inline void euclidean_norm2(wbdata *dat, double* restrict work_np,
 |*  select_weight weight = 1.0 if obs. in subset, otherwise 0.0, array[n]     *|
 |*  center        array[p]                                                    *|
 |*  scatter       array[p, p]                                                 *|
-|* NOTE: on return: dat->dist                                                 *|
+|*  kernel        kernel of the center and scatter (see plan_scatter)         *|
+|* NOTE: on return: dat->dist; WBACON_ERROR_RANK_DEFICIENT if the scatter     *|
+|*       matrix is not positive definite or not defined (the weights of the   *|
+|*       subset sum up to at most one, e.g., the subset is empty)             *|
 \******************************************************************************/
 static inline wbacon_error_type mahalanobis(wbdata *dat, workarray *work,
     double* restrict select_weight, double* restrict center,
-    double* restrict scatter)
+    double* restrict scatter, wbacon_kernel_type kernel)
 {
     int n = dat->n, p = dat->p;
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_DISTANCE];
+    #endif
     double* restrict dist = dat->dist;
     double* restrict x = dat->x;
     double* restrict work_np = work->work_np;
+    double sum_w;
 
     // coordinate-wise mean and scatter matrix
-    mean_scatter_w(dat, select_weight, work->work_n, work_np, center, scatter);
+    threads_blas(dat->blas, dat->plan->blas[WBACON_STEP_SCATTER]);
+    switch (kernel) {
+    case WBACON_KERNEL_REUSE:       // the subset did not change
+        if (!work->stale)
+            return WBACON_ERROR_OK;
+        break;                      // only the distances are computed
+    case WBACON_KERNEL_INCREMENTAL:
+        moments_update(dat, work, center, scatter);
+        break;
+    case WBACON_KERNEL_COMPACTED:
+        sum_w = mean_scatter_compact(dat, select_weight, work->iarray,
+            work_np, center, scatter);
+        if (!(sum_w > 1.0)) {       // the scatter matrix is not defined
+            work->valid = 0;
+            return WBACON_ERROR_RANK_DEFICIENT;
+        }
+        moments_reset(work, center, scatter, p, sum_w);
+        break;
+    default:
+        sum_w = mean_scatter_w(dat, select_weight, work->work_n, work_np,
+            center, scatter);
+        if (!(sum_w > 1.0)) {       // the scatter matrix is not defined
+            work->valid = 0;
+            return WBACON_ERROR_RANK_DEFICIENT;
+        }
+        moments_reset(work, center, scatter, p, sum_w);
+    }
 
     // Cholesky decomposition of scatter matrix
     Memcpy(work->work_pp, scatter, p * p);
     int info;
     F77_CALL(dpotrf)("L", &p, work->work_pp, &p, &info);
-    if (info != 0)
+    if (info != 0) {
+        work->valid = 0;
+        // the incremental update is recomputed in full before we give up
+        if (kernel == WBACON_KERNEL_INCREMENTAL)
+            return mahalanobis(dat, work, select_weight, center, scatter,
+                WBACON_KERNEL_MASKED);
         return WBACON_ERROR_RANK_DEFICIENT;
+    }
+
+    threads_blas(dat->blas, dat->plan->blas[WBACON_STEP_DISTANCE]);
+    if (dat->plan->kernel[WBACON_STEP_DISTANCE] == WBACON_KERNEL_FUSED) {
+        if (distance_fused(dat, work_np, work->work_pp, center))
+            return WBACON_ERROR_STOPPED;
+        return WBACON_ERROR_OK;
+    }
 
     // center the data
-    #pragma omp parallel for if(n > OMP_MIN_SIZE)
+    #pragma omp parallel for if(threads > 1) num_threads(threads)
     for (int j = 0; j < p; j++) {
         #pragma omp simd
         for (int i = 0; i < n; i++)
@@ -576,14 +1478,63 @@ static inline wbacon_error_type mahalanobis(wbdata *dat, workarray *work,
     F77_CALL(dtrsm)("R", "L", "T", "N", &n, &p, &d_one, work->work_pp, &p,
         work_np, &n);
 
-    // squared Mahalanobis distances (row sums)
-    for (int i = 0; i < n; i++)
-        dist[i] = _POWER2(work_np[i]);
-
-    for (int j = 1; j < p; j++)
-        for (int i = 0; i < n; i++)
-            dist[i] += _POWER2(work_np[n * j + i]);
+    // squared Mahalanobis distances (row sums on tiles of rows)
+    int n_tiles = (n + WBACON_TILE - 1) / WBACON_TILE;
+    #pragma omp parallel for if(threads > 1) num_threads(threads) \
+        schedule(static)
+    for (int t = 0; t < n_tiles; t++) {
+        int i0 = t * WBACON_TILE;
+        int rows = n - i0 < WBACON_TILE ? n - i0 : WBACON_TILE;
+        kernel_sumsq_rows(work_np + i0, n, rows, p, dist + i0);
+    }
 
     return WBACON_ERROR_OK;
 }
+
+/******************************************************************************\
+|* squared Mahalanobis distances by tiles of rows: centering, forward         *|
+|* substitution, and row sums are fused (a tile stays in cache)               *|
+|*  dat     data, typedef struct wbdata                                       *|
+|*  work_np work array, array[n * p]; tile t occupies the elements            *|
+|*          [t * WBACON_TILE * p, (t * WBACON_TILE + rows) * p)               *|
+|*  L       Cholesky factor (lower triangle), array[p, p]                     *|
+|*  center  array[p]                                                          *|
+|* Return value: 1: the tiles were skipped because the time budget ran out   *|
+|*               (see wbacon_deadline.c); 0: otherwise                        *|
+|* NOTE: the operations are in the order of dtrsm (reference BLAS) and of    *|
+|*       the row sums in mahalanobis (see kernel_distance_tile)               *|
+\******************************************************************************/
+static int distance_fused(wbdata *dat, double* restrict work_np,
+    double* restrict L, double* restrict center)
+{
+    int n = dat->n, p = dat->p;
+    #ifdef _OPENMP
+    int threads = dat->plan->threads[WBACON_STEP_DISTANCE];
+    #endif
+    int n_tiles = (n + WBACON_TILE - 1) / WBACON_TILE;
+    double* restrict x = dat->x;
+    double* restrict dist = dat->dist;
+    wbacon_deadline *deadline = dat->deadline;
+    int stop = 0;
+
+    #pragma omp parallel for if(threads > 1) num_threads(threads) \
+        schedule(static)
+    for (int t = 0; t < n_tiles; t++) {
+        int skip;
+        #pragma omp atomic read
+        skip = stop;
+        if (skip)
+            continue;
+        if (t % WBACON_DEADLINE_TILES == 0 && deadline_expired(deadline)) {
+            #pragma omp atomic write
+            stop = 1;
+            continue;
+        }
+        int i0 = t * WBACON_TILE;
+        int rows = n - i0 < WBACON_TILE ? n - i0 : WBACON_TILE;
+        kernel_distance_tile(x + i0, n, p, rows, L, center,
+            work_np + (size_t)i0 * p, dist + i0);
+    }
+    return stop;
+}
 #undef _POWER2
@@ -4,29 +4,54 @@
 #include "wquantile.h"
 #include "partial_sort.h"
 #include "wbacon_error.h"
+#include "wbacon_trace.h"
+#include "wbacon_memory.h"
+#include "wbacon_probes.h"
+#include "wbacon_plan.h"
+#include "wbacon_deadline.h"
+#include "wbacon_checkpoint.h"
 
 #ifdef _OPENMP
     #include <omp.h>
 #endif
-#define OMP_MIN_SIZE 100000         // OpenMP enabled when n > OMP_MIN_SIZE
 
 #ifndef _WBACON_H
 #define _WBACON_H
 
 // macros
+#ifndef R_PACKAGE
 #define R_PACKAGE 1					// 1: *.dll/*.so for R; 0: standalone binary
+#endif
 #define _RANK_TOLERANCE 1.0e-8		// criterion to detect rank deficiency
 
+// the threads of a parallel region do not print (the console of R is not
+// thread-safe; e.g., the engines called by wbacon_simulate)
+#ifdef _OPENMP
+    #define _PRINT_QUIET omp_in_parallel()
+#else
+    #define _PRINT_QUIET 0
+#endif
+
 // variadic arguments in macros are supported by gcc (>=3.0), clang (all
 // versions), visual studio (>=2005); the version with ##__VA_ARGS__ (which
 // will silently eliminate the trailing comma) is not portable (clang complains)
 #if R_PACKAGE
-    #define PRINT_OUT(...) Rprintf(__VA_ARGS__)
+    #define PRINT_OUT(...) (_PRINT_QUIET ? (void)0 : Rprintf(__VA_ARGS__))
 #else
-    #define PRINT_OUT(...) printf(__VA_ARGS__)
+    #define PRINT_OUT(...) (_PRINT_QUIET ? (void)0 : (void)printf(__VA_ARGS__))
 #endif
 
 // declarations
 void wbacon(double*, double*, double*, double*, double*, int*, int*, double*,
-    int*, double*, int*, int*, int*, int*, int*, int*);
+    int*, double*, int*, int*, int*, int*, int*, int*, double*, int*, int*,
+    double*, int*, double*, int*, double*, double*, int*, char**, int*);
+wbacon_error_type wbacon_fit(double*, double*, double*, double*, double*,
+    int*, int*, double*, int*, double*, int*, int*, int*, int*, int*, int*,
+    double*, int*, int*, double*, int*, double*, int*, double*, double*, int*,
+    char**, int*, double);
+void wbacon_dryrun(int*, int*, int*, int*, int*, int*, double*);
+void wbacon_explain(int*, int*, int*, int*, int*, int*, int*, double*, int*,
+    int*, int*, double*, int*, double*);
+void wbacon_replicate(double*, double*, int*, int*, int*, int*, double*, int*,
+    int*, double*, double*, double*, int*, int*, int*, double*);
 #endif
@@ -0,0 +1,281 @@
+/* Checkpoints of the engines at the boundaries of their iterations
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       An engine registers the arrays and scalars of its state
+               (items) once and saves them at the beginning of every
+               iteration. The file is written to '<path>.tmp' and renamed;
+               hence, the file is either the last or the previous complete
+               checkpoint (preemption). The subsets are stored as bitmaps.
+               The header holds the dimensions and a fingerprint of the data
+               and the arguments; a checkpoint is only loaded into a call
+               with the same fingerprint. The file is in the byte order of
+               the machine (it is not portable across architectures).
+
+               File format: magic "WBACONCK", version, byte-order mark,
+               engine, n, p, stage, iteration, number of items (uint32),
+               fingerprint (uint64); per item: type (uint32), number of
+               elements (uint64), and the elements; hash of the elements
+               (uint64)
+*/
+
+#include "wbacon_checkpoint.h"
+#include <string.h>
+#if !defined(_WIN32)
+    #include <unistd.h>             // fsync
+    #define WBACON_POSIX 1
+#else
+    #define WBACON_POSIX 0
+#endif
+
+#define _MAGIC "WBACONCK"
+#define _BYTE_ORDER 0x01020304u
+#define _HASH_INIT 14695981039346656037ull  // FNV-1a offset basis
+#define _HASH_PRIME 1099511628211ull        // FNV-1a prime
+
+/******************************************************************************\
+|* hash of a block of memory (FNV-1a on 8-byte words; the tail by bytes)      *|
+|*  h       hash of the previous blocks (0: first block)                      *|
+|*  data    block                                                             *|
+|*  bytes   size of the block                                                 *|
+|* Return value: hash                                                         *|
+\******************************************************************************/
+uint64_t checkpoint_hash(uint64_t h, const void *data, size_t bytes)
+{
+    const unsigned char *s = (const unsigned char*)data;
+    uint64_t word;
+    size_t i = 0;
+    if (h == 0)
+        h = _HASH_INIT;
+    for (; i + 8 <= bytes; i += 8) {
+        memcpy(&word, s + i, 8);
+        h = (h ^ word) * _HASH_PRIME;
+    }
+    for (; i < bytes; i++)
+        h = (h ^ (uint64_t)s[i]) * _HASH_PRIME;
+    return h;
+}
+
+/******************************************************************************\
+|* fingerprint of a double array (the raw bytes; .C entry point of the        *|
+|* sorted-order cache, see wquantile_cache in R)                              *|
+|*  x       array[n]                                                          *|
+|*  n       dimension                                                         *|
+|*  hash    on return: FNV-1a hash (see checkpoint_hash) in two 32-bit        *|
+|*          halves (lower, upper), array[2]                                   *|
+\******************************************************************************/
+void checkpoint_fingerprint(double *x, int *n, int *hash)
+{
+    uint64_t h = checkpoint_hash(0, x, (size_t)*n * sizeof(double));
+    uint32_t half[2] = {(uint32_t)h, (uint32_t)(h >> 32)};
+    memcpy(hash, half, 2 * sizeof(uint32_t));
+}
+
+/******************************************************************************\
+|* begin the checkpoints of a call                                            *|
+|*  ck          typedef struct wbacon_checkpoint                              *|
+|*  mem         typedef struct wbacon_memory                                  *|
+|*  path        file; NULL or "": no checkpoints                              *|
+|*  engine      typedef enum wbacon_checkpoint_engine                         *|
+|*  n, p        dimensions                                                    *|
+|*  fingerprint hash of the data and the arguments (see checkpoint_hash)      *|
+\******************************************************************************/
+void checkpoint_begin(wbacon_checkpoint *ck, wbacon_memory *mem,
+    const char *path, int engine, int n, int p, uint64_t fingerprint)
+{
+    ck->path = path != NULL && path[0] != '\0' ? path : NULL;
+    ck->engine = engine;
+    ck->n = n;
+    ck->p = p;
+    ck->fingerprint = fingerprint;
+    ck->stage = 0;
+    ck->iter = 0;
+    ck->resumed = 0;
+    ck->failed = 0;
+    ck->n_items = 0;
+    ck->bits = ck->path == NULL ? NULL : (unsigned char*) mem_alloc(mem,
+        (size_t)n / 8 + 1, 1, WBACON_MEM_SUBSET);
+}
+
+// register an item of the state (in the order of the file)
+void checkpoint_add(wbacon_checkpoint *ck, wbacon_checkpoint_item_type type,
+    void *ptr, size_t len)
+{
+    if (ck->path == NULL || ck->n_items == WBACON_CHECKPOINT_ITEMS)
+        return;
+    ck->item[ck->n_items].type = type;
+    ck->item[ck->n_items].ptr = ptr;
+    ck->item[ck->n_items].len = len;
+    ck->n_items++;
+}
+
+// end the checkpoints of a call (the file is kept)
+void checkpoint_end(wbacon_checkpoint *ck)
+{
+    mem_free(ck->bits);
+    ck->bits = NULL;
+}
+
+// bytes of an item in the file
+static size_t item_bytes(wbacon_checkpoint_item *item)
+{
+    switch (item->type) {
+    case WBACON_ITEM_BITMAP:
+        return (item->len + 7) / 8;
+    case WBACON_ITEM_INT:
+        return item->len * sizeof(int);
+    default:
+        return item->len * sizeof(double);
+    }
+}
+
+/******************************************************************************\
+|* save the state (the registered items)                                      *|
+|*  ck      typedef struct wbacon_checkpoint                                  *|
+|*  stage   algorithm (3, 4, or 5)                                            *|
+|*  iter    iteration (or step) that begins                                   *|
+|* Return value: 0: saved (or no checkpoints); 1: the file could not be       *|
+|*               written (no further checkpoints are written)                 *|
+\******************************************************************************/
+int checkpoint_save(wbacon_checkpoint *ck, int stage, int iter)
+{
+    if (ck->path == NULL || ck->failed)
+        return 0;
+
+    size_t len = strlen(ck->path);
+    char *tmp = (char*) Calloc(len + 5, char);
+    memcpy(tmp, ck->path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        Free(tmp);
+        ck->failed = 1;
+        return 1;
+    }
+
+    uint32_t head[8] = {WBACON_CHECKPOINT_VERSION, _BYTE_ORDER,
+        (uint32_t)ck->engine, (uint32_t)ck->n, (uint32_t)ck->p,
+        (uint32_t)stage, (uint32_t)iter, (uint32_t)ck->n_items};
+    int ok = fwrite(_MAGIC, 1, 8, f) == 8;
+    ok &= fwrite(head, sizeof(uint32_t), 8, f) == 8;
+    ok &= fwrite(&ck->fingerprint, sizeof(uint64_t), 1, f) == 1;
+
+    uint64_t h = 0;
+    for (int k = 0; k < ck->n_items && ok; k++) {
+        wbacon_checkpoint_item *item = ck->item + k;
+        uint32_t type = (uint32_t)item->type;
+        uint64_t n_elem = (uint64_t)item->len;
+        size_t bytes = item_bytes(item);
+        const void *data = item->ptr;
+        if (item->type == WBACON_ITEM_BITMAP) {
+            int *x = (int*)item->ptr;
+            memset(ck->bits, 0, bytes);
+            for (size_t i = 0; i < item->len; i++)
+                ck->bits[i >> 3] |= (unsigned char)((x[i] != 0) << (i & 7));
+            data = ck->bits;
+        }
+        ok &= fwrite(&type, sizeof(uint32_t), 1, f) == 1;
+        ok &= fwrite(&n_elem, sizeof(uint64_t), 1, f) == 1;
+        ok &= fwrite(data, 1, bytes, f) == bytes;
+        h = checkpoint_hash(h, data, bytes);
+    }
+    ok &= fwrite(&h, sizeof(uint64_t), 1, f) == 1;
+    ok &= fflush(f) == 0;
+    #if WBACON_POSIX
+    ok &= fsync(fileno(f)) == 0;
+    #endif
+    ok &= fclose(f) == 0;
+
+    // replace the previous checkpoint (rename does not replace an existing
+    // file on Windows)
+    #if !WBACON_POSIX
+    if (ok)
+        remove(ck->path);
+    #endif
+    if (ok)
+        ok = rename(tmp, ck->path) == 0;
+    if (!ok) {
+        remove(tmp);
+        ck->failed = 1;
+    }
+    Free(tmp);
+    return !ok;
+}
+
+/******************************************************************************\
+|* load the state (the registered items)                                      *|
+|*  ck      typedef struct wbacon_checkpoint: on return, stage, iter, and     *|
+|*          resumed                                                           *|
+|* Return value: typedef enum wbacon_checkpoint_status                        *|
+|* NOTE: the items are overwritten only if the header matches the call        *|
+\******************************************************************************/
+wbacon_checkpoint_status checkpoint_load(wbacon_checkpoint *ck)
+{
+    if (ck->path == NULL)
+        return WBACON_CHECKPOINT_NONE;
+    FILE *f = fopen(ck->path, "rb");
+    if (f == NULL)
+        return WBACON_CHECKPOINT_NONE;
+
+    char magic[8];
+    uint32_t head[8];
+    uint64_t fingerprint;
+    int ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, _MAGIC, 8) == 0;
+    ok = ok && fread(head, sizeof(uint32_t), 8, f) == 8;
+    ok = ok && fread(&fingerprint, sizeof(uint64_t), 1, f) == 1;
+    ok = ok && head[0] == WBACON_CHECKPOINT_VERSION && head[1] == _BYTE_ORDER
+        && head[2] == (uint32_t)ck->engine && head[3] == (uint32_t)ck->n
+        && head[4] == (uint32_t)ck->p && head[7] == (uint32_t)ck->n_items
+        && fingerprint == ck->fingerprint;
+
+    uint64_t h = 0, h_file;
+    for (int k = 0; k < ck->n_items && ok; k++) {
+        wbacon_checkpoint_item *item = ck->item + k;
+        uint32_t type;
+        uint64_t n_elem;
+        size_t bytes = item_bytes(item);
+        ok = fread(&type, sizeof(uint32_t), 1, f) == 1
+            && fread(&n_elem, sizeof(uint64_t), 1, f) == 1
+            && type == (uint32_t)item->type && n_elem == (uint64_t)item->len;
+        if (!ok)
+            break;
+        if (item->type == WBACON_ITEM_BITMAP) {
+            ok = fread(ck->bits, 1, bytes, f) == bytes;
+            int *x = (int*)item->ptr;
+            for (size_t i = 0; i < item->len && ok; i++)
+                x[i] = (ck->bits[i >> 3] >> (i & 7)) & 1;
+            h = checkpoint_hash(h, ck->bits, bytes);
+        } else {
+            ok = fread(item->ptr, 1, bytes, f) == bytes;
+            h = checkpoint_hash(h, item->ptr, bytes);
+        }
+    }
+    ok = ok && fread(&h_file, sizeof(uint64_t), 1, f) == 1 && h_file == h;
+    fclose(f);
+    if (!ok)
+        return WBACON_CHECKPOINT_INVALID;
+
+    ck->stage = (int)head[5];
+    ck->iter = (int)head[6];
+    ck->resumed = 1;
+    return WBACON_CHECKPOINT_RESUMED;
+}
+#undef _MAGIC
+#undef _BYTE_ORDER
+#undef _HASH_INIT
+#undef _HASH_PRIME
@@ -0,0 +1,75 @@
+#include <R.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "wbacon_memory.h"
+
+#ifndef _WBACON_CHECKPOINT_H
+#define _WBACON_CHECKPOINT_H
+
+#define WBACON_CHECKPOINT_VERSION 1     // version of the file format
+#define WBACON_CHECKPOINT_ITEMS 24      // max. number of items of a checkpoint
+
+// engines that write checkpoints
+typedef enum wbacon_checkpoint_engine_enum {
+    WBACON_CHECKPOINT_WBACON = 0,
+    WBACON_CHECKPOINT_REG
+} wbacon_checkpoint_engine;
+
+// types of the items (the arrays and scalars of the state of an engine)
+typedef enum wbacon_checkpoint_item_enum {
+    WBACON_ITEM_BITMAP = 0,         // int array of 0/1 (stored as bits)
+    WBACON_ITEM_INT,                // int array
+    WBACON_ITEM_DOUBLE              // double array
+} wbacon_checkpoint_item_type;
+
+// status of checkpoint_load (and of the argument 'resume' on return)
+typedef enum wbacon_checkpoint_status_enum {
+    WBACON_CHECKPOINT_INVALID = -1, // the file does not match the call or is
+                                    //   corrupt
+    WBACON_CHECKPOINT_NONE = 0,     // no file: the engine starts from scratch
+    WBACON_CHECKPOINT_RESUMED       // the state was restored
+} wbacon_checkpoint_status;
+
+// an item: len elements at ptr
+typedef struct wbacon_checkpoint_item_struct {
+    int type;                       // see wbacon_checkpoint_item_type
+    void *ptr;
+    size_t len;
+} wbacon_checkpoint_item;
+
+// checkpoints of a call of an engine
+typedef struct wbacon_checkpoint_struct {
+    const char *path;               // file (NULL: no checkpoints)
+    int engine;                     // see wbacon_checkpoint_engine
+    int n;
+    int p;
+    uint64_t fingerprint;           // hash of the data and the arguments
+    int stage;                      // algorithm (3, 4, or 5) of the state
+    int iter;                       // iteration (or step) of the state
+    int resumed;                    // 1: the state was restored
+    int failed;                     // 1: a checkpoint could not be written
+    int n_items;
+    wbacon_checkpoint_item item[WBACON_CHECKPOINT_ITEMS];
+    unsigned char *bits;            // buffer of the bitmaps, array[n / 8 + 1]
+} wbacon_checkpoint;
+
+// declarations
+void checkpoint_begin(wbacon_checkpoint*, wbacon_memory*, const char*, int,
+    int, int, uint64_t);
+void checkpoint_add(wbacon_checkpoint*, wbacon_checkpoint_item_type, void*,
+    size_t);
+int checkpoint_save(wbacon_checkpoint*, int, int);
+wbacon_checkpoint_status checkpoint_load(wbacon_checkpoint*);
+void checkpoint_end(wbacon_checkpoint*);
+uint64_t checkpoint_hash(uint64_t, const void*, size_t);
+void checkpoint_fingerprint(double*, int*, int*);
+
+// 1: iteration 'iter' of algorithm 'stage' continues a restored state (it is
+// run in full; the time budget is not checked before its distances are
+// computed)
+static inline int checkpoint_resumed(wbacon_checkpoint *ck, int stage,
+    int iter)
+{
+    return ck != NULL && ck->resumed && ck->stage == stage && ck->iter == iter;
+}
+#endif
@@ -0,0 +1,147 @@
+/* Hardware performance counters of the engines (Linux: perf_event_open)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+*/
+
+#include "wbacon_counters.h"
+
+#if defined(__linux__)
+    #include <string.h>
+    #include <stdint.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+    #define _HAVE_PERF_EVENT 1
+#else
+    #define _HAVE_PERF_EVENT 0
+#endif
+
+#if _HAVE_PERF_EVENT
+// events of the counters (in the order of wbacon_counter_type)
+static const uint64_t WBACON_COUNTER_EVENTS[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/******************************************************************************\
+|* open a counter of the calling thread (user space only)                     *|
+|*  event   hardware event                                                    *|
+|* NOTE: returns the file descriptor, or -1 if the counter is not available   *|
+|*       (e.g., no PMU in a virtual machine, or perf_event_paranoid > 2)      *|
+\******************************************************************************/
+static int open_counter(uint64_t event)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = event;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/******************************************************************************\
+|* open the counters for every thread of the OpenMP team                      *|
+|*  pmu     typedef struct wbacon_counters                                    *|
+|* NOTE: a counter measures the thread that opened it; hence, the counters    *|
+|*       are opened in a parallel region with the current number of threads   *|
+|*       (call counters_open after omp_set_num_threads). The counters of the  *|
+|*       threads of BLAS/ LAPACK (if any) are not opened. A counter is        *|
+|*       available only if it could be opened for all threads                 *|
+\******************************************************************************/
+void counters_open(wbacon_counters *pmu)
+{
+    pmu->available = 0;
+    pmu->n_threads = 0;
+    pmu->fd = NULL;
+#if _HAVE_PERF_EVENT
+    int n_threads = 1;
+    #ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+    #endif
+    int *fd = (int*) Calloc(n_threads * WBACON_COUNTER_COUNT, int);
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        int t = 0;
+        #ifdef _OPENMP
+        t = omp_get_thread_num();
+        #endif
+        for (int c = 0; c < WBACON_COUNTER_COUNT; c++)
+            fd[t * WBACON_COUNTER_COUNT + c] =
+                open_counter(WBACON_COUNTER_EVENTS[c]);
+    }
+
+    int available = (1 << WBACON_COUNTER_COUNT) - 1;
+    for (int t = 0; t < n_threads; t++)
+        for (int c = 0; c < WBACON_COUNTER_COUNT; c++)
+            if (fd[t * WBACON_COUNTER_COUNT + c] < 0)
+                available &= ~(1 << c);
+
+    pmu->available = available;
+    pmu->n_threads = n_threads;
+    pmu->fd = fd;
+    if (available == 0)
+        counters_close(pmu);
+#endif
+}
+
+/******************************************************************************\
+|* read the counters (sum over the threads)                                   *|
+|*  pmu     typedef struct wbacon_counters                                    *|
+|*  values  on return: array[WBACON_COUNTER_COUNT]; 0.0 if not available      *|
+\******************************************************************************/
+void counters_read(wbacon_counters *pmu, double *values)
+{
+    for (int c = 0; c < WBACON_COUNTER_COUNT; c++)
+        values[c] = 0.0;
+#if _HAVE_PERF_EVENT
+    uint64_t count;
+    for (int t = 0; t < pmu->n_threads; t++) {
+        for (int c = 0; c < WBACON_COUNTER_COUNT; c++) {
+            if (!(pmu->available & (1 << c)))
+                continue;
+            if (read(pmu->fd[t * WBACON_COUNTER_COUNT + c], &count,
+                sizeof(count)) == sizeof(count))
+                values[c] += (double)count;
+        }
+    }
+#endif
+}
+
+/******************************************************************************\
+|* close the counters                                                         *|
+|*  pmu     typedef struct wbacon_counters                                    *|
+\******************************************************************************/
+void counters_close(wbacon_counters *pmu)
+{
+#if _HAVE_PERF_EVENT
+    if (pmu->fd == NULL)
+        return;
+    for (int i = 0; i < pmu->n_threads * WBACON_COUNTER_COUNT; i++)
+        if (pmu->fd[i] >= 0)
+            close(pmu->fd[i]);
+    Free(pmu->fd);
+    pmu->fd = NULL;
+#endif
+    pmu->available = 0;
+    pmu->n_threads = 0;
+}
@@ -0,0 +1,31 @@
+#include <R.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WBACON_COUNTERS_H
+#define _WBACON_COUNTERS_H
+
+// hardware performance counters (Linux: perf_event_open); on other systems,
+// or if the kernel refuses to open a counter, the counter is not available
+typedef enum wbacon_counter_enum {
+    WBACON_COUNTER_CYCLES = 0,
+    WBACON_COUNTER_INSTRUCTIONS,
+    WBACON_COUNTER_LLC_MISSES,          // last-level cache misses
+    WBACON_COUNTER_BRANCH_MISSES,       // mispredicted branches
+    WBACON_COUNTER_COUNT                // [not an actual counter]
+} wbacon_counter_type;
+
+// counters of the threads of the OpenMP team
+typedef struct wbacon_counters_struct {
+    int available;          // bitmask of the available counters (0: none)
+    int n_threads;          // number of threads
+    int *fd;                // file descriptors, array[n_threads, COUNT]
+} wbacon_counters;
+
+// declarations
+void counters_open(wbacon_counters*);
+void counters_read(wbacon_counters*, double*);
+void counters_close(wbacon_counters*);
+#endif
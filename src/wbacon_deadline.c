@@ -0,0 +1,130 @@
+/* Time budget and cooperative cancellation of the engines
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The engines check the budget, the cancellation, and the user
+               interrupts of R at the boundaries of their iterations
+               (deadline_check; on the master thread, outside of parallel
+               regions); the budget and the cancellation are also checked
+               in the tile loop of the fused distances (deadline_expired;
+               on every thread). An engine that stops returns the estimates
+               of its last complete iteration. The user interrupt is
+               checked by R_CheckUserInterrupt in a top-level context
+               (R_ToplevelExec); hence, it does not jump out of the engine
+               (which would leak the work arrays); it is not checked if the
+               engine is called in a parallel region. wbacon_cancel can be
+               called from any thread or from a signal handler; it stops
+               the calls that are running when it is called.
+*/
+
+#include "wbacon_deadline.h"
+#if R_PACKAGE
+    #include <Rinternals.h>
+#endif
+
+// names of the reasons
+const char* const WBACON_STOP_STRINGS[] = {
+    "none",
+    "deadline",
+    "interrupt",
+    "cancel"
+};
+
+// generation of the cancellation (incremented by wbacon_cancel)
+static volatile sig_atomic_t cancel_generation = 0;
+
+#if R_PACKAGE
+// check for a user interrupt without a long jump (see the note)
+static void check_interrupt_fn(void *dummy)
+{
+    R_CheckUserInterrupt();
+}
+
+static int pending_interrupt(void)
+{
+    return !(R_ToplevelExec(check_interrupt_fn, NULL));
+}
+#endif
+
+/******************************************************************************\
+|* begin a call of an engine                                                  *|
+|*  dl      typedef struct wbacon_deadline                                    *|
+|*  budget  time budget of the call (seconds); <= 0: no budget               *|
+\******************************************************************************/
+void deadline_begin(wbacon_deadline *dl, double budget)
+{
+    dl->end = budget > 0.0 ? trace_clock() + budget : 0.0;
+    dl->generation = cancel_generation;
+    // R is not called from the threads of a parallel region
+    dl->interrupt = R_PACKAGE;
+    #ifdef _OPENMP
+    if (omp_in_parallel())
+        dl->interrupt = 0;
+    #endif
+    dl->stop = WBACON_STOP_NONE;
+}
+
+/******************************************************************************\
+|* check the budget, the cancellation, and the user interrupts (master        *|
+|* thread, outside of parallel regions)                                       *|
+|*  dl      typedef struct wbacon_deadline (or NULL)                          *|
+|* Return value: typedef enum wbacon_stop_type                                *|
+\******************************************************************************/
+wbacon_stop_type deadline_check(wbacon_deadline *dl)
+{
+    if (dl == NULL || dl->stop != WBACON_STOP_NONE)
+        return dl == NULL ? WBACON_STOP_NONE : dl->stop;
+
+    if (cancel_generation != dl->generation)
+        dl->stop = WBACON_STOP_CANCEL;
+    else if (dl->end > 0.0 && trace_clock() >= dl->end)
+        dl->stop = WBACON_STOP_DEADLINE;
+    #if R_PACKAGE
+    else if (dl->interrupt && pending_interrupt())
+        dl->stop = WBACON_STOP_INTERRUPT;
+    #endif
+    return dl->stop;
+}
+
+/******************************************************************************\
+|* check the budget and the cancellation (any thread, e.g., in a tile loop)   *|
+|*  dl      typedef struct wbacon_deadline (or NULL)                          *|
+|* Return value: 1: the call should stop; 0: otherwise                        *|
+|* NOTE: only with a budget; otherwise, the cancellation is checked at the    *|
+|*       iteration boundaries                                                 *|
+\******************************************************************************/
+int deadline_expired(wbacon_deadline *dl)
+{
+    if (dl == NULL || dl->end <= 0.0)
+        return 0;
+    return cancel_generation != dl->generation || trace_clock() >= dl->end;
+}
+
+// obtain the name of a reason
+const char* deadline_reason(wbacon_stop_type stop)
+{
+    if (stop >= WBACON_STOP_COUNT)
+        return NULL;
+    else
+        return WBACON_STOP_STRINGS[stop];
+}
+
+// cancel the calls of the engines that are running (async-signal-safe)
+void wbacon_cancel(void)
+{
+    cancel_generation++;
+}
@@ -0,0 +1,39 @@
+#include <R.h>
+#include <signal.h>
+#include "wbacon_trace.h"
+
+#ifndef _WBACON_DEADLINE_H
+#define _WBACON_DEADLINE_H
+
+#ifndef R_PACKAGE
+#define R_PACKAGE 1             // 1: *.dll/*.so for R; 0: standalone binary
+#endif
+#define WBACON_DEADLINE_TILES 8     // the tile loops check the deadline every
+                                    // WBACON_DEADLINE_TILES tiles
+
+// reasons why an engine stopped before convergence
+typedef enum wbacon_stop_enum {
+    WBACON_STOP_NONE = 0,           // not stopped
+    WBACON_STOP_DEADLINE,           // time budget exhausted
+    WBACON_STOP_INTERRUPT,          // user interrupt (R)
+    WBACON_STOP_CANCEL,             // cancellation (wbacon_cancel)
+    WBACON_STOP_COUNT               // [not an actual reason]
+} wbacon_stop_type;
+
+// time budget and cancellation of a call of an engine
+typedef struct wbacon_deadline_struct {
+    double end;                     // trace_clock() at the end of the budget
+                                    //   (0.0: no budget)
+    sig_atomic_t generation;        // generation of the cancellation at the
+                                    //   beginning of the call
+    int interrupt;                  // 1: check for user interrupts (R)
+    wbacon_stop_type stop;          // reason to stop (set by deadline_check)
+} wbacon_deadline;
+
+// declarations
+void deadline_begin(wbacon_deadline*, double);
+wbacon_stop_type deadline_check(wbacon_deadline*);
+int deadline_expired(wbacon_deadline*);
+const char* deadline_reason(wbacon_stop_type);
+void wbacon_cancel(void);
+#endif
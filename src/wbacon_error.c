@@ -25,7 +25,9 @@ const char* const CBACON_ERROR_STRINGS[] = {
     "matrix is rank deficient",
     "matrix is not positive definite",
     "triangular matrix is singular",
-    "failure of convergence"
+    "failure of convergence",
+    "stopped before convergence",
+    "memory allocation failed"
 };
 
 // obtain a human readable error message
@@ -2,12 +2,33 @@
 #include <R_ext/Rdynload.h>
 #include "wbacon.h"
 #include "wbacon_reg.h"
+#include "wbacon_checkpoint.h"
+#include "wbacon_simulate.h"
+#include "wquantile_sketch.h"
 
 // create arrays describing each C routine
 static const R_CMethodDef cMethods[]  = {
-    {"wbacon", (DL_FUNC) &wbacon, 15},
-    {"wbacon_reg", (DL_FUNC) &wbacon_reg, 17},
+    {"wbacon", (DL_FUNC) &wbacon, 28},
+    {"wbacon_reg", (DL_FUNC) &wbacon_reg, 25},
+    {"wbacon_dryrun", (DL_FUNC) &wbacon_dryrun, 7},
+    {"wbacon_reg_dryrun", (DL_FUNC) &wbacon_reg_dryrun, 4},
+    {"wbacon_explain", (DL_FUNC) &wbacon_explain, 14},
+    {"wbacon_replicate", (DL_FUNC) &wbacon_replicate, 16},
+    {"wbacon_simulate", (DL_FUNC) &wbacon_simulate, 17},
+    {"wbacon_calibrate", (DL_FUNC) &wbacon_calibrate, 2},
+    {"wbacon_blas", (DL_FUNC) &wbacon_blas, 2},
+    {"wbacon_simd", (DL_FUNC) &wbacon_simd, 1},
+    {"wbacon_placement", (DL_FUNC) &wbacon_placement, 2},
     {"wquantile", (DL_FUNC) &wquantile, 5},
+    {"wquantile_inplace", (DL_FUNC) &wquantile_inplace, 4},
+    {"wquantile_multi", (DL_FUNC) &wquantile_multi, 5},
+    {"wquantile_grouped", (DL_FUNC) &wquantile_grouped, 8},
+    {"wquantile_sort", (DL_FUNC) &wquantile_sort, 5},
+    {"wquantile_cached", (DL_FUNC) &wquantile_cached, 9},
+    {"wqsketch_update", (DL_FUNC) &wqsketch_update, 5},
+    {"wqsketch_merge", (DL_FUNC) &wqsketch_merge, 3},
+    {"wqsketch_quantile", (DL_FUNC) &wqsketch_quantile, 5},
+    {"checkpoint_fingerprint", (DL_FUNC) &checkpoint_fingerprint, 3},
     {NULL, NULL, 0}
 };
 
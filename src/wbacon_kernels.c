@@ -0,0 +1,172 @@
+/* SIMD kernels of wbacon and wbacon_reg (multiversioned)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The streaming loops of the hot paths (centering and weighting
+               of the columns, the fused distances, and the row sums of the
+               squared distances) are functions with a variant per
+               instruction set (see wbacon_simd.h); the variant is selected
+               once, when the shared object is loaded. The compiler does not
+               clone the bodies of OpenMP regions (they are outlined into
+               separate functions); hence, the kernels work on one column or
+               one tile of rows and are called inside the parallel loops of
+               the engines. The operations are in the same order in all
+               variants (no contraction to FMA); the results do not depend
+               on the CPU.
+*/
+
+#include "wbacon_kernels.h"
+#define _POWER2(_x) ((_x) * (_x))
+
+/******************************************************************************\
+|* weighted mean of a column and the centered and weighted column             *|
+|*  x_j           column j of the data, array[n]                              *|
+|*  work_n        w[i] if obs. i is in the subset, otherwise 0, array[n]      *|
+|*  w_sqrt        square root of the weights, array[n]                        *|
+|*  select_weight 1.0 if obs. in subset, otherwise 0.0, array[n]              *|
+|*  n             dimension                                                   *|
+|*  denom         1 / sum of the weights of the subset                        *|
+|*  center_j      on return: weighted mean of column j                        *|
+|*  work_j        on return: (x_j - center_j) * sqrt(w) * select_weight,      *|
+|*                array[n]                                                    *|
+|* NOTE: the sum is accumulated in the order of the rows (not vectorized)     *|
+\******************************************************************************/
+WBACON_TARGET_CLONES
+void kernel_moments(double* restrict x_j, double* restrict work_n,
+    double* restrict w_sqrt, double* restrict select_weight, int n,
+    double denom, double *center_j, double* restrict work_j)
+{
+    WBACON_NO_CONTRACT
+    double c = 0.0;
+    for (int i = 0; i < n; i++)
+        c += x_j[i] * work_n[i];
+
+    c *= denom;
+    *center_j = c;
+
+    // center the data and pre-multiply by sqrt(w[i])
+    #pragma omp simd
+    for (int i = 0; i < n; i++) {
+        work_j[i] = x_j[i] - c;
+        work_j[i] *= w_sqrt[i] * select_weight[i];
+    }
+}
+
+/******************************************************************************\
+|* squared Mahalanobis distances of a tile of rows: centering, forward        *|
+|* substitution, and row sums                                                 *|
+|*  x       first row of the tile in column 0 of the data (leading dim. ld)   *|
+|*  ld      leading dimension of x (number of rows of the data)               *|
+|*  p       number of columns                                                 *|
+|*  rows    number of rows of the tile                                        *|
+|*  L       Cholesky factor (lower triangle), array[p, p]                     *|
+|*  center  array[p]                                                          *|
+|*  z       work array, array[rows, p]                                        *|
+|*  d       on return: squared distances, array[rows]                         *|
+|* NOTE: the operations are in the order of dtrsm (reference BLAS) and of     *|
+|*       the row sums in kernel_sumsq_rows                                    *|
+\******************************************************************************/
+WBACON_TARGET_CLONES
+void kernel_distance_tile(double* restrict x, int ld, int p, int rows,
+    double* restrict L, double* restrict center, double* restrict z,
+    double* restrict d)
+{
+    WBACON_NO_CONTRACT
+    for (int j = 0; j < p; j++) {
+        double* restrict z_j = z + rows * j;
+        double* restrict x_j = x + (size_t)ld * j;
+        #pragma omp simd
+        for (int i = 0; i < rows; i++)
+            z_j[i] = x_j[i] - center[j];
+
+        for (int k = 0; k < j; k++) {
+            double l_jk = L[j + p * k];
+            double* restrict z_k = z + rows * k;
+            #pragma omp simd
+            for (int i = 0; i < rows; i++)
+                z_j[i] -= l_jk * z_k[i];
+        }
+
+        double inv = 1.0 / L[j * (p + 1)];
+        if (j == 0) {
+            #pragma omp simd
+            for (int i = 0; i < rows; i++) {
+                z_j[i] *= inv;
+                d[i] = _POWER2(z_j[i]);
+            }
+        } else {
+            #pragma omp simd
+            for (int i = 0; i < rows; i++) {
+                z_j[i] *= inv;
+                d[i] += _POWER2(z_j[i]);
+            }
+        }
+    }
+}
+
+/******************************************************************************\
+|* sum of squares of the rows of a block of a matrix                          *|
+|*  z       first element of the block, array[ld, p]                          *|
+|*  ld      leading dimension of z                                            *|
+|*  rows    number of rows of the block                                       *|
+|*  p       number of columns                                                 *|
+|*  out     on return: row sums of the squared elements, array[rows]          *|
+\******************************************************************************/
+WBACON_TARGET_CLONES
+void kernel_sumsq_rows(double* restrict z, int ld, int rows, int p,
+    double* restrict out)
+{
+    WBACON_NO_CONTRACT
+    #pragma omp simd
+    for (int i = 0; i < rows; i++)
+        out[i] = _POWER2(z[i]);
+
+    for (int j = 1; j < p; j++) {
+        double* restrict z_j = z + (size_t)ld * j;
+        #pragma omp simd
+        for (int i = 0; i < rows; i++)
+            out[i] += _POWER2(z_j[i]);
+    }
+}
+#undef _POWER2
+
+/******************************************************************************\
+|* variant of the kernels that the dynamic loader selected                    *|
+|* Return value: typedef enum wbacon_simd_type                                *|
+\******************************************************************************/
+wbacon_simd_type kernel_simd(void)
+{
+    #if WBACON_CLONES
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return WBACON_SIMD_AVX512F;
+    if (__builtin_cpu_supports("avx2"))
+        return WBACON_SIMD_AVX2;
+    return WBACON_SIMD_DEFAULT;
+    #else
+    return WBACON_SIMD_NONE;
+    #endif
+}
+
+/******************************************************************************\
+|* variant of the kernels (R entry point)                                     *|
+|*  level   on return: typedef enum wbacon_simd_type                          *|
+\******************************************************************************/
+void wbacon_simd(int *level)
+{
+    *level = (int)kernel_simd();
+}
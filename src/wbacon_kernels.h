@@ -0,0 +1,25 @@
+#include <R.h>
+#include "wbacon_simd.h"
+
+#ifndef _WBACON_KERNELS_H
+#define _WBACON_KERNELS_H
+
+#define WBACON_TILE 256             // rows per tile of the row-wise kernels
+
+// instruction set of the variant of the kernels selected at load time
+typedef enum wbacon_simd_enum {
+    WBACON_SIMD_NONE = -1,          // not multiversioned (see wbacon_simd.h)
+    WBACON_SIMD_DEFAULT = 0,        // baseline of the build (e.g., SSE2)
+    WBACON_SIMD_AVX2,
+    WBACON_SIMD_AVX512F
+} wbacon_simd_type;
+
+// declarations
+void kernel_moments(double* restrict, double* restrict, double* restrict,
+    double* restrict, int, double, double*, double* restrict);
+void kernel_distance_tile(double* restrict, int, int, int, double* restrict,
+    double* restrict, double* restrict, double* restrict);
+void kernel_sumsq_rows(double* restrict, int, int, int, double* restrict);
+wbacon_simd_type kernel_simd(void);
+void wbacon_simd(int*);
+#endif
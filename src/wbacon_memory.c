@@ -0,0 +1,322 @@
+/* Accounting allocator of the engines (wbacon and wbacon_reg)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       Every block carries a header with its size, its purpose and
+               the accounting it is charged to; hence, mem_free needs only
+               the pointer. The bytes are the requested bytes (the header
+               and the overhead of the heap are not counted). The kernels
+               (selection and sorting) allocate their scratch by mem_scratch,
+               which is charged to the accounting of the engine that is
+               currently running on the calling thread (if any; the active
+               accounting is private to the threads of OpenMP). The kernels
+               of an engine allocate outside of parallel regions; an engine
+               that is called from a parallel region (e.g., by
+               wbacon_simulate) is charged to its own accounting.
+
+               R's allocator (Calloc) must not be called by the threads of a
+               parallel region (on failure, it calls error(), which jumps
+               out of the thread). In a parallel region, the blocks are
+               allocated by calloc of the C library, and NULL is returned on
+               failure; the engines return WBACON_ERROR_MEMORY, and the
+               kernels fall back to a method without scratch.
+
+               The large work arrays are allocated by mem_alloc_placed: the
+               pages are not zeroed by the calling thread (Calloc) but by the
+               threads of the loop that works on the array, with the same
+               static partition (first touch); on a NUMA host, a page is
+               placed on the node of the thread that touches it first.
+               Optionally, the arrays are aligned to huge pages and advised
+               for transparent huge pages (madvise, Linux); see
+               wbacon_placement.
+*/
+
+#if !defined(_WIN32)
+    #include <stdlib.h>
+    #include <string.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #define WBACON_PLACED 1
+#else
+    #define WBACON_PLACED 0
+#endif
+#include "wbacon_memory.h"
+
+// header of a block (the union keeps the payload aligned to 16 bytes)
+typedef union mem_header_union {
+    struct {
+        wbacon_memory *mem;
+        void *base;                 // block of mem_alloc_placed (or NULL)
+        double bytes;
+        int purpose;
+    } h;
+    long double align[2];
+} mem_header;
+
+// accounting of the engine that is currently running on the thread (or NULL)
+static wbacon_memory *mem_active = NULL;
+#ifdef _OPENMP
+#pragma omp threadprivate(mem_active)
+#endif
+
+// placement of the large arrays (see wbacon_placement)
+static int mem_first_touch = 1;
+static int mem_huge_pages = 0;
+
+// 1: the calling thread runs in a parallel region (R is not called)
+static inline int mem_in_parallel(void)
+{
+    #ifdef _OPENMP
+    return omp_in_parallel();
+    #else
+    return 0;
+    #endif
+}
+
+// names of the purposes
+const char* const WBACON_MEM_STRINGS[] = {
+    "data",
+    "subset",
+    "work_n",
+    "work_np",
+    "work_pp",
+    "lapack",
+    "kernel"
+};
+
+/******************************************************************************\
+|* begin the accounting (the kernels are charged to 'mem' until mem_end)      *|
+|*  mem     typedef struct wbacon_memory                                      *|
+|*  dry     1: dry run (mem_alloc returns NULL); 0: allocate                  *|
+\******************************************************************************/
+void mem_begin(wbacon_memory *mem, int dry)
+{
+    mem->dry = dry;
+    mem->current = 0.0;
+    mem->peak = 0.0;
+    for (int k = 0; k < WBACON_MEM_COUNT; k++) {
+        mem->used[k] = 0.0;
+        mem->bytes[k] = 0.0;
+    }
+    mem->outer = mem_active;
+    mem_active = mem;
+}
+
+/******************************************************************************\
+|* end the accounting                                                         *|
+|*  mem     typedef struct wbacon_memory                                      *|
+|*  res     NULL or, on return: array[WBACON_MEMORY_LEN]; see wbacon_memory.h *|
+\******************************************************************************/
+void mem_end(wbacon_memory *mem, double *res)
+{
+    mem_active = mem->outer;
+    if (res == NULL)
+        return;
+
+    res[0] = mem->peak;
+    for (int k = 0; k < WBACON_MEM_COUNT; k++)
+        res[1 + k] = mem->bytes[k];
+}
+
+/******************************************************************************\
+|* charge (or discharge) bytes without allocating (e.g., in a dry run)        *|
+\******************************************************************************/
+void mem_reserve(wbacon_memory *mem, double bytes, wbacon_mem_type purpose)
+{
+    if (mem == NULL)
+        return;
+    mem->current += bytes;
+    mem->used[purpose] += bytes;
+    if (mem->current > mem->peak)
+        mem->peak = mem->current;
+    if (mem->used[purpose] > mem->bytes[purpose])
+        mem->bytes[purpose] = mem->used[purpose];
+}
+
+void mem_release(wbacon_memory *mem, double bytes, wbacon_mem_type purpose)
+{
+    if (mem == NULL)
+        return;
+    mem->current -= bytes;
+    mem->used[purpose] -= bytes;
+}
+
+/******************************************************************************\
+|* allocate a zero-initialized array (see R's Calloc)                         *|
+|*  mem      typedef struct wbacon_memory (or NULL: no accounting)            *|
+|*  n        number of elements                                               *|
+|*  size     size of an element                                               *|
+|*  purpose  purpose of the array                                             *|
+|* NOTE: in a dry run, the bytes are charged and NULL is returned. In a       *|
+|*       parallel region, NULL is returned if the allocation fails (see the   *|
+|*       note at the top of the file); otherwise, R signals the error         *|
+\******************************************************************************/
+void* mem_alloc(wbacon_memory *mem, size_t n, size_t size,
+    wbacon_mem_type purpose)
+{
+    double bytes = (double)n * (double)size;
+    if (mem != NULL && mem->dry) {
+        mem_reserve(mem, bytes, purpose);
+        return NULL;
+    }
+
+    mem_header *block;
+    if (mem_in_parallel()) {
+        block = (mem_header*) calloc(sizeof(mem_header) + n * size, 1);
+        if (block == NULL)
+            return NULL;
+        block->h.base = block;          // freed by free()
+    } else {
+        block = (mem_header*) Calloc(sizeof(mem_header) + n * size, char);
+        block->h.base = NULL;
+    }
+    mem_reserve(mem, bytes, purpose);
+    block->h.mem = mem;
+    block->h.bytes = bytes;
+    block->h.purpose = purpose;
+    return (void*)(block + 1);
+}
+
+/******************************************************************************\
+|* allocate a large array (zero-initialized) that is first-touched in         *|
+|* parallel                                                                   *|
+|*  mem      typedef struct wbacon_memory (or NULL: no accounting)            *|
+|*  n        number of elements                                               *|
+|*  size     size of an element                                               *|
+|*  purpose  purpose of the array                                             *|
+|*  unit     number of elements per iteration of the loop that works on the   *|
+|*           array (e.g., a column or a tile of rows)                         *|
+|*  threads  number of threads of the loop (schedule(static))                 *|
+|* NOTE: the elements of the iteration k of the loop are zeroed by the thread *|
+|*       that runs the iteration k of a loop with 'threads' threads and       *|
+|*       schedule(static); arrays smaller than WBACON_MEM_PLACED_MIN and the  *|
+|*       arrays of a parallel region (the loops run on one thread) are        *|
+|*       allocated by mem_alloc                                               *|
+\******************************************************************************/
+void* mem_alloc_placed(wbacon_memory *mem, size_t n, size_t size,
+    wbacon_mem_type purpose, size_t unit, int threads)
+{
+    size_t bytes = n * size;
+    if (!WBACON_PLACED || (mem != NULL && mem->dry) || mem_in_parallel()
+            || bytes < WBACON_MEM_PLACED_MIN
+            || (!mem_first_touch && !mem_huge_pages))
+        return mem_alloc(mem, n, size, purpose);
+
+    #if WBACON_PLACED
+    // the payload starts at an aligned address; the header is in front of it
+    size_t align = (size_t)sysconf(_SC_PAGESIZE);
+    if (mem_huge_pages && align < WBACON_MEM_HUGE_PAGE)
+        align = WBACON_MEM_HUGE_PAGE;
+    size_t total = align + ((bytes + align - 1) / align) * align;
+    void *base = NULL;
+    if (posix_memalign(&base, align, total) != 0)
+        error("Could not allocate %.0f bytes\n", (double)bytes);
+    #ifdef MADV_HUGEPAGE
+    if (mem_huge_pages)
+        madvise(base, total, MADV_HUGEPAGE);
+    #endif
+
+    mem_reserve(mem, (double)bytes, purpose);
+    char* restrict payload = (char*)base + align;
+    mem_header *block = (mem_header*)payload - 1;
+    block->h.mem = mem;
+    block->h.base = base;
+    block->h.bytes = (double)bytes;
+    block->h.purpose = purpose;
+
+    // first touch
+    if (unit < 1)
+        unit = n;
+    int n_units = (int)((n + unit - 1) / unit);
+    if (!mem_first_touch)
+        threads = 1;
+    #pragma omp parallel for if(threads > 1) num_threads(threads) \
+        schedule(static)
+    for (int k = 0; k < n_units; k++) {
+        size_t lo = (size_t)k * unit * size;
+        size_t len = lo + unit * size < bytes ? unit * size : bytes - lo;
+        memset(payload + lo, 0, len);
+    }
+    return (void*)payload;
+    #else
+    return NULL;
+    #endif
+}
+
+/******************************************************************************\
+|* allocate the scratch of a kernel (charged to the running engine, if any)   *|
+|*  n        number of elements                                               *|
+|*  size     size of an element                                               *|
+|* NOTE: in a parallel region, NULL is returned if the allocation fails; the  *|
+|*       kernel then falls back to a method without scratch                   *|
+\******************************************************************************/
+void* mem_scratch(size_t n, size_t size)
+{
+    wbacon_memory *mem = mem_active != NULL && !mem_active->dry ? mem_active
+        : NULL;
+    return mem_alloc(mem, n, size, WBACON_MEM_KERNEL);
+}
+
+/******************************************************************************\
+|* free an array allocated by mem_alloc or mem_scratch (NULL is ignored)      *|
+\******************************************************************************/
+void mem_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    mem_header *block = (mem_header*)ptr - 1;
+    mem_release(block->h.mem, block->h.bytes,
+        (wbacon_mem_type)block->h.purpose);
+    if (block->h.base != NULL)
+        free(block->h.base);
+    else
+        Free(block);
+}
+
+// obtain the name of a purpose
+const char* mem_purpose_name(wbacon_mem_type purpose)
+{
+    if (purpose >= WBACON_MEM_COUNT)
+        return NULL;
+    else
+        return WBACON_MEM_STRINGS[purpose];
+}
+
+/******************************************************************************\
+|* placement of the large arrays (R entry point)                              *|
+|*  first_touch 1: first touch in parallel; 0: zeroed by the calling thread;  *|
+|*              < 0: not changed; on return: the setting                      *|
+|*  huge_pages  1: aligned to huge pages and advised (madvise); 0: not;       *|
+|*              < 0: not changed; on return: the setting (0 if huge pages     *|
+|*              are not supported)                                            *|
+\******************************************************************************/
+void wbacon_placement(int *first_touch, int *huge_pages)
+{
+    if (*first_touch >= 0)
+        mem_first_touch = *first_touch > 0;
+    if (*huge_pages >= 0)
+        mem_huge_pages = *huge_pages > 0;
+
+    #if !WBACON_PLACED || !defined(MADV_HUGEPAGE)
+    mem_huge_pages = 0;
+    #endif
+    #if !WBACON_PLACED
+    mem_first_touch = 0;
+    #endif
+    *first_touch = mem_first_touch;
+    *huge_pages = mem_huge_pages;
+}
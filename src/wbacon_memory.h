@@ -0,0 +1,56 @@
+#include <R.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WBACON_MEMORY_H
+#define _WBACON_MEMORY_H
+
+// purposes of the allocations of the engines (wbacon and wbacon_reg)
+typedef enum wbacon_mem_enum {
+    WBACON_MEM_DATA = 0,            // sqrt(w), weighted x and y
+    WBACON_MEM_SUBSET,              // subsets, selection weights, indices
+    WBACON_MEM_WORK_N,              // work arrays of size n and 2n
+    WBACON_MEM_WORK_NP,             // work arrays of size n * p
+    WBACON_MEM_WORK_PP,             // Cholesky factor, arrays of size p and p*p
+    WBACON_MEM_LAPACK,              // work array of LAPACK:dgels
+    WBACON_MEM_KERNEL,              // scratch of the selection/sort kernels
+    WBACON_MEM_COUNT                // [not an actual purpose]
+} wbacon_mem_type;
+
+// the accounting is stored in an array[WBACON_MEMORY_LEN] of the caller:
+//   [0]                            peak working set (bytes)
+//   [1, WBACON_MEMORY_LEN)         peak per purpose (bytes)
+#define WBACON_MEMORY_LEN (1 + WBACON_MEM_COUNT)
+
+// placement of large arrays (see mem_alloc_placed): arrays of at least
+// WBACON_MEM_PLACED_MIN bytes are aligned to pages and first-touched by the
+// threads of the loops that use them (NUMA); with huge pages, the arrays are
+// aligned to WBACON_MEM_HUGE_PAGE bytes and advised to the kernel (Linux)
+#define WBACON_MEM_PLACED_MIN 2097152
+#define WBACON_MEM_HUGE_PAGE 2097152
+
+// accounting of the allocations (dry run: nothing is allocated)
+typedef struct wbacon_memory_struct {
+    int dry;                            // 1: dry run; 0: allocate
+    double current;                     // bytes in use
+    double peak;                        // peak of 'current'
+    double used[WBACON_MEM_COUNT];      // bytes in use per purpose
+    double bytes[WBACON_MEM_COUNT];     // peak per purpose
+    struct wbacon_memory_struct *outer; // accounting active before mem_begin
+} wbacon_memory;
+
+// declarations
+void mem_begin(wbacon_memory*, int);
+void mem_end(wbacon_memory*, double*);
+void* mem_alloc(wbacon_memory*, size_t, size_t, wbacon_mem_type);
+void* mem_alloc_placed(wbacon_memory*, size_t, size_t, wbacon_mem_type,
+    size_t, int);
+void* mem_scratch(size_t, size_t);
+void mem_free(void*);
+void mem_reserve(wbacon_memory*, double, wbacon_mem_type);
+void mem_release(wbacon_memory*, double, wbacon_mem_type);
+const char* mem_purpose_name(wbacon_mem_type);
+void wbacon_placement(int*, int*);
+#endif
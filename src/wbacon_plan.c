@@ -0,0 +1,517 @@
+/* Execution planner of wbacon: cost model and choice of kernels and threads
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The cost of a kernel is modeled by the number of elements of
+               its streaming and indexed loops, its flops (BLAS-3 or fused),
+               and its selection or median work; each item is multiplied by
+               a coefficient (seconds per unit). A parallel loop with u
+               independent parts takes time / min(threads, u) plus the cost
+               of fork and join. The coefficients are the defaults below
+               until plan_calibrate measures them on the host. The kernels
+               are chosen once per call (distances, threads) and the scatter
+               kernel once per iteration (it depends on the subset size and
+               on the number of rows that changed membership). In a step,
+               either the loops of the package or BLAS run in parallel (see
+               wbacon_threads.c); if the BLAS library is not controlled, its
+               time is modeled as if it ran on one thread.
+
+               Deterministic plan: the kernels and the thresholds are chosen
+               by the cost model on one thread; hence, they do not depend on
+               the number of threads. The loops that run in parallel split
+               the work into parts whose results do not depend on the
+               threads (columns, tiles, and blocks of WBACON_ROW_BLOCK rows
+               whose scatter matrices are summed up in a fixed order), and
+               BLAS runs on one thread.
+*/
+
+#include "wbacon_plan.h"
+
+// default coefficients of the cost model (one core of a x86-64 host with the
+// reference BLAS); the coefficients of wbacon_calibrate are passed with every
+// call (see plan_wbacon)
+static const wbacon_cost plan_cost = {
+    1.0e-9,         // stream
+    2.0e-9,         // gather
+    5.0e-10,        // blas3
+    4.0e-10,        // fused
+    1.0e-8,         // select
+    3.0e-8,         // median
+    5.0e-6          // fork
+};
+
+// local declarations
+static double par_time(wbacon_cost*, double, double, int);
+static int par_threads(wbacon_cost*, double, double, int);
+static double scatter_time(wbacon_plan*, wbacon_kernel_type, double, double);
+static double distance_time(wbacon_plan*, wbacon_kernel_type, int, int);
+static int compact_threshold(wbacon_plan*);
+static double lcg_uniform(unsigned int*);
+
+/******************************************************************************\
+|* time of a parallel loop                                                    *|
+|*  cost     typedef struct wbacon_cost                                       *|
+|*  serial   time of the loop on one thread (seconds)                         *|
+|*  units    number of independent parts of the loop (e.g., columns)          *|
+|*  threads  number of threads                                                *|
+\******************************************************************************/
+static double par_time(wbacon_cost *cost, double serial, double units,
+    int threads)
+{
+    if (threads <= 1)
+        return serial;
+    double speedup = fmin((double)threads, fmax(units, 1.0));
+    return serial / speedup + cost->fork;
+}
+
+// number of threads for a loop: all threads if it pays off; otherwise, 1
+static int par_threads(wbacon_cost *cost, double serial, double units,
+    int threads)
+{
+    return par_time(cost, serial, units, threads) < serial ? threads : 1;
+}
+
+/******************************************************************************\
+|* time of the center and scatter matrix                                      *|
+|*  plan     typedef struct wbacon_plan                                       *|
+|*  kernel   kernel of the scatter matrix                                     *|
+|*  m        size of the subset                                               *|
+|*  delta    number of rows that changed membership (incremental update)      *|
+\******************************************************************************/
+static double scatter_time(wbacon_plan *plan, wbacon_kernel_type kernel,
+    double m, double delta)
+{
+    wbacon_cost *c = &plan->cost;
+    double n = (double)plan->n, p = (double)plan->p;
+    int threads = plan->threads[WBACON_STEP_SCATTER];
+    int blas = plan->blas[WBACON_STEP_SCATTER];
+    // deterministic plan: dsyrk by blocks of rows on the threads of the loops
+    int det = plan->mode == WBACON_PLAN_DETERMINISTIC;
+    double blocks = det ? n / (double)WBACON_ROW_BLOCK : p;
+    blas = det ? threads : blas;
+
+    switch (kernel) {
+    case WBACON_KERNEL_MASKED:
+        // sum of weights; center and centering (by columns); dsyrk
+        return n * c->stream + par_time(c, 2.0 * n * p * c->stream, p,
+            threads) + par_time(c, n * p * (p + 1.0) * c->blas3, blocks,
+            blas);
+    case WBACON_KERNEL_COMPACTED:
+        // index of the subset; center and centering (by columns); dsyrk
+        return n * c->stream + m * c->gather + par_time(c, 2.0 * m * p
+            * c->gather, p, threads) + par_time(c, m * p * (p + 1.0)
+            * c->blas3, det ? m / (double)WBACON_ROW_BLOCK : p, blas);
+    case WBACON_KERNEL_INCREMENTAL:
+        // gather the changed rows; dsyrk; moments => center and scatter
+        return 2.0 * delta * p * c->gather + par_time(c, delta * p * (p + 1.0)
+            * c->blas3, p, blas) + 2.0 * p * p * c->stream;
+    default:
+        return 0.0;
+    }
+}
+
+/******************************************************************************\
+|* time of the Mahalanobis distances                                          *|
+|*  plan     typedef struct wbacon_plan                                       *|
+|*  kernel   kernel of the distances                                          *|
+|*  threads  number of threads of the loops                                   *|
+|*  blas     number of threads of BLAS                                        *|
+\******************************************************************************/
+static double distance_time(wbacon_plan *plan, wbacon_kernel_type kernel,
+    int threads, int blas)
+{
+    wbacon_cost *c = &plan->cost;
+    double n = (double)plan->n, p = (double)plan->p;
+
+    if (kernel == WBACON_KERNEL_FUSED)
+        return par_time(c, n * p * (p + 1.0) * c->fused + n * p * c->stream,
+            n / (double)WBACON_TILE, threads);
+    // centering (by columns); dtrsm; row sums
+    return par_time(c, n * p * c->stream, p, threads) + par_time(c, n * p * p
+        * c->blas3, n / (double)WBACON_TILE, blas) + n * p * c->stream;
+}
+
+// largest subset size for which the compacted kernel is faster than the
+// masked kernel (the time of the compacted kernel increases in m; bisection)
+static int compact_threshold(wbacon_plan *plan)
+{
+    int n = plan->n;
+    double t_masked = scatter_time(plan, WBACON_KERNEL_MASKED, (double)n, 0.0);
+    int lo = -1, hi = n, mid;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (scatter_time(plan, WBACON_KERNEL_COMPACTED, (double)mid, 0.0)
+                < t_masked)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/******************************************************************************\
+|* plan of wbacon                                                             *|
+|*  plan      on return: typedef struct wbacon_plan                           *|
+|*  n, p      dimensions                                                      *|
+|*  collect   parameter to specify the size of the intial subset              *|
+|*  version2  1: 'Version 2' init. of Billor et al. (2000); 0: 'Version 1'    *|
+|*  cached    1: the sorted-order cache is used; 0: not used                  *|
+|*  n_threads max. number of threads                                          *|
+|*  mode      WBACON_PLAN_FIXED, WBACON_PLAN_AUTO, or                         *|
+|*            WBACON_PLAN_DETERMINISTIC                                       *|
+|*  cost      coefficients of the cost model, array[WBACON_COST_LEN] (see     *|
+|*            wbacon_calibrate); NULL or NaN: the defaults                    *|
+\******************************************************************************/
+void plan_wbacon(wbacon_plan *plan, int n, int p, int collect, int version2,
+    int cached, int n_threads, int mode, const double *cost)
+{
+    wbacon_cost *c = &plan->cost;
+    double dn = (double)n, dp = (double)p;
+    // threads of BLAS if it runs serially (0: BLAS is not controlled)
+    int blas_serial = blas_detect() != WBACON_BLAS_UNKNOWN;
+
+    plan->mode = mode;
+    plan->n = n;
+    plan->p = p;
+    plan->n_threads = n_threads;
+    plan->cost = plan_cost;
+    if (cost != NULL && !ISNAN(cost[0])) {
+        c->stream = cost[0];
+        c->gather = cost[1];
+        c->blas3 = cost[2];
+        c->fused = cost[3];
+        c->select = cost[4];
+        c->median = cost[5];
+        c->fork = cost[6];
+    }
+
+    // kernels of the location and the initial subset (they are not planned;
+    // the kernels determine their threads; see the OMP_MIN_SIZE's)
+    plan->kernel[WBACON_STEP_LOCATION] = version2 ? (cached ?
+        WBACON_KERNEL_MEDIAN_CACHED : WBACON_KERNEL_MEDIAN)
+        : WBACON_KERNEL_MAHALANOBIS;
+    plan->kernel[WBACON_STEP_SUBSET] = WBACON_KERNEL_PSORT;
+    int m = (int)fmin((double)collect * dp, dn * 0.5);
+    plan->threads[WBACON_STEP_SUBSET] = m > PSORT_OMP_MIN_SIZE
+        || n > RADIX_OMP_MIN_SIZE ? n_threads : 1;
+
+    if (mode == WBACON_PLAN_FIXED) {
+        // BLAS runs in parallel if the loops do not
+        int threads = n > OMP_MIN_SIZE ? n_threads : 1;
+        int blas = blas_serial ? (threads > 1 ? 1 : n_threads) : 0;
+        plan->threads[WBACON_STEP_SCATTER] = threads;
+        plan->threads[WBACON_STEP_DISTANCE] = threads;
+        plan->blas[WBACON_STEP_SCATTER] = blas;
+        plan->blas[WBACON_STEP_DISTANCE] = blas;
+        plan->kernel[WBACON_STEP_SCATTER] = WBACON_KERNEL_MASKED;
+        plan->kernel[WBACON_STEP_DISTANCE] = WBACON_KERNEL_BLAS3;
+        plan->compact_max = -1;
+        plan->delta_max = -1;
+    } else if (mode == WBACON_PLAN_DETERMINISTIC) {
+        // the thresholds are modeled on one thread; the scatter matrix is
+        // computed by blocks of rows and the distances by the fused kernel
+        // (tiles); BLAS runs on one thread (no incremental update: the
+        // moments would be summed up in the order of the iterations)
+        plan->threads[WBACON_STEP_SCATTER] = 1;
+        plan->blas[WBACON_STEP_SCATTER] = blas_serial;
+        plan->compact_max = compact_threshold(plan);
+        plan->delta_max = -1;
+        plan->kernel[WBACON_STEP_SCATTER] = plan->compact_max >= n
+            ? WBACON_KERNEL_COMPACTED : WBACON_KERNEL_MASKED;
+        plan->threads[WBACON_STEP_SCATTER] = par_threads(c, 2.0 * dn * dp
+            * c->stream + dn * dp * (dp + 1.0) * c->blas3,
+            dn / (double)WBACON_ROW_BLOCK, n_threads);
+        plan->kernel[WBACON_STEP_DISTANCE] = WBACON_KERNEL_FUSED;
+        plan->threads[WBACON_STEP_DISTANCE] = par_threads(c, dn * dp * (dp
+            + 1.0) * c->fused + dn * dp * c->stream, dn / (double)WBACON_TILE,
+            n_threads);
+        plan->blas[WBACON_STEP_DISTANCE] = blas_serial;
+    } else {
+        // center and scatter: the loops over the columns or dsyrk run in
+        // parallel (whichever is faster)
+        double t_loop = 2.0 * dn * dp * c->stream;
+        double t_blas = dn * dp * (dp + 1.0) * c->blas3;
+        int t = par_threads(c, t_loop, dp, n_threads);
+        int t_dsyrk = blas_serial ? par_threads(c, t_blas, dp, n_threads) : 0;
+        plan->threads[WBACON_STEP_SCATTER] = t;
+        plan->blas[WBACON_STEP_SCATTER] = blas_serial;
+        if (t_dsyrk > 1 && t_loop + par_time(c, t_blas, dp, t_dsyrk)
+                < par_time(c, t_loop, dp, t) + t_blas) {
+            plan->threads[WBACON_STEP_SCATTER] = 1;
+            plan->blas[WBACON_STEP_SCATTER] = t_dsyrk;
+        }
+
+        // distances: the fastest of the fused kernel, the BLAS-3 kernel with
+        // parallel loops, and the BLAS-3 kernel with a parallel dtrsm
+        int t_fused = par_threads(c, dn * dp * (dp + 1.0) * c->fused
+            + dn * dp * c->stream, dn / (double)WBACON_TILE, n_threads);
+        int t_blas3 = par_threads(c, dn * dp * c->stream, dp, n_threads);
+        int t_dtrsm = blas_serial ? par_threads(c, dn * dp * dp * c->blas3,
+            dn / (double)WBACON_TILE, n_threads) : 0;
+        double time_fused = distance_time(plan, WBACON_KERNEL_FUSED, t_fused,
+            blas_serial);
+        double time_blas3 = distance_time(plan, WBACON_KERNEL_BLAS3, t_blas3,
+            blas_serial);
+        double time_dtrsm = t_dtrsm > 1 ? distance_time(plan,
+            WBACON_KERNEL_BLAS3, 1, t_dtrsm) : DBL_MAX;
+        if (time_fused < fmin(time_blas3, time_dtrsm)) {
+            plan->kernel[WBACON_STEP_DISTANCE] = WBACON_KERNEL_FUSED;
+            plan->threads[WBACON_STEP_DISTANCE] = t_fused;
+            plan->blas[WBACON_STEP_DISTANCE] = blas_serial;
+        } else if (time_blas3 <= time_dtrsm) {
+            plan->kernel[WBACON_STEP_DISTANCE] = WBACON_KERNEL_BLAS3;
+            plan->threads[WBACON_STEP_DISTANCE] = t_blas3;
+            plan->blas[WBACON_STEP_DISTANCE] = blas_serial;
+        } else {
+            plan->kernel[WBACON_STEP_DISTANCE] = WBACON_KERNEL_BLAS3;
+            plan->threads[WBACON_STEP_DISTANCE] = 1;
+            plan->blas[WBACON_STEP_DISTANCE] = t_dtrsm;
+        }
+
+        // compacted if m <= compact_max
+        plan->compact_max = compact_threshold(plan);
+
+        // incremental if at most delta_max rows changed (at m = n)
+        double t_full = fmin(scatter_time(plan, WBACON_KERNEL_MASKED, dn, 0.0),
+            scatter_time(plan, WBACON_KERNEL_COMPACTED, dn, 0.0));
+        int lo = 0, hi = (int)(WBACON_DELTA_FRACTION * dn) + 1, mid;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (scatter_time(plan, WBACON_KERNEL_INCREMENTAL, dn, (double)mid)
+                    < t_full)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        plan->delta_max = lo;
+        plan->kernel[WBACON_STEP_SCATTER] = plan->compact_max >= n
+            ? WBACON_KERNEL_COMPACTED : WBACON_KERNEL_MASKED;
+    }
+
+    // estimated time per call
+    double t_scatter = scatter_time(plan, plan->kernel[WBACON_STEP_SCATTER],
+        dn, 0.0);
+    double t_dist = distance_time(plan, plan->kernel[WBACON_STEP_DISTANCE],
+        plan->threads[WBACON_STEP_DISTANCE], plan->blas[WBACON_STEP_DISTANCE]);
+    switch (plan->kernel[WBACON_STEP_LOCATION]) {
+    case WBACON_KERNEL_MEDIAN:
+        plan->time[WBACON_STEP_LOCATION] = dp * dn * c->median
+            + dn * dp * c->stream;
+        break;
+    case WBACON_KERNEL_MEDIAN_CACHED:
+        plan->time[WBACON_STEP_LOCATION] = 3.0 * dp * dn * c->stream;
+        break;
+    default:
+        plan->time[WBACON_STEP_LOCATION] = scatter_time(plan,
+            WBACON_KERNEL_MASKED, dn, 0.0) + t_dist;
+    }
+    plan->threads[WBACON_STEP_LOCATION] = version2 ? (n
+        > WQUANTILE_OMP_MIN_SIZE && !cached ? n_threads : 1)
+        : plan->threads[WBACON_STEP_SCATTER];
+    // the initial subset calls dsyrk and dpotrf as the scatter step; the
+    // weighted median (V2) does not call BLAS
+    plan->blas[WBACON_STEP_LOCATION] = version2 ? blas_serial
+        : plan->blas[WBACON_STEP_SCATTER];
+    plan->blas[WBACON_STEP_SUBSET] = plan->blas[WBACON_STEP_SCATTER];
+    plan->time[WBACON_STEP_SUBSET] = dn * c->select + scatter_time(plan,
+        WBACON_KERNEL_MASKED, dn, 0.0) + dp * dp * dp / 3.0 * c->blas3;
+    plan->time[WBACON_STEP_SCATTER] = t_scatter;
+    plan->time[WBACON_STEP_DISTANCE] = t_dist;
+}
+
+/******************************************************************************\
+|* kernel of the center and scatter matrix in an iteration                    *|
+|*  plan     typedef struct wbacon_plan                                       *|
+|*  m        size of the subset                                               *|
+|*  delta    number of rows that changed membership since the last iteration *|
+|*  valid    1: the moments of the last iteration are available; 0: not      *|
+\******************************************************************************/
+wbacon_kernel_type plan_scatter(wbacon_plan *plan, int m, int delta, int valid)
+{
+    if (plan->mode == WBACON_PLAN_FIXED)
+        return WBACON_KERNEL_MASKED;
+    if (valid && delta == 0)
+        return WBACON_KERNEL_REUSE;
+
+    wbacon_kernel_type full = m <= plan->compact_max ? WBACON_KERNEL_COMPACTED
+        : WBACON_KERNEL_MASKED;
+    if (plan->mode == WBACON_PLAN_DETERMINISTIC)
+        return full;
+    if (valid && (double)delta <= WBACON_DELTA_FRACTION * (double)m
+            && scatter_time(plan, WBACON_KERNEL_INCREMENTAL, (double)m,
+            (double)delta) < scatter_time(plan, full, (double)m, 0.0))
+        return WBACON_KERNEL_INCREMENTAL;
+    return full;
+}
+
+/******************************************************************************\
+|* explain a plan (see wbacon_plan.h for the layout of the arrays)            *|
+\******************************************************************************/
+void plan_explain(wbacon_plan *plan, int *kernel, int *threads, int *blas,
+    double *time, int *threshold)
+{
+    for (int k = 0; k < WBACON_STEP_COUNT; k++) {
+        kernel[k] = plan->kernel[k];
+        threads[k] = plan->threads[k];
+        blas[k] = plan->blas[k];
+        time[k] = plan->time[k];
+    }
+    threshold[0] = plan->compact_max;
+    threshold[1] = plan->delta_max;
+}
+
+// uniform random number (linear congruential generator; R's RNG is not used
+// because calibration must not change the state of the RNG of the user)
+static double lcg_uniform(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (double)(*state >> 8) / 16777216.0;
+}
+
+/******************************************************************************\
+|* measure the coefficients of the cost model on the host                     *|
+|*  cost    on return: typedef struct wbacon_cost                             *|
+|* NOTE: every kernel is timed 3 times; the fastest run counts                *|
+\******************************************************************************/
+void plan_calibrate(wbacon_cost *cost)
+{
+    const int n = 1 << 20, n_blas = 4096, p_blas = 32, n_reps = 3;
+    int n_select = 1 << 18;
+    unsigned int state = 1;
+    double t0, t, best[WBACON_COST_LEN];
+    for (int k = 0; k < WBACON_COST_LEN; k++)
+        best[k] = DBL_MAX;
+
+    double *x = (double*) Calloc(n, double);
+    double *y = (double*) Calloc(n, double);
+    double *w = (double*) Calloc(2 * n, double);
+    int *index = (int*) Calloc(n, int);
+    for (int i = 0; i < n; i++) {
+        x[i] = lcg_uniform(&state);
+        w[i] = 1.0 + lcg_uniform(&state);
+    }
+    int m = 0;
+    for (int i = 0; i < n; i++)
+        if (x[i] < 0.5)
+            index[m++] = i;
+
+    for (int r = 0; r < n_reps; r++) {
+        // streaming loop (see the centering in mean_scatter_w)
+        t0 = trace_clock();
+        for (int i = 0; i < n; i++)
+            y[i] = (x[i] - 0.5) * w[i];
+        t = (trace_clock() - t0) / (double)n;
+        best[0] = fmin(best[0], t);
+
+        // indexed loop (see the compacted scatter)
+        t0 = trace_clock();
+        for (int k = 0; k < m; k++)
+            y[k] = (x[index[k]] - 0.5) * w[index[k]];
+        t = (trace_clock() - t0) / (double)m;
+        best[1] = fmin(best[1], t);
+
+        // BLAS-3: dsyrk (flops: n * p * (p + 1))
+        const double d_one = 1.0, d_zero = 0.0;
+        t0 = trace_clock();
+        F77_CALL(dsyrk)("L", "T", &p_blas, &n_blas, &d_one, x, &n_blas,
+            &d_zero, y, &p_blas);
+        t = (trace_clock() - t0) / ((double)n_blas * p_blas * (p_blas + 1));
+        best[2] = fmin(best[2], t);
+
+        // fused distances: axpy on tiles of rows (2 flops per element)
+        t0 = trace_clock();
+        for (int i0 = 0; i0 < n; i0 += WBACON_TILE) {
+            double *z = x + i0, *u = y + i0;
+            double l = w[i0];
+            #pragma omp simd
+            for (int i = 0; i < WBACON_TILE; i++)
+                u[i] -= l * z[i];
+        }
+        t = (trace_clock() - t0) / (2.0 * (double)n);
+        best[3] = fmin(best[3], t);
+
+        // partial sort (see initial_subset)
+        Memcpy(y, x, n_select);
+        t0 = trace_clock();
+        psort_array(y, index, n_select, 1000, w);
+        t = (trace_clock() - t0) / (double)n_select;
+        best[4] = fmin(best[4], t);
+
+        // weighted median (see initial_location)
+        double d_half = 0.5, med;
+        Memcpy(y, x, n_select);
+        t0 = trace_clock();
+        wquantile_noalloc(y, w + n, w, &n_select, &d_half, &med);
+        t = (trace_clock() - t0) / (double)n_select;
+        best[5] = fmin(best[5], t);
+
+        // fork and join of a parallel region
+        t = 0.0;
+        #ifdef _OPENMP
+        t0 = trace_clock();
+        for (int k = 0; k < 100; k++) {
+            #pragma omp parallel
+            {
+                y[omp_get_thread_num()] += 1.0;
+            }
+        }
+        t = (trace_clock() - t0) / 100.0;
+        #endif
+        best[6] = fmin(best[6], t);
+
+        // restore the weights and the index (overwritten by the kernels)
+        for (int i = 0; i < 2 * n; i++)
+            w[i] = 1.0 + x[i % n];
+        m = 0;
+        for (int i = 0; i < n; i++)
+            if (x[i] < 0.5)
+                index[m++] = i;
+    }
+
+    cost->stream = best[0];
+    cost->gather = best[1];
+    cost->blas3 = best[2];
+    cost->fused = best[3];
+    cost->select = best[4];
+    cost->median = best[5];
+    cost->fork = best[6];
+
+    Free(x); Free(y); Free(w); Free(index);
+}
+
+/******************************************************************************\
+|* coefficients of the cost model (R entry point)                             *|
+|*  measure 1: the coefficients are measured on the host (plan_calibrate);    *|
+|*          0: the defaults                                                   *|
+|*  cost    on return: the coefficients, array[WBACON_COST_LEN]               *|
+|* NOTE: no state is kept; the caller passes the coefficients to the engines  *|
+|*       with every call (see plan_wbacon)                                    *|
+\******************************************************************************/
+void wbacon_calibrate(int *measure, double *cost)
+{
+    wbacon_cost c = plan_cost;
+    if (*measure)
+        plan_calibrate(&c);
+
+    cost[0] = c.stream;
+    cost[1] = c.gather;
+    cost[2] = c.blas3;
+    cost[3] = c.fused;
+    cost[4] = c.select;
+    cost[5] = c.median;
+    cost[6] = c.fork;
+}
@@ -0,0 +1,104 @@
+#include <R.h>
+#include <R_ext/BLAS.h>
+#include "wbacon_trace.h"
+#include "partial_sort.h"
+#include "wquantile.h"
+#include "wbacon_threads.h"
+#include "wbacon_kernels.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+#define OMP_MIN_SIZE 100000         // fixed plan: OpenMP if n > OMP_MIN_SIZE
+
+#ifndef _WBACON_PLAN_H
+#define _WBACON_PLAN_H
+
+#define WBACON_DELTA_FRACTION 0.25  // incremental update of the moments only
+                                    // if the changed rows are <= 25% of m
+#define WBACON_ROW_BLOCK 16384      // deterministic plan: rows per block of
+                                    // the scatter matrix (multiple of
+                                    // WBACON_TILE)
+
+// modes of the planner
+typedef enum wbacon_plan_mode_enum {
+    WBACON_PLAN_FIXED = 0,          // masked, full recompute, BLAS-3, and
+                                    // OpenMP if n > OMP_MIN_SIZE (as in 0.5-1)
+    WBACON_PLAN_AUTO,               // kernels and threads by the cost model
+    WBACON_PLAN_DETERMINISTIC       // results do not depend on the number of
+                                    //   threads (see plan_wbacon)
+} wbacon_plan_mode;
+
+// steps of wbacon that are planned
+typedef enum wbacon_step_enum {
+    WBACON_STEP_LOCATION = 0,       // initial location (once)
+    WBACON_STEP_SUBSET,             // initial subset (once)
+    WBACON_STEP_SCATTER,            // center and scatter (per iteration)
+    WBACON_STEP_DISTANCE,           // Mahalanobis distances (per iteration)
+    WBACON_STEP_COUNT               // [not an actual step]
+} wbacon_step_type;
+
+// kernels of the steps
+typedef enum wbacon_kernel_enum {
+    WBACON_KERNEL_MEDIAN = 0,       // location: weighted median (V2)
+    WBACON_KERNEL_MEDIAN_CACHED,    // location: median by the sorted-order
+                                    //   cache (V2)
+    WBACON_KERNEL_MAHALANOBIS,      // location: mean and Mahalanobis (V1)
+    WBACON_KERNEL_PSORT,            // subset: partial sort of the distances
+    WBACON_KERNEL_MASKED,           // scatter: all n rows; the rows not in the
+                                    //   subset are multiplied by 0
+    WBACON_KERNEL_COMPACTED,        // scatter: the m rows of the subset are
+                                    //   gathered
+    WBACON_KERNEL_INCREMENTAL,      // scatter: the moments are updated by the
+                                    //   rows that changed membership
+    WBACON_KERNEL_REUSE,            // scatter: the subset did not change; the
+                                    //   estimates are reused
+    WBACON_KERNEL_BLAS3,            // distances: centering, dtrsm, row sums
+    WBACON_KERNEL_FUSED,            // distances: centering, substitution, and
+                                    //   row sums fused by tiles of rows
+    WBACON_KERNEL_COUNT             // [not an actual kernel]
+} wbacon_kernel_type;
+
+// coefficients of the cost model (seconds); see plan_calibrate
+typedef struct wbacon_cost_struct {
+    double stream;                  // per element of a streaming loop
+    double gather;                  // per element of an indexed loop
+    double blas3;                   // per flop of BLAS-3 (dsyrk, dtrsm)
+    double fused;                   // per flop of the fused distances
+    double select;                  // per element of the partial sort
+    double median;                  // per element of the weighted median
+    double fork;                    // fork and join of a parallel region
+} wbacon_cost;
+#define WBACON_COST_LEN 7
+
+// execution plan of wbacon
+typedef struct wbacon_plan_struct {
+    int mode;                       // see wbacon_plan_mode
+    int n;
+    int p;
+    int n_threads;                  // max. number of threads
+    int kernel[WBACON_STEP_COUNT];  // kernel per step
+    int threads[WBACON_STEP_COUNT]; // threads of the loops per step
+    int blas[WBACON_STEP_COUNT];    // threads of BLAS per step (0: BLAS is
+                                    //   not controlled; see wbacon_threads.h)
+    double time[WBACON_STEP_COUNT]; // estimated time per call (seconds)
+    int compact_max;                // compact the subset if m <= compact_max
+    int delta_max;                  // incremental update if at most delta_max
+                                    // rows changed (at m = n)
+    wbacon_cost cost;
+} wbacon_plan;
+
+// the explain of a plan is stored in arrays of the caller:
+//   kernel, threads    int array[WBACON_STEP_COUNT]
+//   blas               int array[WBACON_STEP_COUNT]
+//   time               double array[WBACON_STEP_COUNT]
+//   threshold          int array[2]: compact_max, delta_max
+
+// declarations
+void plan_wbacon(wbacon_plan*, int, int, int, int, int, int, int,
+    const double*);
+wbacon_kernel_type plan_scatter(wbacon_plan*, int, int, int);
+void plan_explain(wbacon_plan*, int*, int*, int*, double*, int*);
+void plan_calibrate(wbacon_cost*);
+void wbacon_calibrate(int*, double*);
+#endif
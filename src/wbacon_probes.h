@@ -0,0 +1,37 @@
+#ifndef _WBACON_PROBES_H
+#define _WBACON_PROBES_H
+
+// static tracepoints (USDT, provider 'wbacon') at the phase boundaries of the
+// engines for bpftrace, perf, or SystemTap; e.g.,
+//   bpftrace -e 'usdt:./wbacon.so:wbacon:iteration__end { @[arg2] = count(); }'
+// A probe is a single nop in the code; its location and its arguments are
+// recorded in the ELF note section .note.stapsdt. The probes are compiled in
+// if <sys/sdt.h> (systemtap-sdt-dev) is found; -DWBACON_USDT=0 removes them.
+//
+// every probe carries 4 arguments (int): n, p, m (subset size, -1 if not
+// defined at the probe), and the iteration (0 if not defined); the probes are
+//   wbacon:       initial_location__begin/__end, initial_subset__begin/__end,
+//                 iteration__begin/__end
+//   wbacon_reg:   algorithm4_step__begin/__end, downdate__fail (the Cholesky
+//                 downdate failed; the subset is enlarged),
+//                 algorithm5_iteration__begin/__end, fitwls__begin/__end (the
+//                 4th argument of fitwls__end is the return value of fitwls)
+#ifndef WBACON_USDT
+    #if defined(__has_include)
+        #if __has_include(<sys/sdt.h>)
+            #define WBACON_USDT 1
+        #endif
+    #endif
+#endif
+#ifndef WBACON_USDT
+    #define WBACON_USDT 0
+#endif
+
+#if WBACON_USDT
+    #include <sys/sdt.h>
+    #define WBACON_PROBE(_name, _n, _p, _m, _iter) \
+        DTRACE_PROBE4(wbacon, _name, _n, _p, _m, _iter)
+#else
+    #define WBACON_PROBE(_name, _n, _p, _m, _iter) do {} while (0)
+#endif
+#endif
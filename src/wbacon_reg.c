@@ -26,29 +26,43 @@
 
 #define _POWER2(_x) ((_x) * (_x))
 #define _debug_mode 0               // 0: default; 1: debug mode
+#define _HINT_WIDTH 32              // initial half-width of the band
 
 #if _debug_mode
 #include "utils.h"
 #endif
 
+// band of values around the previous threshold of select_subset (warm start)
+typedef struct subset_hint_struct {
+    int valid;          // 1: the band is defined; 0: cold start
+    int enabled;        // 0: cold starts only (plan "fixed")
+    int width;          // half-width of the band (number of ranks)
+    double lo;          // lower bound of the band
+    double hi;          // upper bound of the band
+    int *band;          // indices of the elements in the band, array[n]
+} subset_hint;
+
 // structure of working arrays
 typedef struct workarray_struct {
     int lwork;
     int *iarray;
+    int *subset1;
     double *work_p;
     double *work_n;
     double *work_np;
     double *work_pp;
     double *dgels_work;
+    subset_hint hint;
 } workarray;
 
 // declarations of local function
 static wbacon_error_type initial_reg(regdata*, workarray*, estimate*,
     int* restrict, int*, int*);
+static int fitwls_subset(regdata*, workarray*, estimate*, int* restrict, int);
 static wbacon_error_type algorithm_4(regdata*, workarray*, estimate*,
-    int* restrict, int* restrict, int*, int*, int*);
+    int* restrict, int* restrict, int*, int*, int*, int);
 static wbacon_error_type algorithm_5(regdata*, workarray*, estimate*,
-    int* restrict, int* restrict, double*, int*, int*, int*);
+    int* restrict, int* restrict, double*, int*, int*, int*, int);
 static wbacon_error_type compute_ti(regdata*, workarray*, estimate*,
     int* restrict, int*, double* restrict);
 static wbacon_error_type update_chol_xty(regdata*, workarray*, estimate*,
@@ -58,9 +72,16 @@ static inline wbacon_error_type chol_downdate(double* restrict,
 static inline wbacon_error_type hat_matrix(regdata*, workarray*,
     double* restrict, double* restrict);
 static void select_subset(double* restrict, double* restrict, int* restrict,
-    int*, int*);
+    int*, int*, subset_hint*);
+static void select_subset_cold(double* restrict, double* restrict,
+    int* restrict, int, int, subset_hint*);
 static inline void cholesky_reg(double*, double*, double*, double*, int*, int*);
 static inline void chol_update(double* restrict, double* restrict, int);
+static wbacon_error_type workarray_alloc(wbacon_memory*, regdata*, estimate*,
+    workarray*, int, int, int);
+static void workarray_free(regdata*, estimate*, workarray*);
+static void checkpoint_items(wbacon_checkpoint*, workarray*, estimate*,
+    int* restrict, int*);
 
 /******************************************************************************\
 |* BACON regression estimator                                                 *|
@@ -88,16 +109,57 @@ static inline void chol_update(double* restrict, double* restrict, int);
 |*           size 'collect * p' and uses instead the size of the subset that  *|
 |*           results from Algorithm 3                                         *|
 |*  threads  set the max number of threads for OpenMP                         *|
+|*  trace    on return: per-phase timing, array[trace_len]; see wbacon_trace.h*|
+|*  trace_len dimension; 0: no timing                                         *|
+|*  memory   on return: peak working set, array[WBACON_MEMORY_LEN]; see       *|
+|*           wbacon_memory.h                                                  *|
+|*  mode     execution plan (see wbacon_plan.h): WBACON_PLAN_DETERMINISTIC:   *|
+|*           BLAS runs on one thread (the result does not depend on the       *|
+|*           number of threads); otherwise, on 'threads'. WBACON_PLAN_FIXED:  *|
+|*           the subsets are selected without warm starts (select_subset)     *|
+|*  budget   time budget of the call (seconds); <= 0: no budget               *|
+|*  stop     on return: typedef enum wbacon_stop_type; if the call stopped    *|
+|*           before convergence, the estimates of the last complete step or   *|
+|*           iteration are returned (success = 0)                             *|
+|*  checkpoint file of the checkpoints (see wbacon_checkpoint.c); "": none    *|
+|*  resume   on entry: 1: the call resumes from the checkpoint (if the file   *|
+|*           exists); 0: from scratch; on return: typedef enum                *|
+|*           wbacon_checkpoint_status                                         *|
 \******************************************************************************/
 void wbacon_reg(double *x, double *y, double *w, double *resid, double *beta,
     int *subset0, double *dist, int *n, int *p, int *m, int *verbose,
     int *success, int *collect, double *alpha, int *maxiter, int *original,
-    int *threads)
+    int *threads, double *trace, int *trace_len, double *memory, int *mode,
+    double *budget, int *stop, char **checkpoint, int *resume)
+{
+    wbacon_reg_fit(x, y, w, resid, beta, subset0, dist, n, p, m, verbose,
+        success, collect, alpha, maxiter, original, threads, trace, trace_len,
+        memory, mode, budget, stop, checkpoint, resume, NULL);
+}
+
+/******************************************************************************\
+|* BACON regression estimator with given cutoffs (for internal use)           *|
+|*  x ... resume  see wbacon_reg                                              *|
+|*  t_quantile cutoffs of Algorithm 5, qt(alpha / (2 * (m + 1)), m - p) for   *|
+|*           the subset sizes m = 0, ..., n, array[n + 1]; NULL: computed by  *|
+|*           qt (R is not called by the threads of a parallel region; see     *|
+|*           wbacon_simulate)                                                 *|
+|* Return value: WBACON_ERROR_MEMORY if the work arrays cannot be allocated   *|
+|*               (in a parallel region; see mem_alloc); WBACON_ERROR_OK       *|
+|*               otherwise (see 'success')                                    *|
+\******************************************************************************/
+wbacon_error_type wbacon_reg_fit(double *x, double *y, double *w,
+    double *resid, double *beta, int *subset0, double *dist, int *n, int *p,
+    int *m, int *verbose, int *success, int *collect, double *alpha,
+    int *maxiter, int *original, int *threads, double *trace, int *trace_len,
+    double *memory, int *mode, double *budget, int *stop, char **checkpoint,
+    int *resume, const double *t_quantile)
 {
     wbacon_error_type err;
     *success = 1;
-
-    int *subset1 = (int*) Calloc(*n, int);
+    wbacon_trace timing;
+    trace_init(&timing, trace, *trace_len);
+    trace_begin(&timing, WBACON_PHASE_TOTAL);
 
     // initialize and populate 'data' which is a regdata struct
     regdata data;
@@ -106,17 +168,34 @@ void wbacon_reg(double *x, double *y, double *w, double *resid, double *beta,
     dat->x = x;
     dat->y = y;
     dat->w = w;
-    double *wy = (double*) Calloc(*n, double);
-    dat->wy = wy;
-    double *wx = (double*) Calloc(*n * *p, double);
-    dat->wx = wx;
-    // sqrt(w) is computed once and then shared
-    double *w_sqrt = (double*) Calloc(*n, double);
-
-    for (int i = 0; i < *n; i++)
-        w_sqrt[i] = sqrt(w[i]);
-
-    dat->w_sqrt = w_sqrt;
+    dat->t_quantile = t_quantile;
+    dat->trace = &timing;
+    wbacon_threads blas;
+    dat->blas = &blas;
+    // the loops of wbacon_reg do not depend on the number of threads; BLAS
+    // does (deterministic plan: one thread; if BLAS is not controlled, it
+    // runs on its own threads and determinism is not guaranteed, see
+    // wbacon_threads.h)
+    int deterministic = *mode == WBACON_PLAN_DETERMINISTIC;
+    dat->blas_threads = deterministic ? 1 : *threads;
+    wbacon_deadline deadline;
+    deadline_begin(&deadline, *budget);
+    dat->deadline = &deadline;
+
+    // checkpoints: the fingerprint covers the data, the subset of Algorithm
+    // 3, the arguments of the initialization, and the mode of the plan
+    uint64_t fingerprint = 0;
+    if (checkpoint[0][0] != '\0') {
+        fingerprint = checkpoint_hash(0, x, (size_t)*n * *p * sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, y, *n * sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, w, *n * sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, subset0, *n * sizeof(int));
+        fingerprint = checkpoint_hash(fingerprint, alpha, sizeof(double));
+        fingerprint = checkpoint_hash(fingerprint, collect, sizeof(int));
+        fingerprint = checkpoint_hash(fingerprint, original, sizeof(int));
+        fingerprint = checkpoint_hash(fingerprint, &deterministic,
+            sizeof(int));
+    }
 
     // initialize and populate 'est' which is a estimate struct
     estimate the_estimate;
@@ -124,28 +203,30 @@ void wbacon_reg(double *x, double *y, double *w, double *resid, double *beta,
     est->resid = resid;
     est->beta = beta;
     est->dist = dist;
-    double *L = (double*) Calloc(*p * *p, double);
-    est->L = L;
-    double *xty = (double*) Calloc(*p, double);
-    est->xty = xty;
 
-    // initialize and populate 'work' which is a workarray struct
+    // initialize and populate 'work' which is a workarray struct (and the
+    // arrays of 'data' and 'est')
+    int n_threads = 1;
+    #ifdef _OPENMP
+    // number of threads of the team (see below)
+    n_threads = omp_get_max_threads();
+    if (*threads <= n_threads)
+        n_threads = *threads;
+    #endif
+    wbacon_memory mem;
+    mem_begin(&mem, 0);
     workarray warray;
     workarray *work = &warray;
-    double *work_p = (double*) Calloc(*p, double);
-    work->work_p = work_p;
-    double *work_pp = (double*) Calloc(*p * *p, double);
-    work->work_pp = work_pp;
-    double *work_np = (double*) Calloc(*n * *p, double);
-    work->work_np = work_np;
-    double *work_n = (double*) Calloc(*n, double);
-    work->work_n = work_n;
-    int *iarray = (int*) Calloc(*n, int);
-    work->iarray = iarray;
-    // determine size of work array for LAPACK:degels
-    work->lwork = fitwls(dat, est, subset0, work_np, -1);
-    double *dgels_work = (double*) Calloc(work->lwork, double);
-    work->dgels_work = dgels_work;
+    wbacon_error_type status = workarray_alloc(&mem, dat, est, work, *n, *p,
+        n_threads);
+    int *subset1 = work->subset1;
+    double *work_n = work->work_n;
+    // the fixed plan selects the subsets without warm starts (as in 0.5-1)
+    work->hint.enabled = *mode != WBACON_PLAN_FIXED;
+    wbacon_checkpoint ckpt;
+    checkpoint_begin(&ckpt, &mem, checkpoint[0], WBACON_CHECKPOINT_REG, *n,
+        *p, fingerprint);
+    dat->checkpoint = &ckpt;
 
     #ifdef _OPENMP
     // store current definition of max number of threads
@@ -156,8 +237,38 @@ void wbacon_reg(double *x, double *y, double *w, double *resid, double *beta,
     } else {
         PRINT_OUT("The requested no. of threads is larger than the default.\n");
         PRINT_OUT("Thus, the default is kept at %d\n", default_no_threads);
+        dat->blas_threads = deterministic ? 1 : default_no_threads;
     }
     #endif
+    threads_begin(&blas);
+    trace_open_counters(&timing);
+    if (status != WBACON_ERROR_OK) {
+        *success = 0;
+        PRINT_OUT("Error: %s\n", wbacon_error(status));
+        goto clean_up;
+    }
+
+    // sqrt(w) is computed once and then shared
+    for (int i = 0; i < *n; i++)
+        dat->w_sqrt[i] = sqrt(w[i]);
+
+    // resume from the checkpoint (the initialization is skipped)
+    checkpoint_items(&ckpt, work, est, subset0, m);
+    *resume = *resume ? (int)checkpoint_load(&ckpt) : 0;
+    if (*resume == WBACON_CHECKPOINT_INVALID) {
+        *success = 0;
+        PRINT_OUT("Error: checkpoint '%s' does not match the data or is "
+            "corrupt\n", checkpoint[0]);
+        goto clean_up;
+    }
+    if (ckpt.resumed) {
+        if (*verbose)
+            PRINT_OUT("Resumed from checkpoint (Algorithm %d, %s %d)\n",
+                ckpt.stage, ckpt.stage == 4 ? "step" : "iteration", ckpt.iter);
+        if (ckpt.stage == 4)
+            goto algorithm4;
+        goto algorithm5;
+    }
 
     // STEP 0 (initialization)
     if (*original) {
@@ -165,9 +276,11 @@ void wbacon_reg(double *x, double *y, double *w, double *resid, double *beta,
         // Alg. 3) into subset0; otherwise we take the subset of all 'good'
         // obs. as determined by Alg. 3 (i.e., subset0)
         *m = *collect * *p;
-        select_subset(dist, work_n, subset0, m, n);
+        select_subset(dist, work_n, subset0, m, n, NULL);
     }
+    trace_begin(&timing, WBACON_PHASE_REG_INIT);
     err = initial_reg(dat, work, est, subset0, m, verbose);
+    trace_end(&timing, WBACON_PHASE_REG_INIT);
     if (err != WBACON_ERROR_OK) {
         *success = 0;
         PRINT_OUT("Error: design %s (step 0)\n", wbacon_error(err));
@@ -181,12 +294,19 @@ print_magic_number(subset1, *n);
 PRINT_OUT("\n");
 #endif
 
-    // select the p+1 obs. with the smallest ti's (initial basic subset)
+    // select the p+1 obs. with the smallest ti's (initial basic subset); the
+    // band around the threshold is kept for the warm starts in Algorithm 4
     *m = *p + 1;
-    select_subset(est->dist, work_n, subset1, m, n);
+    select_subset(est->dist, work_n, subset1, m, n, &work->hint);
 
     // STEP 1 (Algorithm 4)
-    err = algorithm_4(dat, work, est, subset0, subset1, m, verbose, collect);
+algorithm4:
+    trace_begin(&timing, WBACON_PHASE_REG_ALGORITHM4);
+    err = algorithm_4(dat, work, est, subset0, subset1, m, verbose, collect,
+        checkpoint_resumed(&ckpt, 4, ckpt.iter) ? ckpt.iter : 1);
+    trace_end(&timing, WBACON_PHASE_REG_ALGORITHM4);
+    if (err == WBACON_ERROR_STOPPED)
+        goto stopped;
     if (err != WBACON_ERROR_OK) {
         PRINT_OUT("Error: %s (Cholesky update, step 1)\n", wbacon_error(err));
         *success = 0;
@@ -201,26 +321,192 @@ PRINT_OUT("\n");
 #endif
 
     // STEP 2 (Algorithm 5)
+algorithm5:
+    trace_begin(&timing, WBACON_PHASE_REG_ALGORITHM5);
     err = algorithm_5(dat, work, est, subset1, subset0, alpha, m, maxiter,
-        verbose);
+        verbose, checkpoint_resumed(&ckpt, 5, ckpt.iter) ? ckpt.iter : 1);
+    trace_end(&timing, WBACON_PHASE_REG_ALGORITHM5);
+    if (err == WBACON_ERROR_STOPPED)
+        goto stopped;
     if (err != WBACON_ERROR_OK) {
         PRINT_OUT("Error: %s (step 2)\n", wbacon_error(err));
         *success = 0;
     }
+    goto copy_qr;
+
+stopped:
+    // the estimates are refitted on the subset0 of the last complete step or
+    // iteration (the QR factorization in wx belongs to an earlier fit, and
+    // the Cholesky factor L of Algorithm 4 is updated without it)
+    *success = 0;
+    *m = 0;
+    for (int i = 0; i < *n; i++)
+        *m += subset0[i];
+    if (*verbose)
+        PRINT_OUT("Stopped (%s)\n", deadline_reason(deadline.stop));
+    if (fitwls_subset(dat, work, est, subset0, *m) != 0) {
+        // the QR factorization is not available
+        for (int i = 0; i < *n * *p; i++)
+            x[i] = NA_REAL;
+        goto clean_up;
+    }
+    for (int i = 0; i < *p; i++)
+        for (int j = i; j < *p; j++)
+            est->L[j + i * *p] = dat->wx[i + j * *n];
+    err = compute_ti(dat, work, est, subset0, m, est->dist);
+    if (err != WBACON_ERROR_OK)
+        PRINT_OUT("Error: %s (refit after the stop)\n", wbacon_error(err));
 
+copy_qr:
     // copy the QR factorization to x (as returned by fitwls -> dgels -> dgeqrf)
-    Memcpy(x, wx, *n * *p);
+    Memcpy(x, dat->wx, *n * *p);
 
 clean_up:
-    Free(work_pp); Free(work_p); Free(work_np); Free(work_n); Free(dgels_work);
-    Free(iarray); Free(subset1);
-    Free(wx); Free(wy); Free(w_sqrt); Free(L);  Free(xty);
+    *stop = (int)deadline.stop;
+    checkpoint_end(&ckpt);
+    workarray_free(dat, est, work);
+    mem_end(&mem, memory);
+    trace_end(&timing, WBACON_PHASE_TOTAL);
+    trace_close(&timing);
+    threads_end(&blas);
 
     #ifdef _OPENMP
     // set the number of threads to the default value
     if (*threads != default_no_threads)
         omp_set_num_threads(default_no_threads);
     #endif
+    return status;
+}
+
+/******************************************************************************\
+|* peak working set of wbacon_reg without running it (dry run)                *|
+|*  n, p     dimensions                                                       *|
+|*  threads  max number of threads for OpenMP                                 *|
+|*  memory   on return: array[WBACON_MEMORY_LEN]; see wbacon_memory.h         *|
+|* NOTE: the scratch of the kernels is charged for the worst case, i.e., the  *|
+|*       initial subset is rank deficient and all distances are sorted (see   *|
+|*       initial_reg). The trace is not included                              *|
+\******************************************************************************/
+void wbacon_reg_dryrun(int *n, int *p, int *threads, double *memory)
+{
+    int n_threads = 1;
+    #ifdef _OPENMP
+    // see wbacon_reg: the default is kept if the request is larger
+    n_threads = omp_get_max_threads();
+    if (*threads <= n_threads)
+        n_threads = *threads;
+    #endif
+
+    wbacon_memory mem;
+    mem_begin(&mem, 1);
+    regdata data;
+    estimate the_estimate;
+    workarray warray;
+    workarray_alloc(&mem, &data, &the_estimate, &warray, *n, *p,
+        n_threads);
+
+    // select_subset (radix selection) and initial_reg (sort of all distances)
+    double bytes = fmax(select_radix_scratch(*n, n_threads),
+        psort_array_scratch(*n, *n, n_threads));
+    mem_reserve(&mem, bytes, WBACON_MEM_KERNEL);
+    mem_release(&mem, bytes, WBACON_MEM_KERNEL);
+    mem_end(&mem, memory);
+}
+
+/******************************************************************************\
+|* allocate the arrays of wbacon_reg (in a dry run, the pointers are NULL)    *|
+|*  mem     typedef struct wbacon_memory                                      *|
+|*  dat     typedef struct regdata: on return, wx, wy, and w_sqrt             *|
+|*  est     typedef struct estimate: on return, L and xty                     *|
+|*  work    typedef struct workarray                                          *|
+|*  n, p    dimensions                                                        *|
+|*  threads number of threads of the team                                     *|
+|* Return value: WBACON_ERROR_MEMORY if an array cannot be allocated (in a    *|
+|*               parallel region; see mem_alloc); WBACON_ERROR_OK otherwise   *|
+|* NOTE: wx and work_np are first-touched by columns (see mem_alloc_placed)   *|
+|*       as in the loop over the columns of fitwls                            *|
+\******************************************************************************/
+static wbacon_error_type workarray_alloc(wbacon_memory *mem, regdata *dat,
+    estimate *est, workarray *work, int n, int p, int threads)
+{
+    size_t np = (size_t)n * p;
+    if (n <= FITWLS_OMP_MIN_SIZE)
+        threads = 1;
+    work->subset1 = (int*) mem_alloc(mem, n, sizeof(int), WBACON_MEM_SUBSET);
+    dat->wy = (double*) mem_alloc(mem, n, sizeof(double), WBACON_MEM_DATA);
+    dat->wx = (double*) mem_alloc_placed(mem, np, sizeof(double),
+        WBACON_MEM_DATA, n, threads);
+    dat->w_sqrt = (double*) mem_alloc(mem, n, sizeof(double), WBACON_MEM_DATA);
+    est->L = (double*) mem_alloc(mem, p * p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    est->xty = (double*) mem_alloc(mem, p, sizeof(double), WBACON_MEM_WORK_PP);
+    work->work_p = (double*) mem_alloc(mem, p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    work->work_pp = (double*) mem_alloc(mem, p * p, sizeof(double),
+        WBACON_MEM_WORK_PP);
+    work->work_np = (double*) mem_alloc_placed(mem, np, sizeof(double),
+        WBACON_MEM_WORK_NP, n, threads);
+    work->work_n = (double*) mem_alloc(mem, n, sizeof(double),
+        WBACON_MEM_WORK_N);
+    work->iarray = (int*) mem_alloc(mem, n, sizeof(int), WBACON_MEM_SUBSET);
+    work->hint.band = (int*) mem_alloc(mem, n, sizeof(int), WBACON_MEM_SUBSET);
+    work->hint.valid = 0;
+    work->hint.enabled = 1;
+    work->hint.width = _HINT_WIDTH;
+    // determine size of work array for LAPACK:degels
+    work->lwork = fitwls_lwork(n, p);
+    work->dgels_work = (double*) mem_alloc(mem, work->lwork, sizeof(double),
+        WBACON_MEM_LAPACK);
+
+    if (mem->dry)
+        return WBACON_ERROR_OK;
+    if (work->subset1 == NULL || dat->wy == NULL || dat->wx == NULL
+            || dat->w_sqrt == NULL || est->L == NULL || est->xty == NULL
+            || work->work_p == NULL || work->work_pp == NULL
+            || work->work_np == NULL || work->work_n == NULL
+            || work->iarray == NULL || work->hint.band == NULL
+            || work->dgels_work == NULL)
+        return WBACON_ERROR_MEMORY;
+    return WBACON_ERROR_OK;
+}
+
+static void workarray_free(regdata *dat, estimate *est, workarray *work)
+{
+    mem_free(work->work_pp); mem_free(work->work_p); mem_free(work->work_np);
+    mem_free(work->work_n); mem_free(work->dgels_work); mem_free(work->iarray);
+    mem_free(work->hint.band); mem_free(work->subset1);
+    mem_free(dat->wx); mem_free(dat->wy); mem_free(dat->w_sqrt);
+    mem_free(est->L); mem_free(est->xty);
+}
+
+/******************************************************************************\
+|* register the state of Algorithms 4 and 5 with the checkpoints              *|
+|*  ck       typedef struct wbacon_checkpoint                                 *|
+|*  work     typedef struct workarray                                         *|
+|*  est      typedef struct estimate                                          *|
+|*  subset0  subset, array[n]                                                 *|
+|*  m        size of the subset                                               *|
+|* NOTE: the state at the beginning of a step (iteration) is the pair of      *|
+|*       subsets, the Cholesky factor and xty (Algorithm 4), the band of      *|
+|*       select_subset, and the estimates of the previous step; resid and     *|
+|*       the t[i]'s are recomputed in the step that continues a checkpoint    *|
+\******************************************************************************/
+static void checkpoint_items(wbacon_checkpoint *ck, workarray *work,
+    estimate *est, int* restrict subset0, int *m)
+{
+    int n = ck->n, p = ck->p;
+    checkpoint_add(ck, WBACON_ITEM_BITMAP, subset0, n);
+    checkpoint_add(ck, WBACON_ITEM_BITMAP, work->subset1, n);
+    checkpoint_add(ck, WBACON_ITEM_INT, m, 1);
+    checkpoint_add(ck, WBACON_ITEM_INT, work->iarray, n);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, est->L, p * p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, est->xty, p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, est->beta, p);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, &est->sigma, 1);
+    checkpoint_add(ck, WBACON_ITEM_INT, &work->hint.valid, 1);
+    checkpoint_add(ck, WBACON_ITEM_INT, &work->hint.width, 1);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, &work->hint.lo, 1);
+    checkpoint_add(ck, WBACON_ITEM_DOUBLE, &work->hint.hi, 1);
 }
 
 /******************************************************************************\
@@ -250,13 +536,13 @@ static wbacon_error_type initial_reg(regdata *dat, workarray *work,
     // compute regression estimate (on return, dat->wx is overwritten by the
     // R matrix of the QR factorization (R will be used by the caller of
     // initial_reg)
-    info = fitwls(dat, est, subset, work->dgels_work, work->lwork);
+    info = fitwls_subset(dat, work, est, subset, *m);
 
     // if the design matrix is rank deficient, we enlarge the subset
     if (info) {
         status = WBACON_ERROR_RANK_DEFICIENT;
         // sort the dist[i]'s in ascending order
-        psort_array(est->dist, iarray, n, n);
+        psort_array(est->dist, iarray, n, n, work->work_n);
 
         // add obs. to the subset until x has full rank
         while (*m < n) {
@@ -265,7 +551,7 @@ static wbacon_error_type initial_reg(regdata *dat, workarray *work,
             // subset)
             subset[iarray[*m - 1]] = 1;
             // re-do regression and check rank
-            info = fitwls(dat, est, subset, work->dgels_work, work->lwork);
+            info = fitwls_subset(dat, work, est, subset, *m);
             if (info == 0) {
                 status = WBACON_ERROR_OK;
                 break;
@@ -296,6 +582,29 @@ static wbacon_error_type initial_reg(regdata *dat, workarray *work,
     return status;
 }
 
+/******************************************************************************\
+|* Weighted least squares on a subset (timed; with static tracepoints)        *|
+|*  dat      typedef struct regdata                                           *|
+|*  work     typedef struct workarray                                         *|
+|*  est      typedef struct estimate                                          *|
+|*  subset   subset, 1: obs. is in the subset, 0 otherwise, array[n]          *|
+|*  m        number of obs. in subset                                         *|
+|* Return value: see fitwls (0: success)                                      *|
+\******************************************************************************/
+static int fitwls_subset(regdata *dat, workarray *work, estimate *est,
+    int* restrict subset, int m)
+{
+    trace_begin(dat->trace, WBACON_PHASE_FITWLS);
+    WBACON_PROBE(fitwls__begin, dat->n, dat->p, m, 0);
+    // the QR factorization (dgels) runs in parallel, not the loops of fitwls
+    threads_blas(dat->blas, dat->blas_threads);
+    int info = fitwls(dat, est, subset, work->dgels_work, work->lwork);
+    threads_blas(dat->blas, 1);
+    WBACON_PROBE(fitwls__end, dat->n, dat->p, m, info);
+    trace_end(dat->trace, WBACON_PHASE_FITWLS);
+    return info;
+}
+
 /******************************************************************************\
 |* Algorithm 4 of Billor et al. (2000), adapted for weighting                 *|
 |*  dat      typedef struct regdata                                           *|
@@ -307,12 +616,13 @@ static wbacon_error_type initial_reg(regdata *dat, workarray *work,
 |*  verbose  toggle: 1: additional information is printed to the console;     *|
 |*           0: quiet                                                         *|
 |*  collect  defines size of initial subset: m = collect * p                  *|
+|*  first    first step (> 1: resumed from a checkpoint)                      *|
 \******************************************************************************/
 static wbacon_error_type algorithm_4(regdata *dat, workarray *work,
     estimate *est, int* restrict subset0, int* restrict subset1, int *m,
-    int *verbose, int *collect)
+    int *verbose, int *collect, int first)
 {
-    int n = dat->n, p = dat->p;
+    int n = dat->n, p = dat->p, resumed;
     int* restrict iarray = work->iarray;
     wbacon_error_type err;
 
@@ -320,7 +630,21 @@ static wbacon_error_type algorithm_4(regdata *dat, workarray *work,
         PRINT_OUT("Step 1 (Algorithm 4):\n");
 
     // STEP 1 (Algorithm 4)
-    for (;;) {
+    for (int step = first; ; step++) {
+        // checkpoint of the state at the beginning of the step; the step that
+        // continues a checkpoint is run in full
+        resumed = checkpoint_resumed(dat->checkpoint, 4, step);
+        if (!resumed && checkpoint_save(dat->checkpoint, 4, step))
+            PRINT_OUT("Warning: checkpoint '%s' cannot be written\n",
+                dat->checkpoint->path);
+
+        // time budget, cancellation, and user interrupt (beta, resid, and
+        // dist belong to subset0)
+        if (!resumed && deadline_check(dat->deadline) != WBACON_STOP_NONE)
+            return WBACON_ERROR_STOPPED;
+
+        trace_begin(dat->trace, WBACON_PHASE_REG_STEP4);
+        WBACON_PROBE(algorithm4_step__begin, n, p, *m, step);
         if (*verbose)
             PRINT_OUT("  m = %d", *m);
 
@@ -331,6 +655,7 @@ static wbacon_error_type algorithm_4(regdata *dat, workarray *work,
         // subset until it has full rank
         if (err != WBACON_ERROR_OK) {
             for (;;) {
+                WBACON_PROBE(downdate__fail, n, p, *m, step);
                 (*m)++;
                 subset1[iarray[*m - 1]] = 1;
                 if (*verbose)
@@ -366,11 +691,17 @@ static wbacon_error_type algorithm_4(regdata *dat, workarray *work,
 
         // select the m obs. with the smallest t[i]'s
         (*m)++;
-
-        if (*m == p * *collect + 1)
+        int done = *m == p * *collect + 1;
+        if (!done)
+            select_subset(est->dist, work->work_n, subset1, m, &n,
+                &work->hint);
+
+        WBACON_PROBE(algorithm4_step__end, n, p, *m, step);
+        trace_end(dat->trace, WBACON_PHASE_REG_STEP4);
+        trace_iteration(dat->trace, WBACON_PHASE_REG_STEP4, step, subset0,
+            subset1, n);
+        if (done)
             break;
-
-        select_subset(est->dist, work->work_n, subset1, m, &n);
     }
 
     return WBACON_ERROR_OK;
@@ -389,12 +720,13 @@ static wbacon_error_type algorithm_4(regdata *dat, workarray *work,
 |*  maxiter  maximum number of iterations                                     *|
 |*  verbose  toggle: 1: additional information is printed to the console;     *|
 |*           0: quiet                                                         *|
+|*  first    first iteration (> 1: resumed from a checkpoint)                 *|
 \******************************************************************************/
 static wbacon_error_type algorithm_5(regdata *dat, workarray *work,
     estimate *est, int* restrict subset0, int* restrict subset1, double *alpha,
-    int *m, int *maxiter, int *verbose)
+    int *m, int *maxiter, int *verbose, int first)
 {
-    int n = dat->n, p = dat->p, iter = 1, info, i;
+    int n = dat->n, p = dat->p, iter = first, info, i, resumed;
     double cutoff;
     double* restrict L = est->L;
     double* restrict wx = dat->wx;
@@ -405,6 +737,17 @@ static wbacon_error_type algorithm_5(regdata *dat, workarray *work,
         PRINT_OUT("Step 2 (Algorithm 5):\n");
 
     while (iter <= *maxiter) {
+        resumed = checkpoint_resumed(dat->checkpoint, 5, iter);
+        if (!resumed && checkpoint_save(dat->checkpoint, 5, iter))
+            PRINT_OUT("Warning: checkpoint '%s' cannot be written\n",
+                dat->checkpoint->path);
+        if (!resumed && deadline_check(dat->deadline) != WBACON_STOP_NONE) {
+            *maxiter = iter - 1;            // complete iterations
+            return WBACON_ERROR_STOPPED;
+        }
+
+        trace_begin(dat->trace, WBACON_PHASE_REG_ITERATION5);
+        WBACON_PROBE(algorithm5_iteration__begin, n, p, *m, iter);
 
 #if _debug_mode
 print_magic_number(subset0, n);
@@ -412,7 +755,7 @@ print_magic_number(subset0, n);
 
         // weighted least squares (on return, wx is overwritten by the
         // QR factorization)
-        info = fitwls(dat, est, subset0, work->dgels_work, work->lwork);
+        info = fitwls_subset(dat, work, est, subset0, *m);
         if (info)
             return WBACON_ERROR_RANK_DEFICIENT;
 
@@ -427,7 +770,8 @@ print_magic_number(subset0, n);
             return err;
 
         // t-distr. cutoff value (quantile)
-        cutoff = qt(*alpha / (double)(2 * (*m + 1)), *m - p, 0, 0);
+        cutoff = dat->t_quantile != NULL ? dat->t_quantile[*m]
+            : qt(*alpha / (double)(2 * (*m + 1)), *m - p, 0, 0);
 
         // generate new subset that includes all obs. with t[i] < cutoff
         *m = 0;
@@ -439,6 +783,10 @@ print_magic_number(subset0, n);
                 subset1[i] = 0;
             }
         }
+        WBACON_PROBE(algorithm5_iteration__end, n, p, *m, iter);
+        trace_end(dat->trace, WBACON_PHASE_REG_ITERATION5);
+        trace_iteration(dat->trace, WBACON_PHASE_REG_ITERATION5, iter, subset0,
+            subset1, n);
 
         // check whether the subsets differ
         for (i = 0; i < n; i++)
@@ -468,24 +816,120 @@ print_magic_number(subset0, n);
 |*  subset  on return: array[n], 1: element is in the subset, 0: otherwise    *|
 |*  m       size of the subset                                                *|
 |*  n       dimension                                                         *|
+|*  hint    band around the previous threshold (or NULL); on return: band     *|
+|*          around the current threshold                                      *|
+|* NOTE: warm start: in Algorithm 4, m increases by one per step and the      *|
+|*       distances change only a little. One streaming pass over x fills the  *|
+|*       subset with the elements smaller than the band and collects the      *|
+|*       indices of the elements in the band; the threshold is then selected  *|
+|*       among the (few) elements in the band. If the m-th smallest element   *|
+|*       is not in the band, the band is widened and we take a cold start.    *|
+|*       Ties with the threshold are taken in the order of the index; thus,   *|
+|*       the subset does not depend on the hint                               *|
 \******************************************************************************/
 static void select_subset(double* restrict x, double* restrict work_n,
-    int* restrict subset, int *m, int *n)
+    int* restrict subset, int *m, int *n, subset_hint *hint)
+{
+    if (hint == NULL || !hint->valid) {
+        select_subset_cold(x, work_n, subset, *m, *n, hint);
+        return;
+    }
+
+    // streaming pass: elements smaller than the band go into the subset; the
+    // indices of the elements in the band are collected (branchless)
+    int* restrict band = hint->band;
+    double lo = hint->lo, hi = hint->hi;
+    int n_band = 0, n_below = 0, below;
+    for (int i = 0; i < *n; i++) {
+        below = x[i] < lo;
+        subset[i] = below;
+        n_below += below;
+        band[n_band] = i;
+        n_band += (x[i] >= lo) & (x[i] <= hi);
+    }
+
+    // rank of the threshold in the band; if it is not in the band, we widen
+    // the band for the next call and take a cold start
+    int r = *m - 1 - n_below;
+    if (r < 0 || r >= n_band) {
+        if (hint->width < *n)
+            hint->width *= 2;
+        select_subset_cold(x, work_n, subset, *m, *n, hint);
+        return;
+    }
+
+    // select the threshold among the elements in the band
+    for (int j = 0; j < n_band; j++)
+        work_n[j] = x[band[j]];
+    select_k(work_n, 0, n_band - 1, r);
+    double threshold = work_n[r];
+
+    // elements in the band that are smaller than the threshold and the ties
+    // (in the order of the index)
+    int n_ties = *m - n_below;
+    for (int j = 0; j < n_band; j++)
+        n_ties -= x[band[j]] < threshold;
+    for (int j = 0; j < n_band; j++) {
+        if (x[band[j]] < threshold) {
+            subset[band[j]] = 1;
+        } else if (x[band[j]] == threshold && n_ties > 0) {
+            subset[band[j]] = 1;
+            n_ties--;
+        }
+    }
+
+    // new band: 'width' ranks below and above the threshold (the bounds are
+    // kept if the band holds fewer elements)
+    int width = hint->width;
+    if (r - width >= 0) {
+        select_k(work_n, 0, r - 1, r - width);
+        hint->lo = work_n[r - width];
+    }
+    if (r + width < n_band) {
+        select_k(work_n, r + 1, n_band - 1, r + width);
+        hint->hi = work_n[r + width];
+    }
+}
+
+/******************************************************************************\
+|* select_subset without hint (for internal use)                              *|
+|*  x       array[n]                                                          *|
+|*  work_n  work array[n]                                                     *|
+|*  subset  on return: array[n], 1: element is in the subset, 0: otherwise    *|
+|*  m       size of the subset                                                *|
+|*  n       dimension                                                         *|
+|*  hint    NULL or, on return: band of +/- width ranks around the threshold  *|
+|*          (if hint->enabled)                                                *|
+\******************************************************************************/
+static void select_subset_cold(double* restrict x, double* restrict work_n,
+    int* restrict subset, int m, int n, subset_hint *hint)
 {
     // select the m-th smallest element (threshold)
-    Memcpy(work_n, x, *n);
-    select_k(work_n, 0, *n - 1, *m - 1);
-    double threshold = work_n[*m - 1];
+    double threshold = select_radix(x, n, m - 1, work_n);
 
-    // select the elements smaller than the threshold into the subset
+    // select the elements smaller than the threshold into the subset and
+    // then the ties (in the order of the index; as in the warm start)
     int counter = 0;
-    for (int i = 0; i < *n; i++)
-        if (x[i] <= threshold && counter < *m) {
+    for (int i = 0; i < n; i++) {
+        subset[i] = x[i] < threshold;
+        counter += subset[i];
+    }
+    for (int i = 0; i < n && counter < m; i++)
+        if (x[i] == threshold) {
             subset[i] = 1;
             counter++;
-        } else {
-            subset[i] = 0;
         }
+
+    if (hint == NULL || !hint->enabled)
+        return;
+
+    // band for the next (warm) start
+    int width = hint->width;
+    hint->lo = m - 1 - width >= 0 ? select_radix(x, n, m - 1 - width, work_n)
+        : -DBL_MAX;
+    hint->hi = m - 1 + width < n ? select_radix(x, n, m - 1 + width, work_n)
+        : DBL_MAX;
+    hint->valid = 1;
 }
 
 /******************************************************************************\
@@ -705,24 +1149,23 @@ static inline wbacon_error_type hat_matrix(regdata *dat, workarray *work,
     // triangular matrix multiplication x * L^{-T}
     const double d_one = 1.0;
     Memcpy(work_np, dat->x, n * p);
+    threads_blas(dat->blas, dat->blas_threads);
     F77_CALL(dtrmm)("R", "L", "T", "N", &n, &p, &d_one, work->work_pp, &p,
         work_np, &n);
-
-    // diagonal elements of hat matrix = row sums of (x * L^{-T})^2
-    for (int i = 0; i < n; i++)
-        hat[i] = _POWER2(work_np[i]);
-
-    #pragma omp parallel for if(n > REG_OMP_MIN_SIZE)
-    for (int j = 1; j < p; j++) {
-        #pragma omp simd
-        for (int i = 0; i < n; i++) {
-            hat[i] += _POWER2(work_np[i + j * n]);
-        }
+    threads_blas(dat->blas, 1);
+
+    // diagonal elements of hat matrix = row sums of (x * L^{-T})^2; the rows
+    // are split into tiles (a thread owns the elements of hat of its tiles)
+    int n_tiles = (n + WBACON_TILE - 1) / WBACON_TILE;
+    #pragma omp parallel for if(n > REG_OMP_MIN_SIZE) schedule(static)
+    for (int t = 0; t < n_tiles; t++) {
+        int i0 = t * WBACON_TILE;
+        int rows = n - i0 < WBACON_TILE ? n - i0 : WBACON_TILE;
+        kernel_sumsq_rows(work_np + i0, n, rows, p, hat + i0);
+        for (int i = i0; i < i0 + rows; i++)
+            hat[i] *= weight[i];
     }
 
-    for (int i = 0; i < n; i++)
-        hat[i] *= weight[i];
-
     return WBACON_ERROR_OK;
 }
 #undef _POWER2
@@ -0,0 +1,43 @@
+#include <R.h>
+
+#ifndef _WBACON_SIMD_H
+#define _WBACON_SIMD_H
+
+// function multiversioning of the SIMD kernels (target_clones): the compiler
+// generates a variant per instruction set (AVX-512F, AVX2, and the baseline
+// of the build, e.g., SSE2) and the dynamic loader selects the best variant
+// for the CPU when the shared object is loaded (ifunc); hence, a portable
+// build (-O2 from R's Makevars) runs the wide SIMD loops on AVX2/AVX-512
+// hosts. The clones are generated on x86-64 with glibc (ELF ifunc) if the
+// compiler supports the attribute; -DWBACON_CLONES=0 removes them.
+//
+// the floating-point operations are not contracted (FMA) in the variants;
+// hence, the variants are bit-identical to the baseline
+#ifndef WBACON_CLONES
+    #if defined(__x86_64__) && defined(__ELF__) && defined(__GLIBC__) \
+            && defined(__has_attribute)
+        #if __has_attribute(target_clones)
+            #define WBACON_CLONES 1
+        #endif
+    #endif
+#endif
+#ifndef WBACON_CLONES
+    #define WBACON_CLONES 0
+#endif
+
+#if WBACON_CLONES
+    #if defined(__clang__)
+        #define WBACON_TARGET_CLONES \
+            __attribute__((target_clones("avx512f", "avx2", "default")))
+        #define WBACON_NO_CONTRACT _Pragma("clang fp contract(off)")
+    #else
+        #define WBACON_TARGET_CLONES \
+            __attribute__((target_clones("avx512f", "avx2", "default"), \
+            optimize("fp-contract=off")))
+        #define WBACON_NO_CONTRACT
+    #endif
+#else
+    #define WBACON_TARGET_CLONES
+    #define WBACON_NO_CONTRACT
+#endif
+#endif
@@ -0,0 +1,462 @@
+/* Monte Carlo studies of the engines (wbacon and wbacon_reg)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The samples follow the contamination model of Billor et al.
+               (2000, p. 290): the first floor(n * epsilon) rows are
+               outliers, N(4, I_p), the others are N(0, I_p). For the
+               regression, y = 1 + x_1 + ... + x_p + N(0, 1) and the
+               response of the outliers is shifted by 10 (bad leverage
+               points).
+
+               Every replicate draws from its own random number stream
+               (splitmix64; Steele et al., 2014); the stream of replicate r
+               starts at a bijective hash of the seed and r. Hence, the
+               samples do not depend on the number of threads or the order
+               of the replicates, and the scenarios (epsilon, alpha, and
+               collect) of a replicate share the Gaussian variates (common
+               random numbers).
+
+               The replicates run in parallel, one replicate per thread; the
+               engines are called with one thread (BLAS as well; see
+               threads_begin). The threads do not call R: the buffers are
+               allocated and the quantiles of the chi-square and the
+               t-distribution (cutoffs) are computed before the parallel
+               region, the engines allocate their work arrays by the C
+               library (see mem_alloc), and a failed allocation is reported
+               after the parallel region. The criteria of a replicate are
+               counts, which are accumulated online in integer sums per
+               thread; hence, the summary does not depend on the number of
+               threads. Only the summary is returned.
+
+               Reference: Billor N., Hadi A.S., Vellemann P.F. (2000). BACON:
+               Blocked Adaptive Computationally efficient Outlier Nominators.
+               Computational Statistics and Data Analysis 34, pp. 279-298.
+               Steele G.L., Lea D., Flood C.H. (2014). Fast splittable
+               pseudorandom number generators. ACM SIGPLAN Notices 49,
+               pp. 453-472.
+*/
+
+#include "wbacon_simulate.h"
+
+#define _STREAM_GAMMA 0x9e3779b97f4a7c15ull // increment of splitmix64
+#define _STREAM_UNIT (1.0 / 9007199254740992.0) // 2^(-53)
+
+// accumulators of a scenario (integer sums of the counts)
+typedef struct sim_accum_struct {
+    int64_t converged;
+    int64_t sum[WBACON_SIM_COUNT];
+    int64_t sum2[WBACON_SIM_COUNT];
+    int64_t max[WBACON_SIM_COUNT];
+} sim_accum;
+
+// data and results of the replicate that a thread computes
+typedef struct sim_team_struct {
+    double *x;                      // sample, array[n, p]
+    double *y;                      // response, array[n] (regression)
+    double *design;                 // design matrix [1, x], array[n, p + 1]
+    double *center;
+    double *scatter;
+    double *beta;
+    double *dist;
+    double *resid;
+    int *subset;
+    double memory[WBACON_MEMORY_LEN];  // peak working set of the engines
+    sim_accum *acc;                 // array[n_scenarios]
+    int failed;                     // calls of the engines without memory
+} sim_team;
+
+// declarations of local function
+static void stream_begin(wbacon_stream*, int, int);
+static inline uint64_t stream_mix(uint64_t);
+static inline double stream_norm(wbacon_stream*);
+static void generate(wbacon_stream*, sim_team*, int, int, int, int);
+static void replicate(sim_team*, double*, int, int, int, double, double,
+    const double*, int, int, int, int, double*, sim_accum*);
+static void summarize(sim_accum*, int, int, int, double*);
+
+/******************************************************************************\
+|* Monte Carlo study of wbacon (or wbacon_reg)                                *|
+|*  n, p       dimensions of the samples                                      *|
+|*  eps        fractions of outliers, array[n_eps]                            *|
+|*  n_eps      dimension                                                      *|
+|*  alpha      prob., array[n_alpha]                                          *|
+|*  n_alpha    dimension                                                      *|
+|*  collect    parameters that specify the size of the intial subset,         *|
+|*             array[n_collect]                                               *|
+|*  n_collect  dimension                                                      *|
+|*  version2   1: 'Version 2' init. of Billor et al. (2000); 0: 'Version 1'   *|
+|*  reg        1: wbacon_reg (the design matrix is [1, x]); 0: wbacon         *|
+|*  replicates number of replicates per scenario                              *|
+|*  maxiter    maximal no. of iterations of a replicate                       *|
+|*  seed       seed of the random number streams                              *|
+|*  threads    set the max number of threads for OpenMP                       *|
+|*  cost       coefficients of the cost model (see wbacon)                    *|
+|*  result     on return: summary of the scenarios, array[n_eps * n_alpha *   *|
+|*             n_collect, WBACON_SIM_COLS]; see wbacon_simulate.h. The        *|
+|*             scenarios are ordered by eps (fastest), alpha, and collect     *|
+|*  memory     on return: peak working set, array[WBACON_MEMORY_LEN]; see     *|
+|*             wbacon_memory.h                                                *|
+|* NOTE: a replicate is a sample per value of eps; the engines run on the     *|
+|*       sample for every combination of alpha and collect. The criteria are  *|
+|*       accumulated over the replicates that converged. R is only called     *|
+|*       outside of the parallel region (an error is raised if the engines    *|
+|*       could not allocate their work arrays)                                *|
+\******************************************************************************/
+void wbacon_simulate(int *n, int *p, double *eps, int *n_eps, double *alpha,
+    int *n_alpha, int *collect, int *n_collect, int *version2, int *reg,
+    int *replicates, int *maxiter, int *seed, int *threads, double *cost,
+    double *result, double *memory)
+{
+    int n_scen = *n_eps * *n_alpha * *n_collect;
+    int n_tasks = *n_eps * *replicates;
+    int q = *p + 1;
+
+    int n_teams = 1;
+    #ifdef _OPENMP
+    n_teams = omp_get_max_threads();
+    if (*threads <= n_teams)
+        n_teams = *threads;
+    #endif
+    n_teams = n_teams < n_tasks ? n_teams : n_tasks;
+    n_teams = n_teams > 0 ? n_teams : 1;
+
+    // the weights are shared; the buffers are allocated per thread (outside
+    // of the parallel region)
+    wbacon_memory mem;
+    mem_begin(&mem, 0);
+    double *w = (double*) mem_alloc(&mem, *n, sizeof(double), WBACON_MEM_DATA);
+    for (int i = 0; i < *n; i++)
+        w[i] = 1.0;
+
+    sim_team *team = (sim_team*) Calloc(n_teams, sim_team);
+    for (int t = 0; t < n_teams; t++) {
+        sim_team *tm = team + t;
+        tm->x = (double*) mem_alloc(&mem, (size_t)*n * *p, sizeof(double),
+            WBACON_MEM_DATA);
+        tm->y = *reg ? (double*) mem_alloc(&mem, *n, sizeof(double),
+            WBACON_MEM_DATA) : NULL;
+        tm->design = *reg ? (double*) mem_alloc(&mem, (size_t)*n * q,
+            sizeof(double), WBACON_MEM_DATA) : NULL;
+        tm->center = (double*) mem_alloc(&mem, *p, sizeof(double),
+            WBACON_MEM_WORK_PP);
+        tm->scatter = (double*) mem_alloc(&mem, *p * *p, sizeof(double),
+            WBACON_MEM_WORK_PP);
+        tm->beta = (double*) mem_alloc(&mem, q, sizeof(double),
+            WBACON_MEM_WORK_PP);
+        tm->dist = (double*) mem_alloc(&mem, *n, sizeof(double),
+            WBACON_MEM_WORK_N);
+        tm->resid = (double*) mem_alloc(&mem, *n, sizeof(double),
+            WBACON_MEM_WORK_N);
+        tm->subset = (int*) mem_alloc(&mem, *n, sizeof(int),
+            WBACON_MEM_SUBSET);
+        for (int k = 0; k < WBACON_MEMORY_LEN; k++)
+            tm->memory[k] = 0.0;
+        tm->acc = (sim_accum*) Calloc(n_scen, sim_accum);
+        tm->failed = 0;
+    }
+
+    // cutoffs by alpha (master thread; R's qchisq and qt are not called by
+    // the threads): chi-square quantiles of wbacon and, for wbacon_reg, the
+    // t-quantiles by the size of the subset, m = 0, ..., n (see Algorithm 5
+    // in wbacon_reg.c)
+    double *chi2 = (double*) mem_alloc(&mem, *n_alpha, sizeof(double),
+        WBACON_MEM_WORK_N);
+    double *t_quantile = *reg ? (double*) mem_alloc(&mem,
+        (size_t)*n_alpha * (*n + 1), sizeof(double), WBACON_MEM_WORK_N) : NULL;
+    for (int a = 0; a < *n_alpha; a++) {
+        chi2[a] = qchisq(alpha[a] / (double)*n, (double)*p, 0, 0);
+        if (!*reg)
+            continue;
+        double *tq = t_quantile + (size_t)a * (*n + 1);
+        for (int m = 0; m <= *n; m++)
+            tq[m] = qt(alpha[a] / (double)(2 * (m + 1)), m - q, 0, 0);
+    }
+
+    // BLAS runs on one thread (the engines do not control BLAS in the
+    // parallel region)
+    wbacon_threads blas;
+    threads_begin(&blas);
+    threads_blas(&blas, 1);
+
+    #pragma omp parallel num_threads(n_teams)
+    {
+        int t = 0;
+        #ifdef _OPENMP
+        t = omp_get_thread_num();
+        #endif
+        wbacon_stream stream;
+
+        #pragma omp for schedule(dynamic)
+        for (int k = 0; k < n_tasks; k++) {
+            int e = k / *replicates, r = k % *replicates;
+            int n_bad = (int)floor(eps[e] * (double)*n);
+            stream_begin(&stream, *seed, r);
+            generate(&stream, team + t, *n, *p, n_bad, *reg);
+
+            for (int c = 0; c < *n_collect; c++) {
+                for (int a = 0; a < *n_alpha; a++) {
+                    int s = e + *n_eps * (a + *n_alpha * c);
+                    replicate(team + t, w, *n, *p, n_bad, alpha[a], chi2[a],
+                        *reg ? t_quantile + (size_t)a * (*n + 1) : NULL,
+                        collect[c], *version2, *reg, *maxiter, cost,
+                        team[t].acc + s);
+                }
+            }
+        }
+    }
+    threads_end(&blas);
+
+    // merge the accumulators of the threads (into those of thread 0) and the
+    // peak working sets of the engines
+    for (int t = 1; t < n_teams; t++) {
+        for (int s = 0; s < n_scen; s++) {
+            sim_accum *to = team[0].acc + s, *from = team[t].acc + s;
+            to->converged += from->converged;
+            for (int k = 0; k < WBACON_SIM_COUNT; k++) {
+                to->sum[k] += from->sum[k];
+                to->sum2[k] += from->sum2[k];
+                if (from->max[k] > to->max[k])
+                    to->max[k] = from->max[k];
+            }
+        }
+        for (int k = 0; k < WBACON_MEMORY_LEN; k++)
+            if (team[t].memory[k] > team[0].memory[k])
+                team[0].memory[k] = team[t].memory[k];
+        team[0].failed += team[t].failed;
+    }
+    int failed = team[0].failed;
+
+    for (int e = 0; e < *n_eps; e++) {
+        int n_bad = (int)floor(eps[e] * (double)*n);
+        for (int s = e; s < n_scen; s += *n_eps)
+            summarize(team[0].acc + s, *n, n_bad, n_scen, result + s);
+    }
+
+    // peak working set: the buffers and, per thread, the largest call of an
+    // engine
+    double engines[WBACON_MEMORY_LEN];
+    Memcpy(engines, team[0].memory, WBACON_MEMORY_LEN);
+    for (int t = 0; t < n_teams; t++) {
+        sim_team *tm = team + t;
+        mem_free(tm->x);
+        mem_free(tm->y);
+        mem_free(tm->design);
+        mem_free(tm->center);
+        mem_free(tm->scatter);
+        mem_free(tm->beta);
+        mem_free(tm->dist);
+        mem_free(tm->resid);
+        mem_free(tm->subset);
+        Free(tm->acc);
+    }
+    Free(team);
+    mem_free(chi2);
+    mem_free(t_quantile);
+    mem_free(w);
+    mem_end(&mem, memory);
+    for (int k = 0; k < WBACON_MEMORY_LEN; k++)
+        memory[k] += (double)n_teams * engines[k];
+
+    if (failed > 0)
+        error("%s (%d calls of the engines)\n",
+            wbacon_error(WBACON_ERROR_MEMORY), failed);
+}
+
+/******************************************************************************\
+|* a replicate of a scenario: the engine(s) and the criteria                  *|
+|*  tm         data and results, typedef struct sim_team                      *|
+|*  w          weights, array[n]                                              *|
+|*  n, p       dimensions                                                     *|
+|*  n_bad      number of outliers (the first n_bad rows)                      *|
+|*  alpha, collect, version2, reg, maxiter   see wbacon_simulate              *|
+|*  chi2       quantile qchisq(alpha / n, p) (see wbacon_fit)                 *|
+|*  t_quantile cutoffs of wbacon_reg by the size of the subset, array[n + 1]  *|
+|*             (see wbacon_reg_fit); NULL if reg = 0                          *|
+|*  acc        accumulators of the scenario, typedef struct sim_accum         *|
+|* NOTE: a call of an engine that could not allocate its work arrays counts   *|
+|*       in tm->failed (and not as a replicate)                               *|
+\******************************************************************************/
+static void replicate(sim_team *tm, double *w, int n, int p, int n_bad,
+    double alpha, double chi2, const double *t_quantile, int collect,
+    int version2, int reg, int maxiter, double *cost, sim_accum *acc)
+{
+    int threads = 1, verbose = 0, cached = 0, trace_len = 0, resume = 0;
+    int mode = WBACON_PLAN_AUTO, success, stop, iter = maxiter;
+    double cutoff, budget = 0.0, trace = 0.0, mem[WBACON_MEMORY_LEN];
+    char *checkpoint = "";
+
+    for (int i = 0; i < n; i++)
+        tm->subset[i] = 0;
+    wbacon_error_type status = wbacon_fit(tm->x, w, tm->center, tm->scatter,
+        tm->dist, &n, &p, &alpha, tm->subset, &cutoff, &iter, &verbose,
+        &version2, &collect, &success, &threads, NULL, NULL, &cached, &trace,
+        &trace_len, mem, &mode, cost, &budget, &stop, &checkpoint, &resume,
+        chi2);
+    for (int k = 0; k < WBACON_MEMORY_LEN; k++)
+        if (mem[k] > tm->memory[k])
+            tm->memory[k] = mem[k];
+    tm->failed += status == WBACON_ERROR_MEMORY;
+    if (!success)
+        return;
+
+    // regression on the design matrix [1, x] (see wBACON_reg)
+    if (reg) {
+        int q = p + 1, m = 0, original = 0;
+        int collect_reg = collect < n / q ? collect : n / q;
+        for (int i = 0; i < n; i++) {
+            tm->design[i] = 1.0;
+            m += tm->subset[i];
+        }
+        Memcpy(tm->design + n, tm->x, (size_t)n * p);
+        iter = maxiter;
+        status = wbacon_reg_fit(tm->design, tm->y, w, tm->resid, tm->beta,
+            tm->subset, tm->dist, &n, &q, &m, &verbose, &success,
+            &collect_reg, &alpha, &iter, &original, &threads, &trace,
+            &trace_len, mem, &mode, &budget, &stop, &checkpoint, &resume,
+            t_quantile);
+        for (int k = 0; k < WBACON_MEMORY_LEN; k++)
+            if (mem[k] > tm->memory[k])
+                tm->memory[k] = mem[k];
+        tm->failed += status == WBACON_ERROR_MEMORY;
+        if (!success)
+            return;
+    }
+
+    // criteria (the obs. that are not in the final subset are nominated as
+    // outliers)
+    int64_t count[WBACON_SIM_COUNT];
+    int missed = 0, swamped = 0;
+    for (int i = 0; i < n_bad; i++)
+        missed += tm->subset[i];
+    for (int i = n_bad; i < n; i++)
+        swamped += !tm->subset[i];
+    count[WBACON_SIM_MASKING] = missed;
+    count[WBACON_SIM_SWAMPING] = swamped;
+    count[WBACON_SIM_OUT] = n_bad - missed + swamped;
+    count[WBACON_SIM_TRUEOUT] = n_bad - missed;
+    count[WBACON_SIM_ITERATIONS] = iter;
+
+    acc->converged++;
+    for (int k = 0; k < WBACON_SIM_COUNT; k++) {
+        acc->sum[k] += count[k];
+        acc->sum2[k] += count[k] * count[k];
+        if (count[k] > acc->max[k])
+            acc->max[k] = count[k];
+    }
+}
+
+/******************************************************************************\
+|* summary of a scenario                                                      *|
+|*  acc        accumulators, typedef struct sim_accum                         *|
+|*  n          dimension                                                      *|
+|*  n_bad      number of outliers                                             *|
+|*  n_scen     number of scenarios (leading dimension of 'result')            *|
+|*  result     on return: row of the scenario; see wbacon_simulate.h          *|
+\******************************************************************************/
+static void summarize(sim_accum *acc, int n, int n_bad, int n_scen,
+    double *result)
+{
+    // denominators of the rates (Out and TrueOut as in Billor et al., 2000)
+    double den[WBACON_SIM_COUNT];
+    double reference = n_bad > 0 ? (double)n_bad : (double)n;
+    den[WBACON_SIM_MASKING] = (double)n_bad;
+    den[WBACON_SIM_SWAMPING] = (double)(n - n_bad);
+    den[WBACON_SIM_OUT] = reference;
+    den[WBACON_SIM_TRUEOUT] = reference;
+    den[WBACON_SIM_ITERATIONS] = 1.0;
+
+    double r = (double)acc->converged, mean, var;
+    result[0] = r;
+    for (int k = 0; k < WBACON_SIM_COUNT; k++) {
+        double *res = result + (size_t)n_scen * (1 + 3 * k);
+        if (acc->converged == 0 || den[k] == 0.0) {
+            res[0] = NA_REAL;
+            res[n_scen] = NA_REAL;
+            res[2 * n_scen] = NA_REAL;
+            continue;
+        }
+        mean = (double)acc->sum[k] / r;
+        res[0] = mean / den[k];
+        if (acc->converged > 1) {
+            var = ((double)acc->sum2[k] - mean * (double)acc->sum[k])
+                / (r - 1.0);
+            res[n_scen] = sqrt(fmax(var, 0.0)) / den[k];
+        } else {
+            res[n_scen] = NA_REAL;
+        }
+        res[2 * n_scen] = (double)acc->max[k] / den[k];
+    }
+}
+
+/******************************************************************************\
+|* sample of a replicate                                                      *|
+|*  s          random number stream, typedef struct wbacon_stream             *|
+|*  tm         on return: x (and y), typedef struct sim_team                  *|
+|*  n, p       dimensions                                                     *|
+|*  n_bad      number of outliers (the first n_bad rows)                      *|
+|*  reg        1: the response is generated; 0: not                           *|
+|* NOTE: the variates are drawn by rows; hence, the rows of the outliers and  *|
+|*       of the good obs. share the variates across the values of epsilon    *|
+\******************************************************************************/
+static void generate(wbacon_stream *s, sim_team *tm, int n, int p, int n_bad,
+    int reg)
+{
+    double* restrict x = tm->x;
+    for (int i = 0; i < n; i++) {
+        double shift = i < n_bad ? WBACON_SIM_SHIFT_X : 0.0, sum = 1.0;
+        for (int j = 0; j < p; j++) {
+            x[i + n * j] = stream_norm(s) + shift;
+            sum += x[i + n * j];
+        }
+        if (reg)
+            tm->y[i] = sum + stream_norm(s) + (i < n_bad ? WBACON_SIM_SHIFT_Y
+                : 0.0);
+    }
+}
+
+// the stream of replicate r starts at a bijective hash of (seed, r)
+static void stream_begin(wbacon_stream *s, int seed, int r)
+{
+    s->state = stream_mix(((uint64_t)(uint32_t)seed << 32) | (uint32_t)r);
+    s->has_spare = 0;
+}
+
+// finalizer of splitmix64 (a bijection)
+static inline uint64_t stream_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Gaussian variate (Box-Muller; the uniforms are in (0, 1))
+static inline double stream_norm(wbacon_stream *s)
+{
+    if (s->has_spare) {
+        s->has_spare = 0;
+        return s->spare;
+    }
+    s->state += _STREAM_GAMMA;
+    double u1 = ((double)(stream_mix(s->state) >> 11) + 0.5) * _STREAM_UNIT;
+    s->state += _STREAM_GAMMA;
+    double u2 = ((double)(stream_mix(s->state) >> 11) + 0.5) * _STREAM_UNIT;
+    double radius = sqrt(-2.0 * log(u1)), theta = 2.0 * M_PI * u2;
+    s->spare = radius * sin(theta);
+    s->has_spare = 1;
+    return radius * cos(theta);
+}
@@ -0,0 +1,45 @@
+#include <R.h>
+#include <stdint.h>
+#include "wbacon.h"
+#include "wbacon_reg.h"
+#include "wbacon_memory.h"
+#include "wbacon_threads.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WBACON_SIMULATE_H
+#define _WBACON_SIMULATE_H
+
+#define WBACON_SIM_SHIFT_X 4.0      // location of the outliers: N(4, I_p)
+#define WBACON_SIM_SHIFT_Y 10.0     // shift of the response of the outliers
+
+// criteria of a replicate (counts; the rates divide by the denominators)
+typedef enum wbacon_sim_enum {
+    WBACON_SIM_MASKING = 0,         // outliers not nominated / outliers
+    WBACON_SIM_SWAMPING,            // good obs. nominated / good obs.
+    WBACON_SIM_OUT,                 // nominated obs. / reference
+    WBACON_SIM_TRUEOUT,             // outliers nominated / reference
+    WBACON_SIM_ITERATIONS,          // number of iterations
+    WBACON_SIM_COUNT                // [not an actual criterion]
+} wbacon_sim_type;
+
+// the summary of a scenario is a row of an array[n_scenarios,
+// WBACON_SIM_COLS] of the caller:
+//   [0]                            number of converged replicates
+//   [1 + 3 * k, 2 + 3 * k, 3 + 3 * k]  mean, sd, and max of criterion k
+//                                  (over the converged replicates)
+#define WBACON_SIM_COLS (1 + 3 * WBACON_SIM_COUNT)
+
+// random number stream of a replicate
+typedef struct wbacon_stream_struct {
+    uint64_t state;
+    int has_spare;                  // 1: 'spare' holds a Gaussian variate
+    double spare;
+} wbacon_stream;
+
+// declarations
+void wbacon_simulate(int*, int*, double*, int*, double*, int*, int*, int*,
+    int*, int*, int*, int*, int*, int*, double*, double*, double*);
+#endif
@@ -0,0 +1,224 @@
+/* Threads of BLAS: detection of the library and coordination with OpenMP
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Note:       The BLAS library is detected by the symbols of its thread
+               control in the global namespace of the process (R loads
+               libRblas or an external BLAS with global symbols). In every
+               phase of the engines, either BLAS or the loops of the package
+               run in parallel (not both): a multithreaded BLAS whose
+               threads spin after a call competes with the threads of the
+               OpenMP team of the next loop (oversubscription), and a BLAS
+               built with OpenMP nests its region in ours. The engines set
+               BLAS to 1 thread at the beginning of a call (threads_begin),
+               give BLAS the threads in the phases where BLAS does the work
+               (threads_blas), and restore the threads of BLAS at the end
+               (threads_end). The thread control of OpenBLAS (OpenMP build)
+               changes the max. number of threads of OpenMP; it is restored.
+               On Windows, the BLAS is not controlled. An engine that is
+               called from a parallel region (e.g., by wbacon_simulate) does
+               not control BLAS; the caller of the region sets BLAS to 1
+               thread.
+*/
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE                 // RTLD_DEFAULT (glibc)
+#endif
+#include "wbacon_threads.h"
+#if !defined(_WIN32)
+    #include <dlfcn.h>
+    #include <stdint.h>
+    #define WBACON_DLSYM 1
+#else
+    #define WBACON_DLSYM 0
+#endif
+
+// names of the libraries
+const char* const WBACON_BLAS_STRINGS[] = {
+    "unknown",
+    "flexiblas",
+    "openblas",
+    "mkl",
+    "blis"
+};
+
+// thread control of the detected library (NULL: not controlled)
+static int blas_detected = 0;
+static wbacon_blas_type blas_type = WBACON_BLAS_UNKNOWN;
+static int (*blas_get)(void) = NULL;
+static void (*blas_set)(int) = NULL;
+// threads of BLAS in the phase that is running (1: the loops of the package
+// may run in parallel)
+static int blas_active = 1;
+
+#if WBACON_DLSYM
+// BLIS: the number of threads is of type dim_t (64-bit integer by default)
+static int64_t (*blis_get)(void) = NULL;
+static void (*blis_set)(int64_t) = NULL;
+static int blis_get_threads(void)
+{
+    return (int)blis_get();
+}
+static void blis_set_threads(int threads)
+{
+    blis_set((int64_t)threads);
+}
+
+// look up a symbol in the global namespace (POSIX idiom of the cast of the
+// return value of dlsym to a function pointer)
+#define _LOOKUP(_fn, _name) *(void**)(&(_fn)) = dlsym(RTLD_DEFAULT, _name)
+#endif
+
+/******************************************************************************\
+|* detect the BLAS library by its thread control (once)                       *|
+|* Return value: typedef enum wbacon_blas_type                                *|
+|* NOTE: FlexiBLAS is tried first because it wraps the other libraries        *|
+\******************************************************************************/
+wbacon_blas_type blas_detect(void)
+{
+    if (blas_detected)
+        return blas_type;
+    blas_detected = 1;
+
+    #if WBACON_DLSYM
+    _LOOKUP(blas_get, "flexiblas_get_num_threads");
+    _LOOKUP(blas_set, "flexiblas_set_num_threads");
+    if (blas_get != NULL && blas_set != NULL) {
+        blas_type = WBACON_BLAS_FLEXIBLAS;
+        return blas_type;
+    }
+    _LOOKUP(blas_get, "openblas_get_num_threads");
+    _LOOKUP(blas_set, "openblas_set_num_threads");
+    if (blas_get != NULL && blas_set != NULL) {
+        blas_type = WBACON_BLAS_OPENBLAS;
+        return blas_type;
+    }
+    _LOOKUP(blas_get, "MKL_Get_Max_Threads");
+    _LOOKUP(blas_set, "MKL_Set_Num_Threads");
+    if (blas_get != NULL && blas_set != NULL) {
+        blas_type = WBACON_BLAS_MKL;
+        return blas_type;
+    }
+    _LOOKUP(blis_get, "bli_thread_get_num_threads");
+    _LOOKUP(blis_set, "bli_thread_set_num_threads");
+    if (blis_get != NULL && blis_set != NULL) {
+        blas_get = blis_get_threads;
+        blas_set = blis_set_threads;
+        blas_type = WBACON_BLAS_BLIS;
+        return blas_type;
+    }
+    #endif
+
+    blas_get = NULL;
+    blas_set = NULL;
+    blas_type = WBACON_BLAS_UNKNOWN;
+    return blas_type;
+}
+#if WBACON_DLSYM
+#undef _LOOKUP
+#endif
+
+// obtain the name of a library
+const char* blas_name(wbacon_blas_type type)
+{
+    if (type >= WBACON_BLAS_COUNT)
+        return NULL;
+    else
+        return WBACON_BLAS_STRINGS[type];
+}
+
+// set the threads of BLAS (the max. number of threads of OpenMP is kept)
+static void blas_set_threads(int threads)
+{
+    #ifdef _OPENMP
+    int omp_threads = omp_get_max_threads();
+    #endif
+    blas_set(threads);
+    #ifdef _OPENMP
+    if (omp_get_max_threads() != omp_threads)
+        omp_set_num_threads(omp_threads);
+    #endif
+}
+
+/******************************************************************************\
+|* begin a call of an engine: the threads of BLAS are saved and set to 1      *|
+|*  thr     typedef struct wbacon_threads                                     *|
+\******************************************************************************/
+void threads_begin(wbacon_threads *thr)
+{
+    thr->saved = 0;
+    thr->current = 0;
+    #ifdef _OPENMP
+    if (omp_in_parallel())
+        return;
+    #endif
+    if (blas_detect() == WBACON_BLAS_UNKNOWN)
+        return;
+
+    thr->saved = blas_get();
+    thr->current = thr->saved;
+    threads_blas(thr, 1);
+}
+
+/******************************************************************************\
+|* threads of BLAS in a phase                                                 *|
+|*  thr     typedef struct wbacon_threads                                     *|
+|*  threads number of threads of BLAS; 1: the loops of the package run in    *|
+|*          parallel; <= 0: not changed                                       *|
+\******************************************************************************/
+void threads_blas(wbacon_threads *thr, int threads)
+{
+    if (thr == NULL || thr->saved == 0 || threads <= 0
+            || threads == thr->current)
+        return;
+
+    blas_set_threads(threads);
+    thr->current = threads;
+    blas_active = threads;
+}
+
+/******************************************************************************\
+|* end a call of an engine: the threads of BLAS are restored                  *|
+|*  thr     typedef struct wbacon_threads                                     *|
+\******************************************************************************/
+void threads_end(wbacon_threads *thr)
+{
+    if (thr->saved == 0)                // BLAS is not controlled
+        return;
+    if (thr->saved > 0 && thr->current != thr->saved)
+        blas_set_threads(thr->saved);
+    thr->current = thr->saved;
+    blas_active = 1;
+}
+
+// threads of BLAS in the phase that is running (the loops of a phase in which
+// BLAS runs in parallel are not parallelized)
+int threads_blas_active(void)
+{
+    return blas_active;
+}
+
+/******************************************************************************\
+|* detected BLAS library and its number of threads (R entry point)            *|
+|*  type    on return: typedef enum wbacon_blas_type                          *|
+|*  threads on return: number of threads of BLAS (0: not controlled)          *|
+\******************************************************************************/
+void wbacon_blas(int *type, int *threads)
+{
+    *type = (int)blas_detect();
+    *threads = blas_get != NULL ? blas_get() : 0;
+}
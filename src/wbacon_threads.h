@@ -0,0 +1,36 @@
+#include <R.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WBACON_THREADS_H
+#define _WBACON_THREADS_H
+
+// BLAS libraries with a thread control (detected at run time)
+typedef enum wbacon_blas_enum {
+    WBACON_BLAS_UNKNOWN = 0,        // no thread control found (e.g., the
+                                    //   reference BLAS); not controlled
+    WBACON_BLAS_FLEXIBLAS,
+    WBACON_BLAS_OPENBLAS,
+    WBACON_BLAS_MKL,
+    WBACON_BLAS_BLIS,
+    WBACON_BLAS_COUNT               // [not an actual library]
+} wbacon_blas_type;
+
+// threads of BLAS during a call of an engine
+typedef struct wbacon_threads_struct {
+    int saved;                      // threads of BLAS before threads_begin
+                                    //   (0: not controlled)
+    int current;                    // threads of BLAS in the current phase
+} wbacon_threads;
+
+// declarations
+wbacon_blas_type blas_detect(void);
+const char* blas_name(wbacon_blas_type);
+void threads_begin(wbacon_threads*);
+void threads_blas(wbacon_threads*, int);
+void threads_end(wbacon_threads*);
+int threads_blas_active(void);
+void wbacon_blas(int*, int*);
+#endif
@@ -0,0 +1,141 @@
+/* Per-phase timing of the engines (wbacon and wbacon_reg)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+*/
+
+#include "wbacon_trace.h"
+
+// names of the phases
+const char* const WBACON_PHASE_STRINGS[] = {
+    "total",
+    "initial_location",
+    "initial_subset",
+    "iteration",
+    "initial_reg",
+    "algorithm_4",
+    "algorithm_4_step",
+    "algorithm_5",
+    "algorithm_5_iteration",
+    "fitwls"
+};
+
+/******************************************************************************\
+|* initialize the trace                                                       *|
+|*  trace   typedef struct wbacon_trace                                       *|
+|*  buf     array[len] of the caller; on return: the header is zero (except   *|
+|*          for the request of the counters, which is kept)                   *|
+|*  len     dimension; if len < WBACON_TRACE_HEADER, the trace is disabled    *|
+\******************************************************************************/
+void trace_init(wbacon_trace *trace, double *buf, int len)
+{
+    trace->enabled = len >= WBACON_TRACE_HEADER;
+    trace->pmu.available = 0;
+    trace->pmu.n_threads = 0;
+    trace->pmu.fd = NULL;
+    if (!trace->enabled)
+        return;
+
+    // the request of the counters is kept as -1 (see trace_open_counters)
+    double request = buf[WBACON_TRACE_COUNTERS - 1];
+    for (int i = 0; i < WBACON_TRACE_HEADER; i++)
+        buf[i] = 0.0;
+    trace->status = buf + WBACON_TRACE_COUNTERS - 1;
+    trace->status[0] = request == 1.0 ? -1.0 : 0.0;
+    trace->time = buf;
+    trace->calls = buf + WBACON_PHASE_COUNT;
+    trace->n_records = buf + 2 * WBACON_PHASE_COUNT;
+    trace->counts = buf + WBACON_TRACE_COUNTERS;
+    trace->records = buf + WBACON_TRACE_HEADER;
+    trace->capacity = (len - WBACON_TRACE_HEADER) / WBACON_TRACE_RECORD;
+}
+
+/******************************************************************************\
+|* open the hardware counters (if requested)                                  *|
+|*  trace   typedef struct wbacon_trace                                       *|
+|* NOTE: the counters are opened for the current number of threads; hence,    *|
+|*       the engines call trace_open_counters after omp_set_num_threads. The  *|
+|*       phases that have begun before (i.e., 'total') count from here on     *|
+\******************************************************************************/
+void trace_open_counters(wbacon_trace *trace)
+{
+    if (!trace->enabled || trace->status[0] != -1.0)
+        return;
+
+    counters_open(&trace->pmu);
+    trace->status[0] = (double)trace->pmu.available;
+    for (int k = 0; k < WBACON_PHASE_COUNT; k++)
+        for (int c = 0; c < WBACON_COUNTER_COUNT; c++)
+            trace->start_count[k][c] = 0.0;
+}
+
+/******************************************************************************\
+|* close the trace (i.e., the hardware counters)                              *|
+|*  trace   typedef struct wbacon_trace                                       *|
+\******************************************************************************/
+void trace_close(wbacon_trace *trace)
+{
+    if (trace->pmu.available)
+        counters_close(&trace->pmu);
+}
+
+/******************************************************************************\
+|* record an iteration (no-op if the trace is disabled or NULL)               *|
+|*  trace    typedef struct wbacon_trace                                      *|
+|*  phase    phase of the iteration; the elapsed time is taken from the last  *|
+|*           call of trace_end for this phase                                 *|
+|*  iter     iteration                                                        *|
+|*  subset0  previous subset, array[n]                                        *|
+|*  subset1  current subset, array[n]                                         *|
+|*  n        dimension                                                        *|
+|* NOTE: the subset size and the number of flipped rows are counted in one    *|
+|*       pass over the subsets; the pass is skipped if the trace is disabled  *|
+\******************************************************************************/
+void trace_iteration(wbacon_trace *trace, wbacon_phase_type phase, int iter,
+    int* restrict subset0, int* restrict subset1, int n)
+{
+    if (trace == NULL || !trace->enabled)
+        return;
+
+    int k = (int)trace->n_records[0];
+    if (k >= trace->capacity) {
+        trace->n_records[1] += 1.0;         // dropped
+        return;
+    }
+
+    int size = 0, flipped = 0;
+    for (int i = 0; i < n; i++) {
+        size += subset1[i];
+        flipped += subset0[i] ^ subset1[i];
+    }
+
+    double *rec = trace->records + k * WBACON_TRACE_RECORD;
+    rec[0] = (double)phase;
+    rec[1] = (double)iter;
+    rec[2] = (double)size;
+    rec[3] = (double)flipped;
+    rec[4] = trace->last[phase];
+    trace->n_records[0] += 1.0;
+}
+
+// obtain the name of a phase
+const char* trace_phase_name(wbacon_phase_type phase)
+{
+    if (phase >= WBACON_PHASE_COUNT)
+        return NULL;
+    else
+        return WBACON_PHASE_STRINGS[phase];
+}
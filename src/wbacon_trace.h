@@ -0,0 +1,114 @@
+#include <R.h>
+#include <time.h>
+#include "wbacon_counters.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WBACON_TRACE_H
+#define _WBACON_TRACE_H
+
+// phases of the engines (the phases of wbacon_reg include the calls of
+// fitwls, hence, the phases may be nested)
+typedef enum wbacon_phase_enum {
+    WBACON_PHASE_TOTAL = 0,
+    WBACON_PHASE_INIT_LOCATION,         // wbacon: initial_location
+    WBACON_PHASE_INIT_SUBSET,           // wbacon: initial_subset
+    WBACON_PHASE_ITERATION,             // wbacon: iterations (Algorithm 3)
+    WBACON_PHASE_REG_INIT,              // wbacon_reg: initial_reg
+    WBACON_PHASE_REG_ALGORITHM4,        // wbacon_reg: algorithm_4
+    WBACON_PHASE_REG_STEP4,             // wbacon_reg: steps of algorithm_4
+    WBACON_PHASE_REG_ALGORITHM5,        // wbacon_reg: algorithm_5
+    WBACON_PHASE_REG_ITERATION5,        // wbacon_reg: iterations of alg. 5
+    WBACON_PHASE_FITWLS,                // wbacon_reg: all calls of fitwls
+    WBACON_PHASE_COUNT                  // [not an actual phase]
+} wbacon_phase_type;
+
+// the trace is stored in an array[len] of the caller:
+//   [0, WBACON_PHASE_COUNT)        elapsed time per phase (seconds)
+//   [WBACON_PHASE_COUNT, 2 * ...)  number of calls per phase
+//   [2 * WBACON_PHASE_COUNT]       number of iteration records
+//   [2 * WBACON_PHASE_COUNT + 1]   number of records dropped (array is full)
+//   [2 * WBACON_PHASE_COUNT + 2]   on entry: 1 requests the hardware counters;
+//                                  on return: bitmask of available counters
+//   [2 * WBACON_PHASE_COUNT + 3,   counters per phase (phase-major), i.e.,
+//    WBACON_TRACE_HEADER)          WBACON_COUNTER_COUNT values per phase
+//   [WBACON_TRACE_HEADER, len)     iteration records (see below)
+#define WBACON_TRACE_COUNTERS (2 * WBACON_PHASE_COUNT + 3)
+#define WBACON_TRACE_HEADER (WBACON_TRACE_COUNTERS + WBACON_PHASE_COUNT \
+    * WBACON_COUNTER_COUNT)
+
+// iteration record: phase, iteration, subset size, number of rows that
+// flipped membership in the subset, elapsed time (seconds)
+#define WBACON_TRACE_RECORD 5
+
+// trace (disabled if len < WBACON_TRACE_HEADER)
+typedef struct wbacon_trace_struct {
+    int enabled;
+    int capacity;                       // max. number of records
+    double *time;
+    double *calls;
+    double *n_records;
+    double *records;
+    double *counts;                     // counters per phase
+    double *status;                     // request/ available counters
+    double start[WBACON_PHASE_COUNT];
+    double last[WBACON_PHASE_COUNT];    // elapsed time of the last call
+    wbacon_counters pmu;                // hardware counters
+    double start_count[WBACON_PHASE_COUNT][WBACON_COUNTER_COUNT];
+} wbacon_trace;
+
+// declarations
+void trace_init(wbacon_trace*, double*, int);
+void trace_open_counters(wbacon_trace*);
+void trace_close(wbacon_trace*);
+void trace_iteration(wbacon_trace*, wbacon_phase_type, int, int* restrict,
+    int* restrict, int);
+const char* trace_phase_name(wbacon_phase_type);
+
+/******************************************************************************\
+|* monotonic wall clock (seconds)                                             *|
+\******************************************************************************/
+static inline double trace_clock(void)
+{
+#if defined(_OPENMP)
+    return omp_get_wtime();
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/******************************************************************************\
+|* begin and end of a phase (no-op if the trace is disabled or NULL)          *|
+|* NOTE: the counters are read outside of the timed interval                  *|
+\******************************************************************************/
+static inline void trace_begin(wbacon_trace *trace, wbacon_phase_type phase)
+{
+    if (trace != NULL && trace->enabled) {
+        if (trace->pmu.available)
+            counters_read(&trace->pmu, trace->start_count[phase]);
+        trace->start[phase] = trace_clock();
+    }
+}
+
+static inline void trace_end(wbacon_trace *trace, wbacon_phase_type phase)
+{
+    if (trace != NULL && trace->enabled) {
+        trace->last[phase] = trace_clock() - trace->start[phase];
+        trace->time[phase] += trace->last[phase];
+        trace->calls[phase] += 1.0;
+        if (trace->pmu.available) {
+            double now[WBACON_COUNTER_COUNT];
+            double *counts = trace->counts + phase * WBACON_COUNTER_COUNT;
+            counters_read(&trace->pmu, now);
+            for (int c = 0; c < WBACON_COUNTER_COUNT; c++)
+                counts[c] += now[c] - trace->start_count[phase][c];
+        }
+    }
+}
+#endif
@@ -1,4 +1,4 @@
-/* weighted quantile and selection of k-th largest element
+/* weighted quantile and selection of k-th smallest element
 
    Copyright (C) 2020 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
 
@@ -22,30 +22,28 @@
    Note:       The extension of the method to weighted problems is ours.
 */
 
-# define _n_quickselect 40  // switch from insertion sort to quickselect
-# define _n_nither 50       // pivotal element determined by ninther
 # define DEBUG_MODE 0       // debug mode (0 = off; 1 = activated)
 
 #include "wquantile.h"
 
-static inline void swap2(double*, double*, int, int)
-    __attribute__((always_inline));
-static inline int med3(double*, int, int, int)
-    __attribute__((always_inline));
-static inline int min(int, int) __attribute__((always_inline));
-static inline int choose_pivot(double*, int, int)
-    __attribute__((always_inline));
 static inline int is_equal(double, double) __attribute__((always_inline));
+static int partition_parallel(wpair* restrict, int, int, double, int, double*);
+static double sum_weights(wpair* restrict, int);
+static void locate_misplaced(int*, int*, int, int, int*, int*);
 
-void partition_3way(double*, double*, int, int, int*, int*);
-double insertionselect(double*, double*, int, int, double);
-void wquant0(double*, double*, double, int, int, double, double*);
+static void partition_multi(wpair* restrict, int, int, int*, int*, int*,
+    double*, double*);
+static inline double max_value(wpair*, int, int) __attribute__((always_inline));
+static void sort_probs(double*, int, double*, int*);
+
+double insertionselect(wpair*, int, int, double);
+void wquant0(wpair*, double, int, int, double, double*);
 
 // debugging tools
 #if DEBUG_MODE
 #include <stdio.h>
 #include <string.h>
-void debug_print_data(double*, double*, int, int, char*);
+void debug_print_data(wpair*, int, int, char*);
 void debug_print_state(int, int);
 #endif
 
@@ -76,232 +74,818 @@ void wquantile(double *array, double *weights, int *n, double *prob,
 |*  n        dimension                                                        *|
 |*  prob     probability defining quantile (0 <= prob <= 1)                   *|
 |*  result   on return: weighted quantile                                     *|
+|* NOTE: 'array' and 'weights' are not modified                               *|
 \******************************************************************************/
 void wquantile_noalloc(double *array, double *weights, double *work, int *n,
     double *prob, double *result)
 {
-    if (is_equal(*prob, 0.0)) {                     // prob = 0.0
-        wselect0(array, weights, 0, *n - 1, 0);
-        *result = array[0];
-    } else if (is_equal(*prob, 1.0)) {              // prob = 1.0
-        wselect0(array, weights, 0, *n - 1, *n - 1);
-        *result = array[*n - 1];
-    } else {
-        // work = [array[0..(n-1)], weights[0..(n-1)]], i.e. 'weights' is
-        // appended to 'array' s.t. we have one contiguous chunk of memory
-        Memcpy(work, array, *n);
-        Memcpy(work + *n, weights, *n);
-        wquant0(work, work + *n, 0.0, 0, *n - 1, *prob, result);
+    // work = [(array[0], weights[0]), (array[1], weights[1]), ...], i.e.,
+    // the data are interleaved s.t. a value and its weight share the same
+    // cache line
+    wpair *a = (wpair*) work;
+    #pragma omp parallel for if(*n > WQUANTILE_OMP_MIN_SIZE)
+    for (int i = 0; i < *n; i++) {
+        a[i].x = array[i];
+        a[i].w = weights[i];
     }
+    wquant_pair(a, *n, *prob, result);
 }
 
 /******************************************************************************\
-|* weighted quantile (recursive function; for internal use)                   *|
+|* weighted quantile of interleaved (value, weight) pairs (in place)          *|
 |*                                                                            *|
-|*  array    array[lo..hi]                                                    *|
-|*  weights  array[lo..hi]                                                    *|
-|*  sum_w    total sum of weights: initialized with 0.0                       *|
-|*  lo       dimension (usually: 0)                                           *|
-|*  hi       dimension (usually: n - 1)                                       *|
+|*  xw       array[2*n], xw = [x[0], w[0], x[1], w[1], ..., x[n-1], w[n-1]]   *|
+|*  n        dimension                                                        *|
 |*  prob     probability defining quantile (0 <= prob <= 1)                   *|
-|*  result   on return: weighted median                                       *|
+|*  result   on return: weighted quantile                                     *|
+|* NOTE: 'xw' is permuted and (some of) its weights are overwritten           *|
+\******************************************************************************/
+void wquantile_inplace(double *xw, int *n, double *prob, double *result)
+{
+    wquant_pair((wpair*) xw, *n, *prob, result);
+}
+
+/******************************************************************************\
+|* weighted quantile of an array of (value, weight) pairs                     *|
 |*                                                                            *|
-|* NOTE:     wquant0 uses a weighted quickselect based on the the 3-way       *|
-|*           partitioning of Bentley & McIlroy's (1993)                       *|
+|*  a        array[n]                                                         *|
+|*  n        dimension                                                        *|
+|*  prob     probability defining quantile (0 <= prob <= 1)                   *|
+|*  result   on return: weighted quantile                                     *|
+|*                                                                            *|
+|* NOTE: for n > WQUANTILE_OMP_MIN_SIZE, the top levels of the weighted       *|
+|*       quickselect are partitioned in parallel (the 3-way partition is      *|
+|*       obtained by two parallel 2-way partitions); the partial sums of      *|
+|*       weight are accumulated per block of WQUANTILE_BLOCK elements (the    *|
+|*       result does not depend on the number of threads). Once the active    *|
+|*       range has less than WQUANTILE_OMP_MIN_SIZE elements (or the scratch  *|
+|*       of the partition cannot be allocated, see mem_scratch), wquant0      *|
+|*       takes over                                                           *|
 \******************************************************************************/
-void wquant0(double *array, double *weights, double sum_w, int lo, int hi,
-    double prob, double *result)
+void wquant_pair(wpair* restrict a, int n, double prob, double *result)
 {
-    #if DEBUG_MODE
-    debug_print_data(array, weights, lo, hi, "init");
-    #endif
+    if (n < 1)
+        return;
 
-    if (hi <= lo)               // case: n = 1
+    if (is_equal(prob, 0.0) || is_equal(prob, 1.0)) {
+        double r = a[0].x;
+        if (is_equal(prob, 0.0)) {                  // prob = 0.0
+            for (int i = 1; i < n; i++)
+                r = a[i].x < r ? a[i].x : r;
+        } else {                                    // prob = 1.0
+            for (int i = 1; i < n; i++)
+                r = a[i].x > r ? a[i].x : r;
+        }
+        *result = r;
         return;
+    }
 
-    if (hi - lo == 1) {         // case: n = 2
-        double one_minus = 1.0 - prob;
+    if (n <= WQUANTILE_OMP_MIN_SIZE) {
+        wquant0(a, 0.0, 0, n - 1, prob, result);
+        return;
+    }
 
-        if (is_equal(one_minus * weights[lo], prob * weights[hi]))
-            *result = (array[lo] + array[hi]) / 2.0;
-        else if (one_minus * weights[lo] > prob * weights[hi])
-            *result = array[lo];
-        else
-            *result = array[hi];
+    double sum_w = sum_weights(a, n);
 
-        return;
+    int i, j, lo = 0, hi = n - 1, depth = select_depth_limit(n);
+    double pivot, sum_w_lo, sum_w_eq, sum_w_hi;
+    while (hi - lo + 1 > WQUANTILE_OMP_MIN_SIZE && depth-- > 0) {
+        pivot = a[select_pivot_pair(a, lo, hi)].x;
+
+        // a[lo..(j-1)] < pivot, a[j..(i-1)] = pivot, a[i..hi] > pivot
+        j = partition_parallel(a, lo, hi, pivot, 0, &sum_w_lo);
+        i = j < 0 ? -1 : partition_parallel(a, j, hi, pivot, 1, &sum_w_eq);
+        if (i < 0)              // no scratch: wquant0 takes over on a[lo..hi]
+            break;
+        sum_w_hi = sum_w - sum_w_lo - sum_w_eq;
+
+        // termination criterion (see wquant0)
+        if (sum_w_lo < prob * sum_w && sum_w_hi < (1.0 - prob) * sum_w) {
+            *result = pivot;
+            return;
+        }
+
+        // iterate only on the partitioning with larger sum of weights
+        if ((1 - prob) * sum_w_lo > prob * sum_w_hi) {
+            a[j].w = sum_w - sum_w_lo;      // weight is dumped
+            hi = j;
+        } else {
+            a[i - 1].w = sum_w - sum_w_hi;  // weight is dumped
+            lo = i - 1;
+        }
     }
+    wquant0(a, sum_w, lo, hi, prob, result);
+}
+
+/******************************************************************************\
+|* peak scratch of wquant_pair (bytes)                                        *|
+|*  n          dimension                                                      *|
+\******************************************************************************/
+double wquant_pair_scratch(int n)
+{
+    if (n <= WQUANTILE_OMP_MIN_SIZE)
+        return 0.0;
+    // partition_parallel (the blocks of sum_weights need less)
+    int n_blocks = (n + WQUANTILE_BLOCK - 1) / WQUANTILE_BLOCK;
+    return (double)n_blocks * (5 * sizeof(int) + sizeof(double));
+}
+
+/******************************************************************************\
+|* weighted quantile (iterative function; for internal use)                   *|
+|*                                                                            *|
+|*  a        array[lo..hi] of (value, weight) pairs                           *|
+|*  sum_w    total sum of weights: initialized with 0.0                       *|
+|*  lo       dimension (usually: 0)                                           *|
+|*  hi       dimension (usually: n - 1)                                       *|
+|*  prob     probability defining quantile (0 <= prob <= 1)                   *|
+|*  result   on return: weighted median                                       *|
+|*                                                                            *|
+|* NOTE:     wquant0 uses a weighted introselect based on the 3-way           *|
+|*           partitioning of selection.c; the weight of the part of the array *|
+|*           that is discarded is dumped on the pivot                         *|
+\******************************************************************************/
+void wquant0(wpair *a, double sum_w, int lo, int hi, double prob,
+    double *result)
+{
+    if (hi < lo)
+        return;
 
     if (sum_w < DBL_EPSILON) {  // sum_w is only computed at initialization
         for (int k = lo; k <= hi; ++k)
-            sum_w += weights[k];
+            sum_w += a[k].w;
     }
 
-    // case: n <= _n_quickselect
-    if (hi - lo + 1 <= _n_quickselect) {
-        *result = insertionselect(array, weights, lo, hi, prob);
-        return;
-    }
+    int i, j, depth = select_depth_limit(hi - lo + 1);
+    int size = hi - lo + 1, steps = 0;
+    double sum_w_lo, sum_w_hi;
+    for (;;) {
+        #if DEBUG_MODE
+        debug_print_data(a, lo, hi, "init");
+        #endif
 
-    // case: n > _n_quickselect: weighted quickselect
-    // Bentley-McIlroy's 3-way partitioning (weighted): the positions of the
-    // sentinels 'i' and 'j' are returned
-    int i, j;
-    partition_3way(array, weights, lo, hi, &i, &j);
-
-    // sum of weights of the elements smaller and larger than the pivot
-    // (determined with the help of the sentinels' positions)
-    double sum_w_lo = 0.0, sum_w_hi = 0.0;
-    for (int k = lo; k <= j; ++k)
-        sum_w_lo += weights[k];
-    for (int k = i; k <= hi; ++k)
-        sum_w_hi += weights[k];
-
-    #if DEBUG_MODE
-    debug_print_data(array, weights, lo, hi, "");
-    debug_print_state(i, j);
-    #endif
+        if (hi == lo) {             // case: n = 1
+            *result = a[lo].x;
+            return;
+        }
+
+        if (hi - lo == 1) {         // case: n = 2
+            double one_minus = 1.0 - prob;
+            if (a[lo].x > a[hi].x) {    // order the pair
+                wpair tmp = a[lo];
+                a[lo] = a[hi];
+                a[hi] = tmp;
+            }
+
+            if (is_equal(one_minus * a[lo].w, prob * a[hi].w))
+                *result = (a[lo].x + a[hi].x) / 2.0;
+            else if (one_minus * a[lo].w > prob * a[hi].w)
+                *result = a[lo].x;
+            else
+                *result = a[hi].x;
 
-    // termination criterion: sum of weights on both sides are smaller than 0.5
-    if (sum_w_lo < prob * sum_w && sum_w_hi < (1.0 - prob) * sum_w) {
-        *result = array[j + 1];
-    } else {
-        // recursion only on the partitioning with larger sum of weights
+            return;
+        }
+
+        // case: n <= _n_quickselect
+        if (hi - lo + 1 <= _n_quickselect) {
+            *result = insertionselect(a, lo, hi, prob);
+            return;
+        }
+
+        // case: n > _n_quickselect: weighted quickselect
+        // 3-way partitioning (weighted): the positions of the sentinels 'i'
+        // and 'j' are returned
+        select_partition_pair(a, lo, hi, &depth, &i, &j);
+
+        // sum of weights of the elements smaller and larger than the pivot
+        // (determined with the help of the sentinels' positions)
+        sum_w_lo = 0.0; sum_w_hi = 0.0;
+        for (int k = lo; k <= j; ++k)
+            sum_w_lo += a[k].w;
+        for (int k = i; k <= hi; ++k)
+            sum_w_hi += a[k].w;
+
+        #if DEBUG_MODE
+        debug_print_data(a, lo, hi, "");
+        debug_print_state(i, j);
+        #endif
+
+        // termination criterion: sum of weights on both sides are smaller
+        // than 0.5
+        if (sum_w_lo < prob * sum_w && sum_w_hi < (1.0 - prob) * sum_w) {
+            *result = a[j + 1].x;
+            return;
+        }
+
+        // iterate only on the partitioning with larger sum of weights
         if ((1 - prob) * sum_w_lo > prob * sum_w_hi) {
-            // dump weight of ignored part
-            weights[j + 1] = sum_w - sum_w_lo;
-            wquant0(array, weights, sum_w, lo, j + 1, prob, result);
+            a[j + 1].w = sum_w - sum_w_lo;  // weight is dumped
+            hi = j + 1;
+        } else {
+            a[i - 1].w = sum_w - sum_w_hi;  // weight is dumped
+            lo = i - 1;
         }
-        else {
-            weights[i - 1] = sum_w - sum_w_hi;  // weight is dumped
-            wquant0(array, weights, sum_w, i - 1, hi, prob, result);
+        select_progress(hi - lo + 1, &size, &steps, &depth);
+    }
+}
+
+/******************************************************************************\
+|* weighted quantiles for a vector of probabilities (in place)                *|
+|*                                                                            *|
+|*  xw       array[2*n], xw = [x[0], w[0], x[1], w[1], ..., x[n-1], w[n-1]]   *|
+|*  n        dimension                                                        *|
+|*  probs    probabilities defining the quantiles (0 <= probs <= 1),          *|
+|*           array[n_probs]                                                   *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: weighted quantiles, array[n_probs]                    *|
+|* NOTE: 'xw' is permuted                                                     *|
+\******************************************************************************/
+void wquantile_multi(double *xw, int *n, double *probs, int *n_probs,
+    double *result)
+{
+    int m = *n_probs;
+    if (m < 1)
+        return;
+
+    // sort the probabilities in ascending order
+    int *order = (int*) Calloc(m, int);
+    double *sorted = (double*) Calloc(2 * m, double);
+    wqrange *stack = (wqrange*) Calloc(m, wqrange);
+    sort_probs(probs, m, sorted, order);
+
+    wquant_multi((wpair*) xw, *n, sorted, m, sorted + m, stack);
+    for (int q = 0; q < m; q++)
+        result[order[q]] = sorted[m + q];
+
+    Free(order); Free(sorted); Free(stack);
+}
+
+/******************************************************************************\
+|* weighted quantiles by group                                                *|
+|*                                                                            *|
+|*  x        data, array[n]                                                   *|
+|*  w        weights, array[n]                                                *|
+|*  group    group index (1 <= group <= n_groups), array[n]                   *|
+|*  n        dimension                                                        *|
+|*  n_groups number of groups                                                 *|
+|*  probs    probabilities defining the quantiles (0 <= probs <= 1),          *|
+|*           array[n_probs]                                                   *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: weighted quantiles, array[n_groups, n_probs]; NA for  *|
+|*           empty groups                                                     *|
+|*                                                                            *|
+|* NOTE: the data are sorted by group (counting sort) into one buffer of      *|
+|*       (value, weight) pairs; then, the multi-select (wquant_multi) is run  *|
+|*       for every group. The groups are distributed over the threads with    *|
+|*       dynamic scheduling because the group sizes may differ a lot          *|
+\******************************************************************************/
+void wquantile_grouped(double *x, double *w, int *group, int *n,
+    int *n_groups, double *probs, int *n_probs, double *result)
+{
+    int n_obs = *n, n_grp = *n_groups, m = *n_probs;
+    if (n_grp < 1 || m < 1)
+        return;
+
+    // counting sort by group: group g is a[offset[g]..(offset[g + 1] - 1)]
+    int *offset = (int*) Calloc(2 * n_grp + 1, int);
+    int *at = offset + n_grp + 1;
+    for (int i = 0; i < n_obs; i++)
+        offset[group[i]]++;
+    for (int g = 0; g < n_grp; g++) {
+        offset[g + 1] += offset[g];
+        at[g] = offset[g];
+    }
+    wpair *a = (wpair*) Calloc(n_obs, wpair);
+    for (int i = 0; i < n_obs; i++) {
+        int k = at[group[i] - 1]++;
+        a[k].x = x[i];
+        a[k].w = w[i];
+    }
+
+    // sort the probabilities in ascending order
+    int *order = (int*) Calloc(m, int);
+    double *sorted = (double*) Calloc(m, double);
+    sort_probs(probs, m, sorted, order);
+
+    // work arrays per thread
+    int n_threads = 1;
+    #ifdef _OPENMP
+    if (n_obs > WQUANTILE_GROUPED_OMP_MIN_SIZE)
+        n_threads = omp_get_max_threads();
+    #endif
+    wqrange *stack = (wqrange*) Calloc(n_threads * m, wqrange);
+    double *res = (double*) Calloc(n_threads * m, double);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic)
+    for (int g = 0; g < n_grp; g++) {
+        int thread = 0;
+        #ifdef _OPENMP
+        thread = omp_get_thread_num();
+        #endif
+        double *r = res + thread * m;
+        int size = offset[g + 1] - offset[g];
+        if (size == 0) {
+            for (int q = 0; q < m; q++)
+                result[g + n_grp * q] = NA_REAL;
+            continue;
         }
+        wquant_multi(a + offset[g], size, sorted, m, r, stack + thread * m);
+        for (int q = 0; q < m; q++)
+            result[g + n_grp * order[q]] = r[q];
+    }
+
+    Free(offset); Free(a); Free(order); Free(sorted); Free(stack); Free(res);
+}
+
+/******************************************************************************\
+|* sort the columns of a matrix (sorted-order cache)                          *|
+|*                                                                            *|
+|*  x        data, array[n, p]                                                *|
+|*  n, p     dimensions                                                       *|
+|*  sorted   on return: columns of x sorted in ascending order, array[n, p]   *|
+|*  perm     on return: permutation (0-based), such that                      *|
+|*           sorted[i, j] = x[perm[i, j], j], array[n, p]                     *|
+\******************************************************************************/
+void wquantile_sort(double *x, int *n, int *p, double *sorted, int *perm)
+{
+    int n_obs = *n, n_col = *p;
+    #pragma omp parallel for schedule(dynamic) \
+        if((double)n_obs * n_col > WQUANTILE_CACHE_OMP_MIN_SIZE)
+    for (int j = 0; j < n_col; j++) {
+        Memcpy(sorted + n_obs * j, x + n_obs * j, n_obs);
+        for (int i = 0; i < n_obs; i++)
+            perm[n_obs * j + i] = i;
+        select_sort_indx(sorted + n_obs * j, perm + n_obs * j, 0, n_obs - 1);
     }
 }
 
 /******************************************************************************\
-|* select the k-th largest element (with weights; for internal use)           *|
+|* weighted quantiles from the sorted-order cache                             *|
 |*                                                                            *|
-|*  array   array[lo..hi]                                                     *|
-|*  weights array[lo..hi]                                                     *|
-|*  lo      dimension (usually: 0)                                            *|
-|*  hi      dimension (usually: n - 1)                                        *|
-|*  k       integer in 0:(n - 1)                                              *|
+|*  sorted   sorted columns, array[n, p] (see wquantile_sort)                 *|
+|*  perm     permutation, array[n, p] (see wquantile_sort)                    *|
+|*  n, p     dimensions                                                       *|
+|*  w        weights (one column per weight vector), array[n, n_rep]         *|
+|*  n_rep    number of weight vectors                                         *|
+|*  probs    probabilities defining the quantiles (0 <= probs <= 1),          *|
+|*           array[n_probs]                                                   *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: weighted quantiles, array[p, n_probs, n_rep]          *|
 |*                                                                            *|
-|* NOTE     wselect0 sorts 'array' partially, such that element 'k' is in its *|
-|*          final (sorted) position => array[k] gives the k-th largest element*|
+|* NOTE: the columns are not sorted again; for every column and weight        *|
+|*       vector, the weights are gathered in sorted order and the cumulative  *|
+|*       sum is scanned once (see wquant_sorted)                              *|
 \******************************************************************************/
-void wselect0(double *array, double *weights, int lo, int hi, int k)
+void wquantile_cached(double *sorted, int *perm, int *n, int *p, double *w,
+    int *n_rep, double *probs, int *n_probs, double *result)
 {
-    if (hi <= lo)       // case: n = 1
+    int n_obs = *n, n_col = *p, n_w = *n_rep, m = *n_probs;
+    if (n_obs < 1 || m < 1)
         return;
 
-    // Bentley-McIlroy's 3-way partitioning (weighted): the positions of the
-    // sentinels 'i' and 'j' are returned
-    int i, j;
-    partition_3way(array, weights, lo, hi, &i, &j);
+    // sort the probabilities in ascending order
+    int *order = (int*) Calloc(m, int);
+    double *sorted_probs = (double*) Calloc(m, double);
+    sort_probs(probs, m, sorted_probs, order);
+
+    // total sum of weights (for every weight vector)
+    double *sum_w = (double*) Calloc(n_w, double);
+    for (int r = 0; r < n_w; r++)
+        for (int i = 0; i < n_obs; i++)
+            sum_w[r] += w[n_obs * r + i];
+
+    // work arrays per thread
+    int n_threads = 1;
+    #ifdef _OPENMP
+    if ((double)n_obs * n_col * n_w > WQUANTILE_CACHE_OMP_MIN_SIZE)
+        n_threads = omp_get_max_threads();
+    #endif
+    double *res = (double*) Calloc(n_threads * m, double);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(static)
+    for (int jr = 0; jr < n_col * n_w; jr++) {
+        int j = jr % n_col, r = jr / n_col, thread = 0;
+        #ifdef _OPENMP
+        thread = omp_get_thread_num();
+        #endif
+        double *at = res + thread * m;
+        wquant_sorted(sorted + n_obs * j, perm + n_obs * j, w + n_obs * r,
+            sum_w[r], n_obs, sorted_probs, m, at);
+        for (int q = 0; q < m; q++)
+            result[j + n_col * (order[q] + m * r)] = at[q];
+    }
 
-    // recursion only on the partitioning where element 'k' lies
-    if (k <= j)
-        wselect0(array, weights, lo, j, k);
-    else if (k >= i)
-        wselect0(array, weights, i, hi, k);
+    Free(order); Free(sorted_probs); Free(sum_w); Free(res);
 }
 
 /******************************************************************************\
-|* Bentley and McIlroy's (1993) 3-way partitioning scheme with weights        *|
-|*  array   array[lo..hi]                                                     *|
-|*  weights array[lo..hi]                                                     *|
-|*  lo, hi  dimensions                                                        *|
-|*  i, j    sentinels scanning up and down                                    *|
+|* weighted quantiles of a sorted array                                       *|
+|*                                                                            *|
+|*  sorted   data sorted in ascending order, array[n]                         *|
+|*  perm     permutation, such that sorted[i] belongs to w[perm[i]], array[n] *|
+|*  w        weights (in the original order), array[n]                       *|
+|*  sum_w    total sum of weights (if 0.0, it is computed)                    *|
+|*  n        dimension                                                        *|
+|*  probs    probabilities, sorted in ascending order, array[n_probs]         *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: weighted quantiles, array[n_probs]                    *|
+|*                                                                            *|
+|* NOTE: the weights are gathered in sorted order and their cumulative sum is *|
+|*       scanned once for all probabilities; the result is the same as the   *|
+|*       one of insertionselect (and wquant_multi)                            *|
 \******************************************************************************/
-void partition_3way(double *array, double *weights, int lo, int hi, int *i,
-    int *j)
+void wquant_sorted(double* restrict sorted, int* restrict perm,
+    double* restrict w, double sum_w, int n, double* restrict probs,
+    int n_probs, double* restrict result)
 {
-    // determine pivot and swap it into position 'lo' (i.e., position 0)
-    swap2(array, weights, choose_pivot(array, lo, hi), lo);
-    double pivot = array[lo];
+    if (n < 1)
+        return;
 
-    // Bentley-McIlroy's 3-way partitioning weighted with sentinels i and j,
-    // respectively, scanning up and down until they cross; elements equal to
-    // the pivot are swapped to the far left and right,
+    if (sum_w < DBL_EPSILON) {
+        for (int i = 0; i < n; i++)
+            sum_w += w[i];
+    }
 
-    int p = lo, q = hi + 1;
-    *i = lo; *j = hi + 1;               // initialize the sentinels
+    int k = 0;
+    double cumsum = 0.0, prob;
+    for (int q = 0; q < n_probs; q++) {
+        prob = probs[q];
+        if (is_equal(prob, 0.0)) {                  // prob = 0.0
+            result[q] = sorted[0];
+            continue;
+        }
+        if (is_equal(prob, 1.0)) {                  // prob = 1.0
+            result[q] = sorted[n - 1];
+            continue;
+        }
 
-    for (;;) {
-        while (array[++(*i)] < pivot)
-        if (*i == hi)
-            break;
+        while (k < n - 1 && cumsum + w[perm[k]] <= prob * sum_w)
+            cumsum += w[perm[k++]];
 
-        while (pivot < array[--(*j)])
+        if (k > 0 && is_equal((1.0 - prob) * cumsum, prob * (sum_w - cumsum)))
+            result[q] = (sorted[k - 1] + sorted[k]) / 2.0;
+        else
+            result[q] = sorted[k];
+    }
+}
 
-        if (*j == lo)
-            break;
+/******************************************************************************\
+|* weighted quantiles for a vector of probabilities (multi-select)            *|
+|*                                                                            *|
+|*  a        array[n] of (value, weight) pairs                                *|
+|*  n        dimension                                                        *|
+|*  probs    probabilities, sorted in ascending order, array[n_probs]         *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: weighted quantiles, array[n_probs]                    *|
+|*  stack    work array[n_probs]                                              *|
+|*                                                                            *|
+|* NOTE: the array is partitioned once and the algorithm descends into each   *|
+|*       side with only the probabilities that fall there (the probabilities  *|
+|*       that fall on the ties are resolved immediately). A range is carried  *|
+|*       with the sum of weights of the elements to its left; hence, no       *|
+|*       weight needs to be dumped. Every pending range on the stack holds at *|
+|*       least one probability, thus, the stack holds at most n_probs ranges. *|
+|*       The result is the same as the one of insertionselect applied to the  *|
+|*       entire array (type 2 quantile in Hyndman and Fan (1996) for equal    *|
+|*       weighting)                                                           *|
+\******************************************************************************/
+void wquant_multi(wpair* restrict a, int n, double* restrict probs,
+    int n_probs, double* restrict result, wqrange* restrict stack)
+{
+    if (n < 1 || n_probs < 1)
+        return;
 
-        if (*i == *j && is_equal(array[*i], pivot))
-            swap2(array, weights, ++p, *i);
+    // prob = 0.0 (prob = 1.0): minimum (maximum)
+    int q_lo = 0, q_hi = n_probs - 1;
+    while (q_lo <= q_hi && is_equal(probs[q_lo], 0.0))
+        q_lo++;
+    while (q_hi >= q_lo && is_equal(probs[q_hi], 1.0))
+        q_hi--;
+    if (q_lo > 0 || q_hi < n_probs - 1) {
+        double min = a[0].x, max = a[0].x;
+        for (int i = 1; i < n; i++) {
+            min = a[i].x < min ? a[i].x : min;
+            max = a[i].x > max ? a[i].x : max;
+        }
+        for (int q = 0; q < q_lo; q++)
+            result[q] = min;
+        for (int q = q_hi + 1; q < n_probs; q++)
+            result[q] = max;
+    }
+    if (q_lo > q_hi)
+        return;
 
-        if (*i >= *j)                   // check if sentinels cross
-            break;
+    double sum_w = sum_weights(a, n);
 
-        swap2(array, weights, *i, *j);
+    int top = 0, i, j, q1, q2;
+    double w_lo, w_eq, pivot;
+    wqrange r = {0, n - 1, q_lo, q_hi, select_depth_limit(n), 0.0, 0.0};
+    for (;;) {
+        if (r.hi - r.lo + 1 <= _n_quickselect) {
+            // small range: sort and scan the cumulative sum of weights
+            select_insertion_pair(a, r.lo, r.hi);
+            int k = r.lo;
+            double cumsum = r.w_before;
+            for (int q = r.p_lo; q <= r.p_hi; q++) {
+                while (k < r.hi && cumsum + a[k].w <= probs[q] * sum_w)
+                    cumsum += a[k++].w;
+                // midpoint: cumulative weight to the left of element 'k'
+                // is equal to prob * sum_w
+                if (k > 0 && is_equal((1.0 - probs[q]) * cumsum,
+                        probs[q] * (sum_w - cumsum)))
+                    result[q] = ((k == r.lo ? r.prev : a[k - 1].x)
+                        + a[k].x) / 2.0;
+                else
+                    result[q] = a[k].x;
+            }
+        } else {
+            partition_multi(a, r.lo, r.hi, &r.depth, &i, &j, &w_lo, &w_eq);
+            pivot = a[j + 1].x;
+            w_lo += r.w_before;
+
+            // probs[r.p_lo..(q1-1)]: left; probs[q1..(q2-1)]: ties;
+            // probs[q2..r.p_hi]: right
+            q1 = r.p_lo;
+            while (q1 <= r.p_hi && probs[q1] * sum_w < w_lo)
+                q1++;
+            q2 = q1;
+            while (q2 <= r.p_hi && probs[q2] * sum_w < w_lo + w_eq)
+                q2++;
+            if (i > r.hi)           // no element is larger than the pivot
+                q2 = r.p_hi + 1;
+
+            for (int q = q1; q < q2; q++) {
+                if (j + 1 > 0 && is_equal((1.0 - probs[q]) * w_lo,
+                        probs[q] * (sum_w - w_lo))) {
+                    double left = r.lo > 0 ? r.prev : a[r.lo].x;
+                    if (j >= r.lo) {
+                        double max_lo = max_value(a, r.lo, j);
+                        left = r.lo > 0 && r.prev > max_lo ? r.prev : max_lo;
+                    }
+                    result[q] = (left + pivot) / 2.0;
+                } else {
+                    result[q] = pivot;
+                }
+            }
 
-        // swap equal elements to the far left and right, respectively
-        if (is_equal(array[*i], pivot))
-            swap2(array, weights, ++p, *i);
+            // descend into the left part and push the right part
+            wqrange right = {i, r.hi, q2, r.p_hi, r.depth, w_lo + w_eq,
+                pivot};
+            if (r.p_lo < q1) {
+                if (q2 <= r.p_hi)
+                    stack[top++] = right;
+                r.hi = j;
+                r.p_hi = q1 - 1;
+                continue;
+            }
+            if (q2 <= r.p_hi) {
+                r = right;
+                continue;
+            }
+        }
 
-        if (is_equal(array[*j], pivot))
-            swap2(array, weights, --q, *j);
+        if (top == 0)
+            break;
+        r = stack[--top];
     }
+}
 
-    // swap equal elements from the borders back to the center
-    *i = *j + 1;
-    for (int k = lo; k <= p; k++)
-        swap2(array, weights, k, (*j)--);
+/******************************************************************************\
+|* sort the probabilities in ascending order                                  *|
+|*  probs    probabilities, array[m]                                          *|
+|*  m        dimension                                                        *|
+|*  sorted   on return: sorted probabilities, array[m]                        *|
+|*  order    on return: sorted[q] = probs[order[q]], array[m]                 *|
+\******************************************************************************/
+static void sort_probs(double *probs, int m, double *sorted, int *order)
+{
+    for (int q = 0; q < m; q++) {
+        order[q] = q;
+        sorted[q] = probs[q];
+    }
+    select_sort_indx(sorted, order, 0, m - 1);
+}
 
-    for (int k = hi; k >= q; k--)
-        swap2(array, weights, k, (*i)++);
+/******************************************************************************\
+|* 3-way partition with sums of weights (for wquant_multi)                    *|
+|*  a        array[lo..hi] of (value, weight) pairs                           *|
+|*  lo, hi   dimension                                                        *|
+|*  depth    remaining depth budget (see select_partition)                    *|
+|*  i, j     on return: a[lo..j] < pivot, a[(j+1)..(i-1)] = pivot, and        *|
+|*           a[i..hi] > pivot                                                 *|
+|*  w_lo     on return: sum of weights of a[lo..j]                            *|
+|*  w_eq     on return: sum of weights of a[(j+1)..(i-1)]                     *|
+|* NOTE: for large ranges, the partitioning is done in parallel; see          *|
+|*       wquant_pair                                                          *|
+\******************************************************************************/
+static void partition_multi(wpair* restrict a, int lo, int hi, int *depth,
+    int *i, int *j, double *w_lo, double *w_eq)
+{
+    if (hi - lo + 1 > WQUANTILE_OMP_MIN_SIZE && *depth > 0) {
+        (*depth)--;
+        double pivot = a[select_pivot_pair(a, lo, hi)].x;
+        *j = partition_parallel(a, lo, hi, pivot, 0, w_lo) - 1;
+        *i = *j < -1 ? -1 : partition_parallel(a, *j + 1, hi, pivot, 1, w_eq);
+        if (*i >= 0)
+            return;
+        // no scratch (see mem_scratch): serial partition of a[lo..hi]
+    }
+
+    select_partition_pair(a, lo, hi, depth, i, j);
+    *w_lo = 0.0; *w_eq = 0.0;
+    for (int k = lo; k <= *j; k++)
+        *w_lo += a[k].w;
+    for (int k = *j + 1; k < *i; k++)
+        *w_eq += a[k].w;
+}
+
+/******************************************************************************\
+|* maximum of the values of a[lo..hi]                                         *|
+\******************************************************************************/
+static inline double max_value(wpair *a, int lo, int hi)
+{
+    double max = a[lo].x;
+    for (int k = lo + 1; k <= hi; k++)
+        max = a[k].x > max ? a[k].x : max;
+    return max;
 }
 
 /******************************************************************************\
-|* choose pivotal element: for arrays of size < _n_nither, the median of      *|
-|* three is taken as pivotal element, otherwise we take Tukey's ninther       *|
-|*  array   array[lo..hi]                                                     *|
-|*  lo, hi  dimension                                                         *|
+|* parallel 2-way partition (in place)                                        *|
+|*  a        array[lo..hi] of (value, weight) pairs                           *|
+|*  lo, hi   dimension                                                        *|
+|*  pivot    pivotal value                                                    *|
+|*  ties     0: predicate is 'x < pivot'; 1: predicate is 'x <= pivot'        *|
+|*  sum_w    on return: sum of weights of the elements satisfying predicate   *|
+|*  return   position of the first element that does not satisfy predicate;   *|
+|*           -1 if the scratch cannot be allocated (a is not modified)        *|
+|*                                                                            *|
+|* NOTE: the threads partition the chunks of WQUANTILE_BLOCK elements        *|
+|*       (branchless Lomuto pass) and sum up their weights; then, the         *|
+|*       misplaced elements (i.e., the elements on the wrong side of the      *|
+|*       global boundary) are swapped; the r-th misplaced element on the left *|
+|*       is swapped with the r-th misplaced element on the right, and the     *|
+|*       ranks are distributed over the threads. The chunks are fixed and the *|
+|*       sums of the chunks are added up in order; hence, the permutation and *|
+|*       'sum_w' do not depend on the number of threads                       *|
 \******************************************************************************/
-static inline int choose_pivot(double *array, int lo, int hi)
+static int partition_parallel(wpair* restrict a, int lo, int hi, double pivot,
+    int ties, double *sum_w)
 {
-    int n = hi - lo + 1;
-    int mid = lo + n / 2;       // small array: median of three
-    if (n > _n_nither) {        // large array: Tukey's ninther
-        int eps = n / 8;
-        lo = med3(array, lo, lo + eps, lo + eps + eps);
-        mid = med3(array, mid - eps, mid, mid + eps);
-        hi = med3(array, hi - eps - eps, hi - eps, hi);
+    int n_threads = 1;
+    #ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+    #endif
+    int n = hi - lo + 1, chunk_size = WQUANTILE_BLOCK;
+    int n_chunks = (n + chunk_size - 1) / chunk_size;
+    int* restrict count = (int*) mem_scratch(5 * n_chunks, sizeof(int));
+    double* restrict sum = (double*) mem_scratch(n_chunks, sizeof(double));
+    if (count == NULL || sum == NULL) {
+        mem_free(count); mem_free(sum);
+        return -1;
+    }
+
+    // part 1: chunk-wise partition
+    #pragma omp parallel for num_threads(n_threads) schedule(static)
+    for (int c = 0; c < n_chunks; c++) {
+        int c_lo = lo + c * chunk_size;
+        int c_hi = c_lo + chunk_size - 1 < hi ? c_lo + chunk_size - 1 : hi;
+        int first = c_lo, is;
+        double s = 0.0;
+        wpair tmp;
+        for (int k = c_lo; k <= c_hi; k++) {
+            tmp = a[k];
+            a[k] = a[first];
+            a[first] = tmp;
+            is = (tmp.x < pivot) | (ties & (tmp.x == pivot));
+            s += is ? tmp.w : 0.0;
+            first += is;
+        }
+        count[c] = c_lo <= c_hi ? first - c_lo : 0;
+        sum[c] = s;
+    }
+
+    int bound = lo;
+    *sum_w = 0.0;
+    for (int c = 0; c < n_chunks; c++) {
+        bound += count[c];
+        *sum_w += sum[c];
+    }
+
+    // part 2: ranges of misplaced elements; left of 'bound': elements that
+    // do not satisfy the predicate; right of 'bound': elements that do
+    int *l_lo = count + n_chunks, *l_hi = l_lo + n_chunks;
+    int *r_lo = l_hi + n_chunks, *r_hi = r_lo + n_chunks;
+    int n_l = 0, n_r = 0, n_misplaced = 0;
+    for (int c = 0; c < n_chunks; c++) {
+        int c_lo = lo + c * chunk_size;
+        if (c_lo > hi)
+            break;
+        int c_mid = c_lo + count[c];
+        int c_end = c_lo + chunk_size < hi + 1 ? c_lo + chunk_size : hi + 1;
+        int end = c_end < bound ? c_end : bound;
+        if (c_mid < end) {
+            l_lo[n_l] = c_mid; l_hi[n_l++] = end;
+            n_misplaced += end - c_mid;
+        }
+        int start = c_lo > bound ? c_lo : bound;
+        if (start < c_mid) {
+            r_lo[n_r] = start; r_hi[n_r++] = c_mid;
+        }
     }
-    return med3(array, lo, mid, hi);
+
+    // part 3: swap the misplaced elements (the pairs do not depend on the
+    // distribution over the threads)
+    #pragma omp parallel for num_threads(n_threads) schedule(static, 1)
+    for (int c = 0; c < n_threads; c++) {
+        int rank_lo = (int)(((int64_t)n_misplaced * c) / n_threads);
+        int rank_hi = (int)(((int64_t)n_misplaced * (c + 1)) / n_threads);
+        if (rank_lo == rank_hi)
+            continue;
+
+        int li, lp, ri, rp;
+        locate_misplaced(l_lo, l_hi, n_l, rank_lo, &li, &lp);
+        locate_misplaced(r_lo, r_hi, n_r, rank_lo, &ri, &rp);
+        wpair tmp;
+        for (int r = rank_lo; r < rank_hi; r++) {
+            tmp = a[lp]; a[lp] = a[rp]; a[rp] = tmp;
+            if (++lp == l_hi[li] && ++li < n_l)
+                lp = l_lo[li];
+            if (++rp == r_hi[ri] && ++ri < n_r)
+                rp = r_lo[ri];
+        }
+    }
+
+    mem_free(count); mem_free(sum);
+    return bound;
 }
 
 /******************************************************************************\
-|* swap the elements i and j in array and weights                             *|
-|*  array   array[n]                                                          *|
-|*  weights array[n]                                                          *|
-|*  i, j    elements to be swapped                                            *|
+|* sum of the weights of an array of (value, weight) pairs                    *|
+|*  a        array[n]                                                         *|
+|*  n        dimension                                                        *|
+|* NOTE: for n > WQUANTILE_OMP_MIN_SIZE, the sums of the blocks of            *|
+|*       WQUANTILE_BLOCK elements are computed in parallel and added up in    *|
+|*       order (the result does not depend on the number of threads)          *|
 \******************************************************************************/
-static inline void swap2(double *array, double *weights, int i, int j)
+static double sum_weights(wpair* restrict a, int n)
 {
-    double tmp = array[i]; array[i] = array[j]; array[j] = tmp;
-    // swap weights
-    tmp = weights[i]; weights[i] = weights[j]; weights[j] = tmp;
+    double sum_w = 0.0;
+    if (n <= WQUANTILE_OMP_MIN_SIZE) {
+        for (int i = 0; i < n; i++)
+            sum_w += a[i].w;
+        return sum_w;
+    }
+
+    int n_blocks = (n + WQUANTILE_BLOCK - 1) / WQUANTILE_BLOCK;
+    double* restrict sum = (double*) mem_scratch(n_blocks, sizeof(double));
+    if (sum == NULL) {
+        // no scratch (see mem_scratch): the blocks are summed up serially
+        // (in the same order)
+        for (int b = 0; b < n_blocks; b++) {
+            int b_lo = b * WQUANTILE_BLOCK;
+            int b_hi = n - b_lo < WQUANTILE_BLOCK ? n : b_lo + WQUANTILE_BLOCK;
+            double s = 0.0;
+            for (int i = b_lo; i < b_hi; i++)
+                s += a[i].w;
+            sum_w += s;
+        }
+        return sum_w;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < n_blocks; b++) {
+        int b_lo = b * WQUANTILE_BLOCK;
+        int b_hi = n - b_lo < WQUANTILE_BLOCK ? n : b_lo + WQUANTILE_BLOCK;
+        double s = 0.0;
+        for (int i = b_lo; i < b_hi; i++)
+            s += a[i].w;
+        sum[b] = s;
+    }
+    for (int b = 0; b < n_blocks; b++)
+        sum_w += sum[b];
+    mem_free(sum);
+    return sum_w;
 }
 
 /******************************************************************************\
-|* minimum of two integer values                                              *|
+|* position of the misplaced element with rank 'rank' (0-based)               *|
+|*  lo, hi   ranges [lo[i], hi[i]) of misplaced elements, array[n_ranges]     *|
+|*  n_ranges dimension                                                        *|
+|*  rank     rank of the element                                              *|
+|*  at       on return: range of the element                                  *|
+|*  pos      on return: position of the element                               *|
 \******************************************************************************/
-static inline int min(int a, int b)
+static void locate_misplaced(int *lo, int *hi, int n_ranges, int rank,
+    int *at, int *pos)
 {
-    return a < b ? a : b;
+    int i = 0;
+    while (i < n_ranges - 1 && rank >= hi[i] - lo[i]) {
+        rank -= hi[i] - lo[i];
+        i++;
+    }
+    *at = i;
+    *pos = lo[i] + rank;
 }
 
 /******************************************************************************\
@@ -314,73 +898,39 @@ static inline int is_equal(double a, double b)
         fabs(a)) * DBL_EPSILON);
 }
 
-/******************************************************************************\
-|* median-of-three (but without swaps)                                        *|
-\******************************************************************************/
-static inline int med3(double *array, int i, int j, int k)
-{
-    return array[i] < array[j] ?
-        (array[j] < array[k] ? j : array[i] < array[k] ? k : i)
-        : (array[j] > array[k] ? j : array[i] > array[k] ? k : i);
-}
-
 /******************************************************************************\
 |* weighted quantile by insertion sort with weights                           *|
-|*  array    array[lo..hi]                                                    *|
-|*  weights  array[lo..hi]                                                    *|
+|*  a        array[lo..hi] of (value, weight) pairs                           *|
 |*  lo, hi   dimension                                                        *|
 |*  prob     prob. of the weighted quantile                                   *|
 \******************************************************************************/
-double insertionselect(double *array, double *weights, int lo, int hi,
-    double prob)
+double insertionselect(wpair *a, int lo, int hi, double prob)
 {
     // part: sort
-    int exch = 0;
-    for (int i = hi; i > lo; i--) {     // smallest element as sentinel
-        if (array[i] < array[i - 1]) {
-            swap2(array, weights, i, i - 1);
-            exch++;
-        }
-    }
-    if (exch != 0) {                    // insertion sort with half-exchanges
-        int j;
-        double pivot, pivot_weight;
-        for (int i = lo + 2; i <= hi; i++) {
-            pivot = array[i];
-            pivot_weight = weights[i];
-            j = i;
-            while (pivot < array[j - 1]) {
-                array[j] = array[j - 1];
-                weights[j] = weights[j - 1];
-                j--;
-            }
-            array[j] = pivot;
-            weights[j] = pivot_weight;
-        }
-    }
+    select_insertion_pair(a, lo, hi);
 
     // part: select
     double sum_w = 0.0;
     for (int k = lo; k <= hi; k++)      // total sum of weight
-        sum_w += weights[k];
+        sum_w += a[k].w;
 
     int k;
     double cumsum = 0.0;
     for (k = lo; k <= hi; k++) {        // cumulative sum of weight
-        cumsum += weights[k];
+        cumsum += a[k].w;
 
         if (cumsum > prob * sum_w)
             break;
     }
 
     if (k == lo)
-        return array[k];
+        return a[k].x;
     else {
-        cumsum -= weights[k];
+        cumsum -= a[k].w;
         if (is_equal((1 - prob) * cumsum, prob * (sum_w - cumsum)))
-            return (array[k - 1] + array[k]) / 2.0;
+            return (a[k - 1].x + a[k].x) / 2.0;
         else
-            return array[k];
+            return a[k].x;
     }
 }
 
@@ -388,8 +938,7 @@ double insertionselect(double *array, double *weights, int lo, int hi,
 |* DEBUGGING TOOLS                                                            *|
 \******************************************************************************/
 #if DEBUG_MODE
-void debug_print_data(double *array, double *weights, int lo, int hi,
-    char *message)
+void debug_print_data(wpair *a, int lo, int hi, char *message)
 {
     if (strlen(message) > 0) {
         printf("------\n");
@@ -398,7 +947,7 @@ void debug_print_data(double *array, double *weights, int lo, int hi,
         printf("x \t");
 
     for (int i = lo; i <= hi; ++i)
-        printf("%.2f\t", array[i]);
+        printf("%.2f\t", a[i].x);
 
     printf("\n");
 
@@ -408,7 +957,7 @@ void debug_print_data(double *array, double *weights, int lo, int hi,
         printf("w \t");
 
     for (int i = lo; i <= hi; ++i)
-        printf("%.2f\t", weights[i]);
+        printf("%.2f\t", a[i].w);
 
     printf("\n");
 }
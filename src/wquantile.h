@@ -1,8 +1,46 @@
 #include <R.h>
+#include <stdint.h>
+#include "selection.h"
+#include "wbacon_memory.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+#define WQUANTILE_OMP_MIN_SIZE 1000000      // parallel partition if n > this
+#define WQUANTILE_GROUPED_OMP_MIN_SIZE 10000 // groups in parallel if n > this
+#define WQUANTILE_CACHE_OMP_MIN_SIZE 10000   // columns in parallel if n > this
+#define WQUANTILE_BLOCK 65536               // elements per block of the
+                                            //   parallel partition and sums
 
 #ifndef _WQUANTILE_H
 #define _WQUANTILE_H
-void wselect0(double*, double*, int, int, int);
+
+// range of the multi-select (wquant_multi): the range a[lo..hi] carries the
+// probabilities probs[p_lo..p_hi], the sum of weights of the elements to its
+// left, and the largest value to its left
+typedef struct wqrange_struct {
+    int lo;
+    int hi;
+    int p_lo;
+    int p_hi;
+    int depth;
+    double w_before;
+    double prev;
+} wqrange;
+
 void wquantile(double*, double*, int*, double*, double*);
 void wquantile_noalloc(double*, double*, double*, int*, double*, double*);
+void wquantile_inplace(double*, int*, double*, double*);
+void wquant_pair(wpair* restrict, int, double, double*);
+double wquant_pair_scratch(int);
+void wquantile_multi(double*, int*, double*, int*, double*);
+void wquantile_grouped(double*, double*, int*, int*, int*, double*, int*,
+    double*);
+void wquantile_sort(double*, int*, int*, double*, int*);
+void wquantile_cached(double*, int*, int*, int*, double*, int*, double*, int*,
+    double*);
+void wquant_sorted(double* restrict, int* restrict, double* restrict, double,
+    int, double* restrict, int, double* restrict);
+void wquant_multi(wpair* restrict, int, double* restrict, int,
+    double* restrict, wqrange* restrict);
 #endif
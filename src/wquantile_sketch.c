@@ -0,0 +1,379 @@
+/* mergeable weighted quantile sketch
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, a copy is available at
+   https://www.gnu.org/licenses/
+
+   Reference:  Manku, G.S., S. Rajagopalan, and B.G. Lindsay (1998).
+               Approximate Medians and other Quantiles in One Pass and with
+               Limited Memory, Proceedings of the ACM SIGMOD International
+               Conference on Management of Data, pp. 426-435
+               Karnin, Z., K. Lang, and E. Liberty (2016). Optimal Quantile
+               Approximation in Streams, IEEE 57th Annual Symposium on
+               Foundations of Computer Science, pp. 71-78
+   Note:       The sketch is a hierarchy of compactors (levels) of (value,
+               weight) pairs. When a level holds k pairs, it is sorted and
+               adjacent pairs are merged into one pair, which is pushed to
+               the next level; the merged pair takes the value of the heavier
+               pair and the sum of the weights. For any value y, at most one
+               merged pair straddles y; hence, a compaction changes the
+               weighted rank of y by at most the weight of the lighter pair.
+               The sum of these weights is accumulated in 'err', which is a
+               deterministic bound on the rank error (in units of weight).
+               The extension of the compactors to weighted data is ours.
+*/
+
+#include "wquantile_sketch.h"
+
+static void compact(wqsketch*, int);
+static void add_items(wqsketch*, int, wpair*, int);
+static void reserve(wqsketch*, int);
+static void update_serial(wqsketch*, double*, double*, int);
+
+/******************************************************************************\
+|* update the sketch with a batch of data (R entry point)                     *|
+|*  state    serialized sketch, array[len]; on return: updated sketch         *|
+|*  len      on return: length of the serialized sketch                       *|
+|*  x        data, array[n]                                                   *|
+|*  w        weights, array[n]                                                *|
+|*  n        dimension                                                        *|
+|* NOTE: the caller must provide an array 'state' of length                   *|
+|*       WQSKETCH_HEADER + 2 * WQSKETCH_MAX_LEVELS * (k + 1); the first       *|
+|*       element of an empty sketch is k, all other elements are zero         *|
+\******************************************************************************/
+void wqsketch_update(double *state, int *len, double *x, double *w, int *n)
+{
+    wqsketch s;
+    wqs_unpack(state, &s);
+    wqs_update(&s, x, w, *n);
+    *len = wqs_pack(&s, state);
+    wqs_free(&s);
+}
+
+/******************************************************************************\
+|* merge two sketches (R entry point)                                         *|
+|*  state    serialized sketch, array[len]; on return: merged sketch          *|
+|*  len      on return: length of the serialized sketch                       *|
+|*  other    serialized sketch (same k as 'state')                            *|
+\******************************************************************************/
+void wqsketch_merge(double *state, int *len, double *other)
+{
+    wqsketch s, t;
+    wqs_unpack(state, &s);
+    wqs_unpack(other, &t);
+    wqs_merge(&s, &t);
+    *len = wqs_pack(&s, state);
+    wqs_free(&s);
+    wqs_free(&t);
+}
+
+/******************************************************************************\
+|* approximate weighted quantiles (R entry point)                             *|
+|*  state    serialized sketch                                                *|
+|*  probs    probabilities (0 <= probs <= 1), array[n_probs]                  *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: approximate weighted quantiles, array[n_probs]        *|
+|*  err      on return: bound on the rank error relative to the total weight  *|
+\******************************************************************************/
+void wqsketch_quantile(double *state, double *probs, int *n_probs,
+    double *result, double *err)
+{
+    wqsketch s;
+    wqs_unpack(state, &s);
+    *err = wqs_query(&s, probs, *n_probs, result);
+    *err = s.total_w > 0.0 ? *err / s.total_w : 0.0;
+    wqs_free(&s);
+}
+
+/******************************************************************************\
+|* initialize an empty sketch                                                 *|
+|*  s        sketch                                                           *|
+|*  k        capacity of a level (rounded up to an even number >= 2)          *|
+\******************************************************************************/
+void wqs_init(wqsketch *s, int k)
+{
+    s->k = k < 2 ? 2 : k + (k % 2);
+    s->n_levels = 1;
+    s->n = 0.0;
+    s->total_w = 0.0;
+    s->err = 0.0;
+    for (int h = 0; h < WQSKETCH_MAX_LEVELS; h++) {
+        s->size[h] = 0;
+        s->parity[h] = 0;
+        s->level[h] = NULL;
+    }
+    reserve(s, 1);
+}
+
+/******************************************************************************\
+|* free the memory of a sketch                                                *|
+\******************************************************************************/
+void wqs_free(wqsketch *s)
+{
+    for (int h = 0; h < WQSKETCH_MAX_LEVELS; h++) {
+        if (s->level[h] != NULL) {
+            Free(s->level[h]);
+            s->level[h] = NULL;
+        }
+    }
+}
+
+/******************************************************************************\
+|* update the sketch with a batch of data                                     *|
+|*  s        sketch                                                           *|
+|*  x        data, array[n]                                                   *|
+|*  w        weights, array[n]                                                *|
+|*  n        dimension                                                        *|
+|* NOTE: for n > WQUANTILE_OMP_MIN_SIZE, every thread sketches its chunk of   *|
+|*       the data; the per-thread sketches are then merged into 's'           *|
+\******************************************************************************/
+void wqs_update(wqsketch *s, double *x, double *w, int n)
+{
+    int n_chunks = 1;
+    #ifdef _OPENMP
+    if (n > WQUANTILE_OMP_MIN_SIZE)
+        n_chunks = omp_get_max_threads();
+    #endif
+
+    if (n_chunks == 1) {
+        update_serial(s, x, w, n);
+        return;
+    }
+
+    // per-thread sketches (the levels are allocated before the parallel
+    // region)
+    int chunk_size = n / n_chunks + 1, n_levels = 2;
+    for (double cap = s->k; cap < chunk_size; cap *= 2.0)
+        n_levels++;
+    wqsketch *t = (wqsketch*) Calloc(n_chunks, wqsketch);
+    for (int c = 0; c < n_chunks; c++) {
+        wqs_init(&t[c], s->k);
+        reserve(&t[c], n_levels);
+    }
+
+    #pragma omp parallel for num_threads(n_chunks) schedule(static, 1)
+    for (int c = 0; c < n_chunks; c++) {
+        int lo = c * chunk_size;
+        int hi = lo + chunk_size < n ? lo + chunk_size : n;
+        if (lo < hi)
+            update_serial(&t[c], x + lo, w + lo, hi - lo);
+    }
+
+    for (int c = 0; c < n_chunks; c++) {
+        wqs_merge(s, &t[c]);
+        wqs_free(&t[c]);
+    }
+    Free(t);
+}
+
+/******************************************************************************\
+|* update the sketch with a batch of data (serial; see wqs_update)            *|
+\******************************************************************************/
+static void update_serial(wqsketch *s, double *x, double *w, int n)
+{
+    int m;
+    wpair batch[64];
+    for (int i = 0; i < n; i += m) {
+        m = n - i < 64 ? n - i : 64;
+        for (int j = 0; j < m; j++) {
+            batch[j].x = x[i + j];
+            batch[j].w = w[i + j];
+            s->total_w += w[i + j];
+        }
+        add_items(s, 0, batch, m);
+    }
+    s->n += (double)n;
+}
+
+/******************************************************************************\
+|* merge sketch 'other' into sketch 's' (both sketches must have the same k)  *|
+\******************************************************************************/
+void wqs_merge(wqsketch *s, wqsketch *other)
+{
+    for (int h = 0; h < other->n_levels; h++) {
+        if (other->size[h] > 0)
+            add_items(s, h, other->level[h], other->size[h]);
+    }
+    s->n += other->n;
+    s->total_w += other->total_w;
+    s->err += other->err;
+}
+
+/******************************************************************************\
+|* approximate weighted quantiles                                             *|
+|*  s        sketch                                                           *|
+|*  probs    probabilities (0 <= probs <= 1), array[n_probs]                  *|
+|*  n_probs  dimension                                                        *|
+|*  result   on return: approximate weighted quantiles, array[n_probs]        *|
+|*  return   bound on the rank error (in units of weight)                     *|
+|* NOTE: the pairs of all levels are collected and the weighted quantiles of  *|
+|*       the collection are computed exactly (wquantile_multi); the sketch    *|
+|*       is exact (err = 0) as long as no level has been compacted            *|
+\******************************************************************************/
+double wqs_query(wqsketch *s, double *probs, int n_probs, double *result)
+{
+    int m = 0;
+    for (int h = 0; h < s->n_levels; h++)
+        m += s->size[h];
+    if (m == 0) {
+        for (int q = 0; q < n_probs; q++)
+            result[q] = NA_REAL;
+        return 0.0;
+    }
+
+    wpair *a = (wpair*) Calloc(m, wpair);
+    m = 0;
+    for (int h = 0; h < s->n_levels; h++) {
+        Memcpy(&a[m], s->level[h], s->size[h]);
+        m += s->size[h];
+    }
+    wquantile_multi((double*) a, &m, probs, &n_probs, result);
+    Free(a);
+    return s->err;
+}
+
+/******************************************************************************\
+|* deserialize a sketch                                                       *|
+|*  state    serialized sketch (see wqs_pack)                                 *|
+|*  s        on return: sketch (the levels are allocated)                     *|
+\******************************************************************************/
+void wqs_unpack(double *state, wqsketch *s)
+{
+    wqs_init(s, (int)state[0]);
+    int n_levels = (int)state[1];
+    s->n = state[2];
+    s->total_w = state[3];
+    s->err = state[4];
+    reserve(s, n_levels > 1 ? n_levels : 1);
+
+    double *at = state + WQSKETCH_HEADER + 2 * WQSKETCH_MAX_LEVELS;
+    for (int h = 0; h < n_levels; h++) {
+        s->size[h] = (int)state[WQSKETCH_HEADER + h];
+        s->parity[h] = (int)state[WQSKETCH_HEADER + WQSKETCH_MAX_LEVELS + h];
+        Memcpy((double*) s->level[h], at, 2 * s->size[h]);
+        at += 2 * s->size[h];
+    }
+}
+
+/******************************************************************************\
+|* serialize a sketch                                                         *|
+|*  s        sketch                                                           *|
+|*  state    on return: [k, n_levels, n, total_w, err, size[0..(L-1)],        *|
+|*           parity[0..(L-1)], pairs of level 0, pairs of level 1, ...],      *|
+|*           where L = WQSKETCH_MAX_LEVELS                                    *|
+|*  return   length of 'state'                                                *|
+\******************************************************************************/
+int wqs_pack(wqsketch *s, double *state)
+{
+    state[0] = (double)s->k;
+    state[1] = (double)s->n_levels;
+    state[2] = s->n;
+    state[3] = s->total_w;
+    state[4] = s->err;
+
+    int len = WQSKETCH_HEADER + 2 * WQSKETCH_MAX_LEVELS;
+    for (int h = 0; h < WQSKETCH_MAX_LEVELS; h++) {
+        state[WQSKETCH_HEADER + h] = (double)s->size[h];
+        state[WQSKETCH_HEADER + WQSKETCH_MAX_LEVELS + h] =
+            (double)s->parity[h];
+        if (s->size[h] > 0) {
+            Memcpy(state + len, (double*) s->level[h], 2 * s->size[h]);
+            len += 2 * s->size[h];
+        }
+    }
+    return len;
+}
+
+/******************************************************************************\
+|* append pairs to level h and compact (if necessary)                         *|
+|*  s        sketch                                                           *|
+|*  h        level                                                            *|
+|*  items    array[m] of (value, weight) pairs                                *|
+|*  m        dimension (m <= k)                                               *|
+\******************************************************************************/
+static void add_items(wqsketch *s, int h, wpair *items, int m)
+{
+    reserve(s, h + 1);
+    int at = 0, k = s->k;
+    while (at < m) {
+        // level h holds less than k pairs; hence, we can append k pairs
+        int len = m - at < k ? m - at : k;
+        Memcpy(&s->level[h][s->size[h]], items + at, len);
+        s->size[h] += len;
+        at += len;
+        compact(s, h);
+    }
+}
+
+/******************************************************************************\
+|* compact level h (and the levels above, if necessary)                       *|
+|* NOTE: the level is sorted and adjacent pairs are merged; if the number of  *|
+|*       pairs is odd, the largest pair remains on the level. The top level   *|
+|*       (WQSKETCH_MAX_LEVELS - 1) is compacted into itself                   *|
+\******************************************************************************/
+static void compact(wqsketch *s, int h)
+{
+    int k = s->k;
+    while (s->size[h] >= k) {
+        int to = h + 1 < WQSKETCH_MAX_LEVELS ? h + 1 : h;
+        reserve(s, to + 1);
+
+        wpair *a = s->level[h];
+        int m = s->size[h], n_pairs = m / 2;
+        select_sort_pair(a, 0, m - 1);
+
+        // merge adjacent pairs: the value of the heavier pair is kept (in
+        // case of equal weights, the lower and the upper value are kept
+        // alternately); the weight of the lighter pair bounds the error
+        wpair *out = s->level[to] + (to == h ? 0 : s->size[to]);
+        int keep_hi = s->parity[h];
+        double err = 0.0, x_lo, x_hi, w_lo, w_hi;
+        for (int i = 0; i < n_pairs; i++) {
+            x_lo = a[2 * i].x; w_lo = a[2 * i].w;
+            x_hi = a[2 * i + 1].x; w_hi = a[2 * i + 1].w;
+            if (x_lo < x_hi)
+                err = fmax(err, fmin(w_lo, w_hi));
+            out[i].x = (w_hi > w_lo || (w_hi == w_lo && keep_hi)) ? x_hi : x_lo;
+            out[i].w = w_lo + w_hi;
+        }
+        s->parity[h] = 1 - keep_hi;
+        s->err += err;
+
+        if (to == h) {              // top level
+            if (m % 2)
+                out[n_pairs] = a[m - 1];
+            s->size[h] = n_pairs + m % 2;
+            return;
+        }
+        if (m % 2)
+            a[0] = a[m - 1];
+        s->size[h] = m % 2;
+        s->size[to] += n_pairs;
+        h = to;
+    }
+}
+
+/******************************************************************************\
+|* allocate the levels 0..(n_levels - 1) (if not yet allocated)               *|
+\******************************************************************************/
+static void reserve(wqsketch *s, int n_levels)
+{
+    n_levels = n_levels < WQSKETCH_MAX_LEVELS ? n_levels : WQSKETCH_MAX_LEVELS;
+    for (int h = 0; h < n_levels; h++) {
+        if (s->level[h] == NULL)
+            s->level[h] = (wpair*) Calloc(2 * s->k, wpair);
+    }
+    s->n_levels = n_levels > s->n_levels ? n_levels : s->n_levels;
+}
@@ -0,0 +1,41 @@
+#include <R.h>
+#include "selection.h"
+#include "wquantile.h"
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WQUANTILE_SKETCH_H
+#define _WQUANTILE_SKETCH_H
+
+#define WQSKETCH_MAX_LEVELS 32      // max. number of levels of the sketch
+#define WQSKETCH_HEADER 5           // k, n_levels, n, total_w, err
+
+// weighted quantile sketch: level h holds less than k (value, weight)
+// pairs after every update or merge; level[h] is an array[2*k]
+typedef struct wqsketch_struct {
+    int k;                                  // capacity of a level (even)
+    int n_levels;                           // number of levels in use
+    double n;                               // number of items
+    double total_w;                         // total sum of weights
+    double err;                             // bound on the rank error
+    int size[WQSKETCH_MAX_LEVELS];          // number of items per level
+    int parity[WQSKETCH_MAX_LEVELS];        // alternates for equal weights
+    wpair *level[WQSKETCH_MAX_LEVELS];      // items per level
+} wqsketch;
+
+// R entry points (sketch is serialized as a double array)
+void wqsketch_update(double*, int*, double*, double*, int*);
+void wqsketch_merge(double*, int*, double*);
+void wqsketch_quantile(double*, double*, int*, double*, double*);
+
+// C interface
+void wqs_init(wqsketch*, int);
+void wqs_free(wqsketch*);
+void wqs_update(wqsketch*, double*, double*, int);
+void wqs_merge(wqsketch*, wqsketch*);
+double wqs_query(wqsketch*, double*, int, double*);
+void wqs_unpack(double*, wqsketch*);
+int wqs_pack(wqsketch*, double*);
+#endif
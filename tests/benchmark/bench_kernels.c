@@ -0,0 +1,405 @@
+/* Microbenchmarks of the hot kernels with scaling curves and roofline
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   Build:      make -f _myMakefile bench_kernels
+   Usage:      ./bench_kernels [n_max]     (default: 1000000)
+   Kernels:    mean_scatter_w, mahalanobis, euclidean_norm2 (wbacon.c, see
+               bench_kernels_mv.c), hat_matrix, chol_update, chol_downdate
+               (wbacon_reg.c, see bench_kernels_reg.c), fitwls, select_k,
+               wquant0, and psort_array; sweep over n, p, and the number of
+               threads (the univariate kernels are run only for the first p)
+   Roofline:   for every number of threads, the sustainable memory bandwidth
+               (STREAM triad, 24 bytes per element) and the peak rate of
+               floating point operations (one dgemm per thread on private
+               matrices that fit in the cache) are measured first and
+               written as comment lines ('#')
+   Output:     CSV, one line per kernel, n, p, and threads: the minimum time
+               per call over the repetitions, the throughput (rows/s, GB/s,
+               GFLOP/s), the arithmetic intensity (flops per byte), the
+               attainable rate of the roofline, min(peak, intensity * bw),
+               the fraction of the roofline attained, and whether the kernel
+               is bound by memory or compute. For the kernels without floating
+               point operations (selection, sorting), the roofline is the
+               bandwidth
+   Exit code:  1 if the check of select_subset (warm vs. cold start with
+               ties, see bench_kernels_reg.c) fails; 0 otherwise
+   Note:       The bytes of a kernel are the compulsory traffic of its passes
+               over the arrays of size n as written in the code; hence, the
+               fraction of the roofline is an estimate; a fraction above 1
+               indicates that the working set stays in the cache (small n).
+               BLAS/ LAPACK may use threads of their own (e.g., OpenBLAS);
+               set OPENBLAS_NUM_THREADS = 1 to measure only the threads of
+               OpenMP.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <R_ext/BLAS.h>
+#include "bench_kernels.h"
+#include "fitwls.h"
+#include "selection.h"
+#include "partial_sort.h"
+#include "wquantile.h"
+
+// grid of the sweep
+static const int grid_n[] = {10000, 100000, 1000000};
+static const int grid_p[] = {5, 10, 20, 40};
+#define N_GRID_N (sizeof(grid_n) / sizeof(grid_n[0]))
+#define N_GRID_P (sizeof(grid_p) / sizeof(grid_p[0]))
+#define MAX_THREADS 64
+#define ROOF_STREAM_SIZE 8388608    // elements of the arrays of the triad
+#define ROOF_DGEMM_SIZE 256         // dimension of the matrices of dgemm
+
+// roofline by number of threads
+static double roof_bw[MAX_THREADS + 1];     // GB/s
+static double roof_peak[MAX_THREADS + 1];   // GFLOP/s
+
+// data of the benchmarks of this file
+typedef struct bench_uni_struct {
+    int n;
+    int k;
+    double *x;          // data, array[n]
+    double *w;          // weights, array[n]
+    double *work;       // copy of the data, array[n]
+    int *index;         // array[n]
+    wpair *pairs;       // array[n]
+    double result;
+} bench_uni;
+
+typedef struct bench_wls_struct {
+    regdata *dat;
+    estimate *est;
+    int *subset;
+    double *work_dgels;
+    int lwork;
+} bench_wls;
+
+void wquant0(wpair*, double, int, int, double, double*);
+
+static uint64_t rng_state = 88172645463325252ULL;
+static double runif(void);
+static void roofline(int);
+static void bench_fitwls(double*, double*, int, int, int);
+static void bench_univariate(double*, double*, int, int);
+static void run_fitwls(void*);
+static void run_select_k(void*);
+static void run_wquant0(void*);
+static void run_psort_array(void*);
+static void run_triad(void*);
+static void run_dgemm(void*);
+
+int main(int argc, char **argv)
+{
+    int n_max = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    int max_threads = 1;
+    #ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+    #endif
+    max_threads = max_threads > MAX_THREADS ? MAX_THREADS : max_threads;
+
+    int n_fail = check_select_subset();
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        roofline(threads);
+        printf("# roofline: threads = %d, bandwidth = %.2f GB/s, "
+            "peak = %.2f GFLOP/s\n", threads, roof_bw[threads],
+            roof_peak[threads]);
+    }
+
+    printf("kernel,n,p,threads,seconds,rows_per_s,gb_per_s,gflop_per_s,"
+        "intensity,roofline,fraction,bound\n");
+
+    for (size_t gn = 0; gn < N_GRID_N; gn++) {
+        int n = grid_n[gn];
+        if (n > n_max)
+            break;
+        for (size_t gp = 0; gp < N_GRID_P; gp++) {
+            int p = grid_p[gp];
+            double *x = (double*) Calloc(n * p, double);
+            double *w = (double*) Calloc(n, double);
+            bench_data(x, w, n, p);
+
+            for (int threads = 1; threads <= max_threads; threads *= 2) {
+                #ifdef _OPENMP
+                omp_set_num_threads(threads);
+                #endif
+                bench_kernels_mv(x, w, n, p, threads);
+                bench_kernels_reg(x, w, n, p, threads);
+                bench_fitwls(x, w, n, p, threads);
+                if (gp == 0)
+                    bench_univariate(x, w, n, threads);
+            }
+            Free(x); Free(w);
+        }
+    }
+    return n_fail > 0;
+}
+
+/******************************************************************************\
+|* minimum time of a call of a kernel (seconds)                               *|
+|*  fn       kernel                                                           *|
+|*  arg      data of the benchmark                                            *|
+|* NOTE: the kernel is called once to warm up the cache, then at least        *|
+|*       BENCH_MIN_REPS times and until BENCH_MIN_TIME seconds have elapsed   *|
+\******************************************************************************/
+double bench_time(kernel_fn fn, void *arg)
+{
+    fn(arg);
+    double t, t_min = DBL_MAX, t_total = 0.0;
+    for (int r = 0; r < BENCH_MIN_REPS || t_total < BENCH_MIN_TIME; r++) {
+        t = trace_clock();
+        fn(arg);
+        t = trace_clock() - t;
+        t_total += t;
+        t_min = t < t_min ? t : t_min;
+    }
+    return t_min;
+}
+
+/******************************************************************************\
+|* one line of output (CSV)                                                   *|
+|*  kernel   name of the kernel                                               *|
+|*  n, p     dimensions                                                       *|
+|*  threads  number of threads                                                *|
+|*  sec      time of a call (seconds)                                         *|
+|*  cost     cost of a call                                                   *|
+\******************************************************************************/
+void bench_report(const char *kernel, int n, int p, int threads, double sec,
+    kernel_cost cost)
+{
+    double gb = cost.bytes / sec * 1e-9, gflop = cost.flops / sec * 1e-9;
+    double bw = roof_bw[threads], peak = roof_peak[threads];
+    double intensity = cost.flops / cost.bytes, attainable, fraction;
+    const char *bound;
+
+    if (cost.flops > 0.0) {
+        attainable = fmin(peak, intensity * bw);
+        fraction = gflop / attainable;
+        bound = intensity * bw < peak ? "memory" : "compute";
+    } else {
+        attainable = bw;
+        fraction = gb / bw;
+        bound = "memory";
+    }
+    printf("%s,%d,%d,%d,%.3e,%.3e,%.3f,%.3f,%.3f,%.3f,%.3f,%s\n", kernel, n, p,
+        threads, sec, cost.rows / sec, gb, gflop, intensity, attainable,
+        fraction, bound);
+}
+
+/******************************************************************************\
+|* data: x ~ N(0, 1) and w ~ U(1, 3) (xorshift64 and Box-Muller)              *|
+|*  x      on return: array[n, p]                                             *|
+|*  w      on return: array[n]                                                *|
+|*  n, p   dimensions                                                         *|
+\******************************************************************************/
+void bench_data(double *x, double *w, int n, int p)
+{
+    for (int i = 0; i < n * p; i++)
+        x[i] = sqrt(-2.0 * log(runif())) * cos(2.0 * M_PI * runif());
+    for (int i = 0; i < n; i++)
+        w[i] = 1.0 + 2.0 * runif();
+}
+
+static double runif(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/******************************************************************************\
+|* roofline of the machine for a given number of threads                      *|
+\******************************************************************************/
+static void roofline(int threads)
+{
+    #ifdef _OPENMP
+    omp_set_num_threads(threads);
+    #endif
+
+    // sustainable bandwidth: a = b + s * c
+    int n = ROOF_STREAM_SIZE;
+    double *a = (double*) Calloc(3 * (size_t)n, double);
+    #pragma omp parallel for
+    for (int i = 0; i < 3 * n; i++)         // first touch by the threads
+        a[i] = 1.0;
+    double t = bench_time(run_triad, a);
+    roof_bw[threads] = 24.0 * n / t * 1e-9;
+    Free(a);
+
+    // peak rate: one dgemm per thread on matrices that fit in the cache
+    int m = ROOF_DGEMM_SIZE;
+    a = (double*) Calloc(3 * (size_t)m * m * threads, double);
+    for (int i = 0; i < 3 * m * m * threads; i++)
+        a[i] = 1.0 / (1.0 + i % 7);
+    t = bench_time(run_dgemm, a);
+    roof_peak[threads] = 2.0 * m * m * m * threads / t * 1e-9;
+    Free(a);
+}
+
+static void run_triad(void *arg)
+{
+    int n = ROOF_STREAM_SIZE;
+    double* restrict a = (double*) arg;
+    double* restrict b = a + n;
+    double* restrict c = b + n;
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++)
+        a[i] = b[i] + 3.0 * c[i];
+}
+
+static void run_dgemm(void *arg)
+{
+    int m = ROOF_DGEMM_SIZE;
+    const double d_one = 1.0;
+    #pragma omp parallel
+    {
+        int tid = 0;
+        #ifdef _OPENMP
+        tid = omp_get_thread_num();
+        #endif
+        double *a = (double*) arg + 3 * (size_t)m * m * tid;
+        F77_CALL(dgemm)("N", "N", &m, &m, &m, &d_one, a, &m, a + m * m, &m,
+            &d_one, a + 2 * m * m, &m);
+    }
+}
+
+/******************************************************************************\
+|* fitwls (design matrix [1, x] without the last column of x)                 *|
+|*  x        data, array[n, p]                                                *|
+|*  w        weights, array[n]                                                *|
+|*  n, p     dimensions                                                       *|
+|*  threads  number of threads (OpenMP)                                       *|
+\******************************************************************************/
+static void bench_fitwls(double *x, double *w, int n, int p, int threads)
+{
+    double *X = (double*) Calloc(n * p, double);
+    double *y = (double*) Calloc(n, double);
+    double *w_sqrt = (double*) Calloc(n, double);
+    double *wx = (double*) Calloc(n * p, double);
+    double *wy = (double*) Calloc(n, double);
+    double *resid = (double*) Calloc(n, double);
+    double *beta = (double*) Calloc(p, double);
+    int *subset = (int*) Calloc(n, int);
+
+    // y = 1 + sum(x[, 1:(p - 1)]) + x[, p]
+    for (int i = 0; i < n; i++) {
+        X[i] = 1.0;
+        y[i] = 1.0 + x[i + n * (p - 1)];
+        w_sqrt[i] = sqrt(w[i]);
+        subset[i] = 1;
+    }
+    for (int j = 1; j < p; j++) {
+        for (int i = 0; i < n; i++) {
+            X[i + n * j] = x[i + n * (j - 1)];
+            y[i] += X[i + n * j];
+        }
+    }
+
+    regdata data = {.n = n, .p = p, .w = w, .w_sqrt = w_sqrt, .x = X,
+        .wx = wx, .y = y, .wy = wy, .trace = NULL};
+    estimate est = {.sigma = 0.0, .weight = NULL, .resid = resid,
+        .beta = beta, .dist = NULL, .L = NULL, .xty = NULL};
+
+    double tmp;
+    int lwork = fitwls(&data, &est, subset, &tmp, -1);
+    double *work_dgels = (double*) Calloc(lwork, double);
+    bench_wls b = {.dat = &data, .est = &est, .subset = subset,
+        .work_dgels = work_dgels, .lwork = lwork};
+
+    // weighting (4np), QR factorization (2np) and the response (9n), and
+    // residuals (np)
+    double dn = (double)n, dp = (double)p, dnp = dn * dp;
+    kernel_cost cost = {.rows = dn,
+        .flops = 2.0 * dnp + 2.0 * dnp * dp - 2.0 * dp * dp * dp / 3.0
+            + 4.0 * dnp + 2.0 * dn + 2.0 * dnp,
+        .bytes = 8.0 * (9.0 * dn + 5.0 * dnp) + 4.0 * dn};
+    double t = bench_time(run_fitwls, &b);
+    bench_report("fitwls", n, p, threads, t, cost);
+
+    Free(X); Free(y); Free(w_sqrt); Free(wx); Free(wy); Free(resid);
+    Free(beta); Free(subset); Free(work_dgels);
+}
+
+static void run_fitwls(void *arg)
+{
+    bench_wls *b = (bench_wls*) arg;
+    fitwls(b->dat, b->est, b->subset, b->work_dgels, b->lwork);
+}
+
+/******************************************************************************\
+|* select_k (median), wquant0 (weighted median), and psort_array (the n / 2   *|
+|* smallest elements); the data are copied before every call (the kernels     *|
+|* are destructive) and the copy is part of the cost                          *|
+|*  x        data, array[n]                                                   *|
+|*  w        weights, array[n]                                                *|
+|*  n        dimension                                                        *|
+|*  threads  number of threads (OpenMP)                                       *|
+\******************************************************************************/
+static void bench_univariate(double *x, double *w, int n, int threads)
+{
+    double *work = (double*) Calloc(n, double);
+    int *index = (int*) Calloc(n, int);
+    wpair *pairs = (wpair*) Calloc(n, wpair);
+    bench_uni b = {.n = n, .k = n / 2, .x = x, .w = w, .work = work,
+        .index = index, .pairs = pairs, .result = 0.0};
+    double dn = (double)n, t;
+
+    // copy (16n) and one partitioning pass (16n)
+    kernel_cost sel = {.rows = dn, .flops = 0.0, .bytes = 32.0 * dn};
+    t = bench_time(run_select_k, &b);
+    bench_report("select_k", n, 1, threads, t, sel);
+
+    // packing (32n) and one partitioning pass over the pairs (32n)
+    kernel_cost wq = {.rows = dn, .flops = 0.0, .bytes = 64.0 * dn};
+    t = bench_time(run_wquant0, &b);
+    bench_report("wquant0", n, 1, threads, t, wq);
+
+    // copy (16n), selection pass with index (24n), and sorting the k
+    // smallest (value and index) in log2(k) passes
+    double dk = (double)b.k;
+    kernel_cost ps = {.rows = dn, .flops = 0.0,
+        .bytes = 40.0 * dn + 24.0 * dk * log2(dk)};
+    t = bench_time(run_psort_array, &b);
+    bench_report("psort_array", n, 1, threads, t, ps);
+
+    Free(work); Free(index); Free(pairs);
+}
+
+static void run_select_k(void *arg)
+{
+    bench_uni *b = (bench_uni*) arg;
+    Memcpy(b->work, b->x, b->n);
+    select_k(b->work, 0, b->n - 1, b->k);
+    b->result = b->work[b->k];
+}
+
+static void run_wquant0(void *arg)
+{
+    bench_uni *b = (bench_uni*) arg;
+    for (int i = 0; i < b->n; i++) {
+        b->pairs[i].x = b->x[i];
+        b->pairs[i].w = b->w[i];
+    }
+    wquant0(b->pairs, 0.0, 0, b->n - 1, 0.5, &b->result);
+}
+
+static void run_psort_array(void *arg)
+{
+    bench_uni *b = (bench_uni*) arg;
+    double *copy = (double*) b->pairs;      // pairs are not used here
+    Memcpy(copy, b->x, b->n);
+    psort_array(copy, b->index, b->n, b->k, b->work);
+    b->result = copy[b->k - 1];
+}
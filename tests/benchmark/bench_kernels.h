@@ -0,0 +1,29 @@
+#include <R.h>
+#include "wbacon_trace.h"
+
+#ifndef _BENCH_KERNELS_H
+#define _BENCH_KERNELS_H
+
+#define BENCH_MIN_TIME 0.1          // min. time per measurement (seconds)
+#define BENCH_MIN_REPS 3            // min. number of repetitions
+
+// cost of one call of a kernel (compulsory traffic, see bench_kernels.c)
+typedef struct kernel_cost_struct {
+    double rows;                    // number of rows processed
+    double flops;                   // floating point operations
+    double bytes;                   // bytes moved from/ to memory
+} kernel_cost;
+
+// a kernel call; 'arg' points to the data of the benchmark
+typedef void (*kernel_fn)(void *arg);
+
+// declarations (bench_kernels.c)
+double bench_time(kernel_fn, void*);
+void bench_report(const char*, int, int, int, double, kernel_cost);
+void bench_data(double*, double*, int, int);
+
+// declarations (bench_kernels_mv.c and bench_kernels_reg.c)
+void bench_kernels_mv(double*, double*, int, int, int);
+void bench_kernels_reg(double*, double*, int, int, int);
+int check_select_subset(void);
+#endif
@@ -0,0 +1,155 @@
+/* Microbenchmarks of the kernels of wbacon (mean_scatter_w,
+   mean_scatter_compact, mahalanobis, distance_fused, euclidean_norm2)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   The kernels are static functions of wbacon.c; hence, the source file is
+   included here (this translation unit replaces wbacon.o in the binary
+   bench_kernels, see the makefile).
+*/
+
+#include "bench_kernels.h"
+#include "wbacon.c"
+
+// data of the benchmark
+typedef struct bench_mv_struct {
+    wbdata *dat;
+    workarray *work;
+    double *select_weight;
+    double *center;
+    double *scatter;
+} bench_mv;
+
+static void run_mean_scatter_w(void*);
+static void run_mean_scatter_compact(void*);
+static void run_euclidean_norm2(void*);
+static void run_mahalanobis(void*);
+static void run_distance_fused(void*);
+
+/******************************************************************************\
+|* kernels of wbacon                                                          *|
+|*  x        data, array[n, p]                                                *|
+|*  w        weights, array[n]                                                *|
+|*  n, p     dimensions                                                       *|
+|*  threads  number of threads (OpenMP)                                       *|
+|* NOTE: the cost model counts the streaming passes over arrays of size n as  *|
+|*       written in the code (i.e., the arrays are assumed not to stay in the *|
+|*       cache); the flops of dsyrk, dpotrf, and dtrsm are the usual counts   *|
+\******************************************************************************/
+void bench_kernels_mv(double *x, double *w, int n, int p, int threads)
+{
+    double *w_sqrt = (double*) Calloc(n, double);
+    double *dist = (double*) Calloc(n, double);
+    double *select_weight = (double*) Calloc(n, double);
+    double *center = (double*) Calloc(p, double);
+    double *scatter = (double*) Calloc(p * p, double);
+    double *work_n = (double*) Calloc(n, double);
+    double *work_np = (double*) Calloc(n * p, double);
+    double *work_pp = (double*) Calloc(p * p, double);
+    double *ref = (double*) Calloc(p, double);
+    double *sum_wx = (double*) Calloc(p, double);
+    double *sum_wxx = (double*) Calloc(p * p, double);
+    int *iarray = (int*) Calloc(n, int);
+
+    // subset: all but every 10th observation
+    for (int i = 0; i < n; i++) {
+        w_sqrt[i] = sqrt(w[i]);
+        select_weight[i] = i % 10 == 0 ? 0.0 : 1.0;
+    }
+
+    // the kernels run with the given number of threads (see wbacon_plan.h)
+    wbacon_plan plan;
+    plan_wbacon(&plan, n, p, 4, 1, 0, threads, WBACON_PLAN_FIXED);
+    plan.threads[WBACON_STEP_SCATTER] = threads;
+    plan.threads[WBACON_STEP_DISTANCE] = threads;
+
+    wbdata data = {.n = n, .p = p, .x = x, .w = w, .w_sqrt = w_sqrt,
+        .dist = dist, .sorted = NULL, .perm = NULL, .trace = NULL,
+        .plan = &plan};
+    workarray warray = {.iarray = iarray, .work_n = work_n,
+        .work_np = work_np, .work_pp = work_pp, .work_2n = NULL, .ref = ref,
+        .sum_wx = sum_wx, .sum_wxx = sum_wxx};
+    bench_mv b = {.dat = &data, .work = &warray,
+        .select_weight = select_weight, .center = center, .scatter = scatter};
+
+    double dn = (double)n, dp = (double)p, dnp = dn * dp;
+    double t;
+
+    // mean_scatter_w: weights (3n), mean and centering (6np), dsyrk (np)
+    kernel_cost msw = {.rows = dn,
+        .flops = 2.0 * dn + 5.0 * dnp + dnp * (dp + 1.0),
+        .bytes = 8.0 * (3.0 * dn + 7.0 * dnp)};
+    t = bench_time(run_mean_scatter_w, &b);
+    bench_report("mean_scatter_w", n, p, threads, t, msw);
+
+    // mean_scatter_compact: index (n), weights (m), mean and centering
+    // (gather of 0.9 * 6np), dsyrk (0.9 * np)
+    kernel_cost msc = {.rows = dn,
+        .flops = 0.9 * (dn + 4.0 * dnp + dnp * (dp + 1.0)),
+        .bytes = 8.0 * (dn + 0.9 * (2.0 * dn + 4.0 * dnp))};
+    t = bench_time(run_mean_scatter_compact, &b);
+    bench_report("mean_scatter_compact", n, p, threads, t, msc);
+
+    // euclidean_norm2: x (read), work_np (write), and dist (write)
+    kernel_cost en2 = {.rows = dn, .flops = 5.0 * dnp + 2.0 * dn,
+        .bytes = 8.0 * (2.0 * dnp + dn)};
+    t = bench_time(run_euclidean_norm2, &b);
+    bench_report("euclidean_norm2", n, p, threads, t, en2);
+
+    // mahalanobis: mean_scatter_w, dpotrf, centering (2np), dtrsm (2np), and
+    // row sums (np + 2np)
+    kernel_cost mah = {.rows = dn,
+        .flops = msw.flops + dp * dp * dp / 3.0 + dnp + dnp * dp + 2.0 * dnp,
+        .bytes = msw.bytes + 8.0 * 7.0 * dnp};
+    t = bench_time(run_mahalanobis, &b);
+    bench_report("mahalanobis", n, p, threads, t, mah);
+
+    // distance_fused (on the Cholesky factor left by mahalanobis): x (read),
+    // the tiles stay in the cache, dist (write)
+    kernel_cost dfu = {.rows = dn, .flops = dnp + dnp * dp + 2.0 * dnp,
+        .bytes = 8.0 * (dnp + dn)};
+    t = bench_time(run_distance_fused, &b);
+    bench_report("distance_fused", n, p, threads, t, dfu);
+
+    Free(w_sqrt); Free(dist); Free(select_weight); Free(center);
+    Free(scatter); Free(work_n); Free(work_np); Free(work_pp); Free(ref);
+    Free(sum_wx); Free(sum_wxx); Free(iarray);
+}
+
+static void run_mean_scatter_w(void *arg)
+{
+    bench_mv *b = (bench_mv*) arg;
+    mean_scatter_w(b->dat, b->select_weight, b->work->work_n,
+        b->work->work_np, b->center, b->scatter);
+}
+
+static void run_mean_scatter_compact(void *arg)
+{
+    bench_mv *b = (bench_mv*) arg;
+    mean_scatter_compact(b->dat, b->select_weight, b->work->iarray,
+        b->work->work_np, b->center, b->scatter);
+}
+
+static void run_euclidean_norm2(void *arg)
+{
+    bench_mv *b = (bench_mv*) arg;
+    euclidean_norm2(b->dat, b->work->work_np, b->center);
+}
+
+static void run_mahalanobis(void *arg)
+{
+    bench_mv *b = (bench_mv*) arg;
+    mahalanobis(b->dat, b->work, b->select_weight, b->center, b->scatter,
+        WBACON_KERNEL_MASKED);
+}
+
+static void run_distance_fused(void *arg)
+{
+    bench_mv *b = (bench_mv*) arg;
+    distance_fused(b->dat, b->work->work_np, b->work->work_pp, b->center);
+}
@@ -0,0 +1,194 @@
+/* Microbenchmarks of the kernels of wbacon_reg (hat_matrix, chol_update,
+   chol_downdate) and a check of select_subset
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   The kernels are static functions of wbacon_reg.c; hence, the source file
+   is included here (this translation unit replaces wbacon_reg.o in the
+   binary bench_kernels, see the makefile).
+*/
+
+#include "bench_kernels.h"
+#include "wbacon_reg.c"
+
+// data of the benchmark
+typedef struct bench_reg_struct {
+    regdata *dat;
+    workarray *work;
+    double *L;          // Cholesky factor, array[p, p]
+    double *L0;         // Cholesky factor of 2 * X^T W X, array[p, p]
+    double *u;          // rank-one update, array[p]
+    double *hat;        // diagonal of the hat matrix, array[n]
+} bench_reg;
+
+static void run_hat_matrix(void*);
+static void run_chol_update(void*);
+static void run_chol_downdate(void*);
+static int compare_subset(int*, int*, int);
+
+/******************************************************************************\
+|* kernels of wbacon_reg                                                      *|
+|*  x        design matrix, array[n, p]                                       *|
+|*  w        weights, array[n]                                                *|
+|*  n, p     dimensions                                                       *|
+|*  threads  number of threads (OpenMP)                                       *|
+|* NOTE: chol_update and chol_downdate are called once per row (the rows of   *|
+|*       sqrt(w) * x); one call of the benchmark updates (downdates) the      *|
+|*       Cholesky factor of 2 * X^T W X by all n rows. The factor stays in    *|
+|*       the cache; the compulsory traffic is one read of every row           *|
+\******************************************************************************/
+void bench_kernels_reg(double *x, double *w, int n, int p, int threads)
+{
+    double *w_sqrt = (double*) Calloc(n, double);
+    double *hat = (double*) Calloc(n, double);
+    double *L = (double*) Calloc(p * p, double);
+    double *L0 = (double*) Calloc(p * p, double);
+    double *u = (double*) Calloc(p, double);
+    double *work_np = (double*) Calloc(n * p, double);
+    double *work_pp = (double*) Calloc(p * p, double);
+
+    // Cholesky factor of 2 * X^T W X
+    for (int i = 0; i < n; i++)
+        w_sqrt[i] = sqrt(w[i]);
+    for (int j = 0; j < p; j++)
+        for (int i = 0; i < n; i++)
+            work_np[i + n * j] = w_sqrt[i] * x[i + n * j];
+
+    int info;
+    const double d_zero = 0.0, d_two = 2.0;
+    F77_CALL(dsyrk)("L", "T", &p, &n, &d_two, work_np, &n, &d_zero, L0, &p);
+    F77_CALL(dpotrf)("L", &p, L0, &p, &info);
+    if (info != 0) {
+        PRINT_OUT("Error: design matrix is rank deficient\n");
+        goto clean_up;
+    }
+    Memcpy(L, L0, p * p);
+
+    regdata data = {.n = n, .p = p, .w = w, .w_sqrt = w_sqrt, .x = x,
+        .wx = NULL, .y = NULL, .wy = NULL, .trace = NULL};
+    workarray warray = {.lwork = 0, .iarray = NULL, .work_p = NULL,
+        .work_n = hat, .work_np = work_np, .work_pp = work_pp,
+        .dgels_work = NULL};
+    bench_reg b = {.dat = &data, .work = &warray, .L = L, .L0 = L0, .u = u,
+        .hat = hat};
+
+    double dn = (double)n, dp = (double)p, dnp = dn * dp;
+    double t;
+
+    // hat_matrix: copy (2np), dtrmm (2np), row sums (np + 2np), weights (3n)
+    kernel_cost hm = {.rows = dn,
+        .flops = dp * dp * dp / 3.0 + dnp * dp + 2.0 * dnp + dn,
+        .bytes = 8.0 * (7.0 * dnp + 3.0 * dn)};
+    t = bench_time(run_hat_matrix, &b);
+    bench_report("hat_matrix", n, p, threads, t, hm);
+
+    // chol_update/ chol_downdate: 6 flops per off-diagonal element and 7 per
+    // diagonal element; one read of every row
+    kernel_cost cu = {.rows = dn,
+        .flops = dn * (3.0 * dp * (dp - 1.0) + 7.0 * dp),
+        .bytes = 8.0 * dnp};
+    t = bench_time(run_chol_update, &b);
+    bench_report("chol_update", n, p, threads, t, cu);
+
+    t = bench_time(run_chol_downdate, &b);
+    bench_report("chol_downdate", n, p, threads, t, cu);
+
+clean_up:
+    Free(w_sqrt); Free(hat); Free(L); Free(L0); Free(u); Free(work_np);
+    Free(work_pp);
+}
+
+static void run_hat_matrix(void *arg)
+{
+    bench_reg *b = (bench_reg*) arg;
+    hat_matrix(b->dat, b->work, b->L, b->hat);
+}
+
+static void run_chol_update(void *arg)
+{
+    bench_reg *b = (bench_reg*) arg;
+    int n = b->dat->n, p = b->dat->p;
+    double *x = b->dat->x, *w_sqrt = b->dat->w_sqrt;
+
+    Memcpy(b->L, b->L0, p * p);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < p; j++)
+            b->u[j] = w_sqrt[i] * x[i + n * j];
+        chol_update(b->L, b->u, p);
+    }
+}
+
+static void run_chol_downdate(void *arg)
+{
+    bench_reg *b = (bench_reg*) arg;
+    int n = b->dat->n, p = b->dat->p;
+    double *x = b->dat->x, *w_sqrt = b->dat->w_sqrt;
+
+    // on return, L is the Cholesky factor of X^T W X
+    Memcpy(b->L, b->L0, p * p);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < p; j++)
+            b->u[j] = w_sqrt[i] * x[i + n * j];
+        if (chol_downdate(b->L, b->u, p) != WBACON_ERROR_OK)
+            break;
+    }
+}
+
+/******************************************************************************\
+|* check of select_subset: the warm start (with hint) and the cold start      *|
+|* (without hint) must select the same subset, also if there are ties with    *|
+|* the threshold (the ties are taken in the order of the index)               *|
+|* value: number of failures                                                  *|
+|* NOTE: m increases by one per step (as in Algorithm 4); the distances take  *|
+|*       only a few distinct values, hence there are many ties               *|
+\******************************************************************************/
+int check_select_subset(void)
+{
+    int n_fail = 0;
+
+    // the ties must follow the elements smaller than the threshold
+    int n = 3, m = 2;
+    double x3[3] = {1.0, 1.0, 0.0}, work3[3];
+    int subset3[3], expected[3] = {1, 0, 1};
+    select_subset(x3, work3, subset3, &m, &n, NULL);
+    n_fail += compare_subset(subset3, expected, n);
+
+    n = 500;
+    double *x = (double*) Calloc(n, double);
+    double *work_n = (double*) Calloc(n, double);
+    int *warm = (int*) Calloc(n, int);
+    int *cold = (int*) Calloc(n, int);
+    int *band = (int*) Calloc(n, int);
+    subset_hint hint = {.valid = 0, .enabled = 1, .width = 4, .lo = 0.0,
+        .hi = 0.0, .band = band};
+
+    srand(1);
+    for (int trial = 0; trial < 10; trial++) {
+        for (int i = 0; i < n; i++)
+            x[i] = (double)(rand() % (trial + 2));
+        hint.valid = 0;
+        for (m = 1; m <= n; m++) {
+            select_subset(x, work_n, warm, &m, &n, &hint);
+            select_subset(x, work_n, cold, &m, &n, NULL);
+            n_fail += compare_subset(warm, cold, n);
+        }
+    }
+    printf("# check select_subset (ties, warm vs. cold start): %s\n",
+        n_fail ? "FAIL" : "OK");
+
+    Free(x); Free(work_n); Free(warm); Free(cold); Free(band);
+    return n_fail;
+}
+
+static int compare_subset(int *subset, int *reference, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (subset[i] != reference[i])
+            return 1;
+    return 0;
+}
@@ -0,0 +1,338 @@
+/* Benchmark and stress suite for the selection routines
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   Build:      make -f _myMakefile bench_select
+   Usage:      ./bench_select [log2_n_max]     (default: 20)
+   Output:     one CSV line per routine, input pattern, and n: time per
+               element and the counters of the selection engine (elements
+               scanned by the partitioning, partitioning steps,
+               median-of-medians pivots, and the max. nesting depth of the
+               partitioning steps); then one summary line per routine and
+               pattern with the growth exponents of time and scanned
+               elements: the median of log2(t(2n) / t(n)) over the grid of n
+               (the median is not affected by a switch of the algorithm at
+               some n, e.g. to radix selection, which changes the constant
+               but not the growth)
+   Exit code:  1 if a result is wrong, the growth of the scanned elements is
+               superlinear (exponent > EXPONENT_MAX_SCANNED; for the full
+               sort, the counters are divided by log2(n)), or the depth
+               exceeds DEPTH_MAX_FACTOR * log2(n); 0 otherwise. The verdict
+               depends only on the counters (deterministic); the growth
+               exponent of the time is printed for information
+   Note:       The engine must be compiled with -DSELECT_STATS (see the
+               makefile); the counters are not thread-safe, hence we run on
+               one thread. McIlroy's (1999) adversary cannot be used since
+               the engine compares the keys inline; the median-of-3 killer
+               of Musser (1997) is used instead.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "selection.h"
+#include "median.h"
+#include "partial_sort.h"
+#include "wquantile.h"
+
+#ifndef SELECT_STATS
+#error "the selection engine must be compiled with -DSELECT_STATS"
+#endif
+
+#define LOG2_N_MIN 12           // smallest n = 2^12
+#define LOG2_N_FIT 14           // growth is measured for n >= 2^14
+#define EXPONENT_MAX_SCANNED 1.15 // max. growth exponent of scanned elements
+#define DEPTH_MAX_FACTOR 4      // max. nesting depth: factor * log2(n)
+#define PSORT_K 64              // partial sort: k smallest elements
+
+typedef enum {
+    PAT_RANDOM, PAT_SORTED, PAT_REVERSED, PAT_ORGAN_PIPE, PAT_M3_KILLER,
+    PAT_ALL_TIES, PAT_FEW_DISTINCT, PAT_SAWTOOTH, PAT_DENORMAL, N_PATTERNS
+} pattern_type;
+
+static const char *pattern_names[] = {"random", "sorted", "reversed",
+    "organ_pipe", "m3_killer", "all_ties", "few_distinct", "sawtooth",
+    "denormal"};
+
+typedef enum {
+    RT_SELECT_K, RT_MEDIAN, RT_WQUANT, RT_WQUANT_SKEW, RT_PSORT_PARTIAL,
+    RT_PSORT_FULL, N_ROUTINES
+} routine_type;
+
+static const char *routine_names[] = {"select_k", "median_destructive",
+    "wquant0", "wquant0_skew", "psort_partial", "psort_full"};
+
+// data of one run
+typedef struct bench_struct {
+    int n;
+    double *orig;           // input pattern
+    double *ref;            // sorted input (reference)
+    double *w;              // weights
+    double *x;              // array passed to the routine
+    double *work;           // work array[2 * n]
+    int *index;
+} bench;
+
+static double now(void);
+static void generate(pattern_type, double*, int);
+static int cmp_double(const void*, const void*);
+static double run(routine_type, bench*, select_stats_type*, int*);
+static double growth(double*, int);
+
+int main(int argc, char **argv)
+{
+    int log2_n_max = argc > 1 ? atoi(argv[1]) : 20;
+    if (log2_n_max < LOG2_N_FIT + 1 || log2_n_max > 26) {
+        fprintf(stderr, "log2_n_max must be in %d:26\n", LOG2_N_FIT + 1);
+        return 1;
+    }
+    #ifdef _OPENMP
+    omp_set_num_threads(1);
+    #endif
+
+    int n_max = 1 << log2_n_max, n_grid = log2_n_max - LOG2_N_MIN + 1;
+    bench b;
+    b.orig = (double*) malloc(n_max * sizeof(double));
+    b.ref = (double*) malloc(n_max * sizeof(double));
+    b.w = (double*) malloc(n_max * sizeof(double));
+    b.x = (double*) malloc(n_max * sizeof(double));
+    b.work = (double*) malloc(2 * n_max * sizeof(double));
+    b.index = (int*) malloc(n_max * sizeof(int));
+    double *log_t = (double*) malloc(n_grid * sizeof(double));
+    double *log_s = (double*) malloc(n_grid * sizeof(double));
+
+    int n_fail = 0, wrong;
+    printf("routine,pattern,n,ns_per_n,scanned_per_n,partitions,fallbacks,"
+        "depth\n");
+    for (int r = 0; r < N_ROUTINES; r++) {
+        for (int pat = 0; pat < N_PATTERNS; pat++) {
+            int n_fit = 0, depth_ok = 1;
+            for (int g = 0; g < n_grid; g++) {
+                b.n = 1 << (LOG2_N_MIN + g);
+                srand(1234 + pat);
+                generate((pattern_type)pat, b.orig, b.n);
+                Memcpy(b.ref, b.orig, b.n);
+                qsort(b.ref, b.n, sizeof(double), cmp_double);
+
+                // repetitions: about 2^22 elements per n (best time)
+                int reps = (1 << 22) / b.n;
+                reps = reps < 3 ? 3 : reps;
+                double t, t_min = DBL_MAX;
+                select_stats_type stats;
+                wrong = 0;
+                for (int rep = 0; rep < reps; rep++) {
+                    t = run((routine_type)r, &b, &stats, &wrong);
+                    t_min = t < t_min ? t : t_min;
+                }
+
+                double scale = r == RT_PSORT_FULL ? log2((double)b.n) : 1.0;
+                printf("%s,%s,%d,%.3f,%.3f,%d,%d,%d\n", routine_names[r],
+                    pattern_names[pat], b.n, 1e9 * t_min / b.n,
+                    stats.n_scanned / b.n, stats.n_partition,
+                    stats.n_fallback, stats.max_depth);
+                depth_ok &= stats.max_depth
+                    <= DEPTH_MAX_FACTOR * (LOG2_N_MIN + g);
+                if (wrong) {
+                    printf("# FAIL %s %s n = %d: wrong result\n",
+                        routine_names[r], pattern_names[pat], b.n);
+                    n_fail++;
+                }
+
+                // the partial sort may scan (almost) no elements in the
+                // engine (radix selection); hence, we add n
+                if (LOG2_N_MIN + g >= LOG2_N_FIT) {
+                    log_t[n_fit] = log2(t_min / scale);
+                    log_s[n_fit] = log2((stats.n_scanned + b.n) / scale);
+                    n_fit++;
+                }
+            }
+
+            double exp_t = growth(log_t, n_fit);
+            double exp_s = growth(log_s, n_fit);
+            int ok = exp_s <= EXPONENT_MAX_SCANNED && depth_ok;
+            printf("# %s %s growth_time %.3f growth_scanned %.3f depth %s "
+                "%s\n", routine_names[r], pattern_names[pat], exp_t, exp_s,
+                depth_ok ? "ok" : "exceeded", ok ? "OK" : "FAIL");
+            n_fail += !ok;
+        }
+    }
+    printf("# %d failure(s)\n", n_fail);
+
+    free(b.orig); free(b.ref); free(b.w); free(b.x); free(b.work);
+    free(b.index); free(log_t); free(log_s);
+    return n_fail > 0;
+}
+
+/******************************************************************************\
+|* run a routine on a copy of the input and check the result                  *|
+|*  routine  routine                                                          *|
+|*  b        typedef struct bench                                             *|
+|*  stats    on return: counters of the selection engine (the call only)      *|
+|*  wrong    on return: incremented if the result is wrong                    *|
+|* value: elapsed time (seconds) of the call of the routine                   *|
+\******************************************************************************/
+static double run(routine_type routine, bench *b, select_stats_type *stats,
+    int *wrong)
+{
+    int n = b->n, k = (n + 1) / 2 - 1;
+    double t, result, ref, prob = 0.5;
+    wpair *a = (wpair*)b->work;
+
+    switch (routine) {
+    case RT_SELECT_K:
+        Memcpy(b->x, b->orig, n);
+        memset(&select_stats, 0, sizeof(select_stats));
+        t = now();
+        select_k(b->x, 0, n - 1, k);
+        t = now() - t;
+        *stats = select_stats;
+        *wrong += b->x[k] != b->ref[k];
+        break;
+    case RT_MEDIAN:
+        Memcpy(b->x, b->orig, n);
+        memset(&select_stats, 0, sizeof(select_stats));
+        t = now();
+        median_destructive(b->x, &n, &result);
+        t = now() - t;
+        *stats = select_stats;
+        ref = n % 2 ? b->ref[k] : (b->ref[k] + b->ref[k + 1]) / 2.0;
+        *wrong += result != ref;
+        break;
+    case RT_WQUANT:
+    case RT_WQUANT_SKEW:
+        // equal weights: the weighted median is the (lower) median; skewed
+        // weights (Pareto with shape 0.5; a few weights dominate): the result
+        // is checked with the weighted quantile of the sorted data
+        for (int i = 0; i < n; i++) {
+            b->w[i] = routine == RT_WQUANT ? 1.0
+                : pow((rand() + 1.0) / ((double)RAND_MAX + 1.0), -2.0);
+            a[i].x = b->orig[i];
+            a[i].w = b->w[i];
+        }
+        memset(&select_stats, 0, sizeof(select_stats));
+        t = now();
+        wquant_pair(a, n, prob, &result);
+        t = now() - t;
+        *stats = select_stats;
+        if (routine == RT_WQUANT) {
+            ref = n % 2 ? b->ref[k] : (b->ref[k] + b->ref[k + 1]) / 2.0;
+        } else {
+            Memcpy(b->x, b->orig, n);
+            for (int i = 0; i < n; i++)
+                b->index[i] = i;
+            select_sort_indx(b->x, b->index, 0, n - 1);
+            wquant_sorted(b->x, b->index, b->w, 0.0, n, &prob, 1, &ref);
+        }
+        *wrong += result != ref;
+        break;
+    case RT_PSORT_PARTIAL:
+    case RT_PSORT_FULL:
+        k = routine == RT_PSORT_FULL ? n : PSORT_K;
+        Memcpy(b->x, b->orig, n);
+        memset(&select_stats, 0, sizeof(select_stats));
+        t = now();
+        psort_array(b->x, b->index, n, k, b->work);
+        t = now() - t;
+        *stats = select_stats;
+        for (int i = 0; i < n; i++)
+            *wrong += b->x[i] != b->orig[b->index[i]]
+                || (i < k && b->x[i] != b->ref[i]);
+        break;
+    default:
+        t = 0.0;
+        memset(stats, 0, sizeof(select_stats_type));
+    }
+    return t;
+}
+
+/******************************************************************************\
+|* input patterns                                                             *|
+|*  pattern  pattern                                                          *|
+|*  x        on return: array[n]                                              *|
+|*  n        dimension                                                        *|
+\******************************************************************************/
+static void generate(pattern_type pattern, double *x, int n)
+{
+    int half = n / 2;
+    switch (pattern) {
+    case PAT_RANDOM:
+        for (int i = 0; i < n; i++)
+            x[i] = rand() / (double)RAND_MAX;
+        break;
+    case PAT_SORTED:
+        for (int i = 0; i < n; i++)
+            x[i] = (double)i;
+        break;
+    case PAT_REVERSED:
+        for (int i = 0; i < n; i++)
+            x[i] = (double)(n - i);
+        break;
+    case PAT_ORGAN_PIPE:
+        for (int i = 0; i < n; i++)
+            x[i] = (double)(i < half ? i : n - i);
+        break;
+    case PAT_M3_KILLER:
+        // Musser (1997): median-of-3 killer sequence (n even)
+        for (int i = 1; i <= half; i++) {
+            x[i - 1] = (double)(i % 2 ? i : half + i - 1);
+            x[half + i - 1] = (double)(2 * i);
+        }
+        break;
+    case PAT_ALL_TIES:
+        for (int i = 0; i < n; i++)
+            x[i] = 1.0;
+        break;
+    case PAT_FEW_DISTINCT:
+        for (int i = 0; i < n; i++)
+            x[i] = (double)(rand() % 4);
+        break;
+    case PAT_SAWTOOTH:
+        for (int i = 0; i < n; i++)
+            x[i] = (double)(i % 64);
+        break;
+    case PAT_DENORMAL:
+        // subnormal numbers (no NaN)
+        for (int i = 0; i < n; i++)
+            x[i] = DBL_MIN * (rand() / ((double)RAND_MAX + 1.0));
+        break;
+    default:
+        break;
+    }
+}
+
+/******************************************************************************\
+|* growth exponent: median of the differences of log2(cost) between           *|
+|* successive n (n doubles)                                                   *|
+|*  log_cost  log2(cost), array[n]                                            *|
+|*  n         dimension                                                       *|
+\******************************************************************************/
+static double growth(double *log_cost, int n)
+{
+    double diff[32];
+    for (int i = 0; i < n - 1; i++)
+        diff[i] = log_cost[i + 1] - log_cost[i];
+    qsort(diff, n - 1, sizeof(double), cmp_double);
+    return n % 2 ? (diff[(n - 1) / 2 - 1] + diff[(n - 1) / 2]) / 2.0
+        : diff[(n - 1) / 2];
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
@@ -0,0 +1,214 @@
+/* Benchmark of the engines wbacon and wbacon_reg (standalone binary)
+
+   Copyright (C) 2020-2021 Tobias Schoch (e-mail: tobias.schoch@gmail.com)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   Build:      make -f _myMakefile bench_wbacon
+   Usage:      ./bench_wbacon [n_max] [replicates] [plan]
+               (default: n_max = 1000000, replicates = 3, plan = 1); plan
+               1: the planner chooses the kernels of wbacon (cost model),
+               0: fixed plan, 2: deterministic plan (see src/wbacon_plan.h)
+   Data:       contamination model of Billor et al. (2000, p. 290); see
+               tests/simulation/simulation.R: the first floor(n * eps) rows
+               are N(4, I_p), the other rows are N(0, I_p). Regression: the
+               design matrix is [1, x] and y = 1 + sum(x) + N(0, 1); the
+               response of the contaminated rows is shifted by 10.
+   Output:     CSV, one line per engine, n, p, eps, threads, and replicate:
+               wall time (seconds) of the engine call, the per-phase times
+               of the engine (see src/wbacon_trace.h), the peak working set
+               (bytes; see src/wbacon_memory.h), the number of nominated
+               outliers, and the parallel efficiency t(1) / (threads * t),
+               where t(1) is the mean time on one thread
+   Note:       The engines are compiled with -DR_PACKAGE=0 (messages by
+               printf). The data are generated by a xorshift generator, not
+               by R's generators; the numbers are timings, not reference
+               results.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "wbacon.h"
+#include "wbacon_reg.h"
+#include "wbacon_trace.h"
+
+// grid of scenarios
+static const int grid_n[] = {10000, 100000, 1000000};
+static const int grid_p[] = {5, 10, 20};
+static const double grid_eps[] = {0.0, 0.1, 0.2};
+#define N_GRID_N (sizeof(grid_n) / sizeof(grid_n[0]))
+#define N_GRID_P (sizeof(grid_p) / sizeof(grid_p[0]))
+#define N_GRID_EPS (sizeof(grid_eps) / sizeof(grid_eps[0]))
+#define MAX_THREADS 64
+
+static uint64_t rng_state = 88172645463325252ULL;
+static double rnorm(void);
+static void generate(double*, double*, double*, double*, int, int, double);
+static void print_line(const char*, int, int, double, int, int, double,
+    double*, double*, int, double);
+
+int main(int argc, char **argv)
+{
+    int n_max = argc > 1 ? atoi(argv[1]) : 1000000;
+    int replicates = argc > 2 ? atoi(argv[2]) : 3;
+    int plan = argc > 3 ? atoi(argv[3]) : WBACON_PLAN_AUTO;
+
+    int max_threads = 1;
+    #ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+    #endif
+    max_threads = max_threads > MAX_THREADS ? MAX_THREADS : max_threads;
+
+    printf("engine,n,p,eps,threads,replicate,wall");
+    for (int k = 0; k < WBACON_PHASE_COUNT; k++)
+        printf(",%s", trace_phase_name((wbacon_phase_type)k));
+    printf(",peak_bytes,outliers,efficiency\n");
+
+    for (size_t gn = 0; gn < N_GRID_N; gn++) {
+        int n = grid_n[gn];
+        if (n > n_max)
+            break;
+        for (size_t gp = 0; gp < N_GRID_P; gp++) {
+            int p = grid_p[gp], q = p + 1;
+            // data, copies (the engines overwrite x), and results
+            double *x0 = (double*) Calloc(n * p, double);
+            double *x = (double*) Calloc(n * p, double);
+            double *X0 = (double*) Calloc(n * q, double);
+            double *X = (double*) Calloc(n * q, double);
+            double *y = (double*) Calloc(n, double);
+            double *w = (double*) Calloc(n, double);
+            double *center = (double*) Calloc(p, double);
+            double *scatter = (double*) Calloc(p * p, double);
+            double *dist = (double*) Calloc(n, double);
+            double *dist0 = (double*) Calloc(n, double);
+            double *resid = (double*) Calloc(n, double);
+            double *beta = (double*) Calloc(q, double);
+            int *subset = (int*) Calloc(n, int);
+            int *subset0 = (int*) Calloc(n, int);
+            double trace[WBACON_TRACE_HEADER] = {0};
+            double memory[WBACON_MEMORY_LEN];
+            int trace_len = WBACON_TRACE_HEADER, cached = 0;
+
+            for (size_t ge = 0; ge < N_GRID_EPS; ge++) {
+                double eps = grid_eps[ge];
+                generate(x0, X0, y, w, n, p, eps);
+
+                double t1_mv = 0.0, t1_reg = 0.0;
+                for (int threads = 1; threads <= max_threads; threads *= 2) {
+                    for (int r = 0; r < replicates; r++) {
+                        // Algorithm 3 (wbacon)
+                        double alpha = 0.05, cutoff;
+                        int maxiter = 50, verbose = 0, version2 = 1;
+                        int collect = 4, success;
+                        double budget = 0.0;    // no time budget
+                        int stop;
+                        char *checkpoint = "";  // no checkpoints
+                        int resume = 0;
+                        Memcpy(x, x0, n * p);
+                        double t = trace_clock();
+                        wbacon(x, w, center, scatter, dist, &n, &p, &alpha,
+                            subset, &cutoff, &maxiter, &verbose, &version2,
+                            &collect, &success, &threads, NULL, NULL,
+                            &cached, trace, &trace_len, memory, &plan,
+                            &budget, &stop, &checkpoint, &resume);
+                        t = trace_clock() - t;
+                        if (threads == 1)
+                            t1_mv += t / replicates;
+
+                        int m = 0;
+                        for (int i = 0; i < n; i++)
+                            m += subset[i];
+                        print_line("wbacon", n, p, eps, threads, r, t, trace,
+                            memory, n - m,
+                            threads == 1 ? 1.0 : t1_mv / (threads * t));
+                        Memcpy(subset0, subset, n);
+                        Memcpy(dist0, dist, n);
+
+                        // Algorithms 4 and 5 (wbacon_reg)
+                        int original = 0;
+                        maxiter = 50;
+                        Memcpy(X, X0, n * q);
+                        t = trace_clock();
+                        wbacon_reg(X, y, w, resid, beta, subset, dist, &n, &q,
+                            &m, &verbose, &success, &collect, &alpha, &maxiter,
+                            &original, &threads, trace, &trace_len, memory,
+                            &plan, &budget, &stop, &checkpoint, &resume);
+                        t = trace_clock() - t;
+                        if (threads == 1)
+                            t1_reg += t / replicates;
+
+                        print_line("wbacon_reg", n, q, eps, threads, r, t,
+                            trace, memory, n - m,
+                            threads == 1 ? 1.0 : t1_reg / (threads * t));
+                        Memcpy(subset, subset0, n);
+                        Memcpy(dist, dist0, n);
+                    }
+                }
+            }
+            Free(x0); Free(x); Free(X0); Free(X); Free(y); Free(w);
+            Free(center); Free(scatter); Free(dist); Free(dist0);
+            Free(resid); Free(beta); Free(subset); Free(subset0);
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************\
+|* one line of output (CSV)                                                   *|
+\******************************************************************************/
+static void print_line(const char *engine, int n, int p, double eps,
+    int threads, int replicate, double wall, double *trace, double *memory,
+    int outliers, double efficiency)
+{
+    printf("%s,%d,%d,%.2f,%d,%d,%.6f", engine, n, p, eps, threads, replicate,
+        wall);
+    for (int k = 0; k < WBACON_PHASE_COUNT; k++)
+        printf(",%.6f", trace[k]);
+    printf(",%.0f,%d,%.3f\n", memory[0], outliers, efficiency);
+}
+
+/******************************************************************************\
+|* contamination model of Billor et al. (2000)                                *|
+|*  x        on return: data, array[n, p]                                     *|
+|*  X        on return: design matrix [1, x], array[n, p + 1]                 *|
+|*  y        on return: response, array[n]                                    *|
+|*  w        on return: weights (equal to one), array[n]                      *|
+|*  n, p     dimensions                                                       *|
+|*  eps      share of contaminated rows (the first floor(n * eps) rows)       *|
+\******************************************************************************/
+static void generate(double *x, double *X, double *y, double *w, int n, int p,
+    double eps)
+{
+    int n_bad = (int)floor(n * eps);
+    for (int i = 0; i < n; i++) {
+        w[i] = 1.0;
+        X[i] = 1.0;
+        y[i] = 1.0 + rnorm() + (i < n_bad ? 10.0 : 0.0);
+        for (int j = 0; j < p; j++) {
+            x[i + j * n] = rnorm() + (i < n_bad ? 4.0 : 0.0);
+            X[i + (j + 1) * n] = x[i + j * n];
+            y[i] += x[i + j * n];
+        }
+    }
+}
+
+/******************************************************************************\
+|* standard Gaussian random number (xorshift64 and Box-Muller)                *|
+\******************************************************************************/
+static double rnorm(void)
+{
+    double u[2];
+    for (int k = 0; k < 2; k++) {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        u[k] = ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}